@@ -0,0 +1,148 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace RHI::Benchmarks
+{
+    std::vector<Benchmark>& getBenchmarks()
+    {
+        static std::vector<Benchmark> benchmarks;
+        return benchmarks;
+    }
+
+    HeadlessDevice::HeadlessDevice()
+    {
+        const VkApplicationInfo appInfo = {
+                VK_STRUCTURE_TYPE_APPLICATION_INFO,
+                nullptr,
+                "rhiBenchmarks",
+                VK_MAKE_VERSION(1, 0, 0),
+                "No Engine",
+                VK_MAKE_VERSION(1, 0, 0),
+                VK_API_VERSION_1_2
+        };
+
+        VkInstanceCreateInfo instanceInfo{};
+        instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceInfo.pApplicationInfo = &appInfo;
+
+        Vulkan::checkSuccess(vkCreateInstance(&instanceInfo, nullptr, &instance));
+        volkLoadInstance(instance);
+
+        Vulkan::checkSuccess(Vulkan::findBestSuitablePhysicalDevice(instance, Vulkan::rateDeviceSuitability, &physicalDevice));
+        graphicsFamily = Vulkan::findQueueFamilies(physicalDevice, VK_QUEUE_GRAPHICS_BIT);
+
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensionProperties(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensionProperties.data());
+
+        // only what the benchmarked paths need, the allocator reads the budget when the device reports it
+        std::vector<const char*> extensions;
+        for (const VkExtensionProperties& properties : extensionProperties) {
+            if (!strcmp(properties.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+                ctxExtensions.EXT_memory_budget = true;
+                extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            }
+        }
+        ctxExtensions.KHR_swapchain = false;
+        ctxFeatures.geometryShader_ = false;
+        ctxFeatures.timelineSemaphore = true;
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphore{};
+        timelineSemaphore.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineSemaphore.timelineSemaphore = VK_TRUE;
+
+        VkPhysicalDeviceFeatures2 deviceFeatures2{};
+        deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        deviceFeatures2.pNext = &timelineSemaphore;
+
+        const float queuePriority = 0.f;
+
+        VkDeviceQueueCreateInfo queueInfo{};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = graphicsFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+
+        VkDeviceCreateInfo deviceInfo{};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.pNext = &deviceFeatures2;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        deviceInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        deviceInfo.ppEnabledExtensionNames = extensions.data();
+
+        Vulkan::checkSuccess(vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device));
+        volkLoadDevice(device);
+
+        vkGetDeviceQueue(device, graphicsFamily, 0, &graphicsQueue);
+
+        Vulkan::DeviceDesc desc{};
+        desc.instance = instance;
+        desc.physicalDevice = physicalDevice;
+        desc.device = device;
+        desc.ctxExtensions = &ctxExtensions;
+        desc.ctxFeatures = &ctxFeatures;
+        desc.graphicsFamily = graphicsFamily;
+        desc.graphicsQueue = graphicsQueue;
+        desc.useGraphicsQueue = true;
+        desc.useTransferQueue = false;
+
+        rhiDevice = RHI::DeviceHandle(new Vulkan::Device(desc));
+    }
+
+    HeadlessDevice::~HeadlessDevice()
+    {
+        rhiDevice = nullptr;
+
+        vkDestroyDevice(device, nullptr);
+        vkDestroyInstance(instance, nullptr);
+    }
+
+    uint32_t HeadlessDevice::findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) const
+    {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((memoryTypeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+                return i;
+        }
+
+        printf("No memory type with the requested properties\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+using namespace RHI::Benchmarks;
+
+// rhiBenchmarks [--threads N] [benchmark names...], without names every benchmark runs
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    std::vector<std::string> selected;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            options.threadCount = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+        else
+            selected.emplace_back(argv[i]);
+    }
+
+    RHI::Vulkan::checkSuccess(volkInitialize());
+
+    for (const Benchmark& benchmark : getBenchmarks()) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), benchmark.name) == selected.end())
+            continue;
+
+        printf("%s\n", benchmark.name);
+
+        HeadlessDevice device;
+        benchmark.function(device, options);
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <VulkanBackend.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace RHI::Benchmarks
+{
+    // Vulkan objects of a device created without a surface, benchmarks get a new one each
+    struct HeadlessDevice
+    {
+        VkInstance instance = VK_NULL_HANDLE;
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        VkDevice device = VK_NULL_HANDLE;
+        VkQueue graphicsQueue = VK_NULL_HANDLE;
+        uint32_t graphicsFamily = 0;
+
+        Vulkan::VulkanContextExtensions ctxExtensions;
+        Vulkan::VulkanContextFeatures ctxFeatures;
+
+        RHI::DeviceHandle rhiDevice;
+
+        HeadlessDevice();
+        ~HeadlessDevice();
+
+        Vulkan::Device* getDevice() const { return static_cast<Vulkan::Device*>(rhiDevice.get()); }
+        uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) const;
+    };
+
+    struct BenchmarkOptions
+    {
+        // upper bound of the worker threads of multithreaded benchmarks
+        uint32_t threadCount = 16;
+    };
+
+    using BenchmarkFunction = void (*)(HeadlessDevice& device, const BenchmarkOptions& options);
+
+    struct Benchmark
+    {
+        const char* name;
+        BenchmarkFunction function;
+    };
+
+    std::vector<Benchmark>& getBenchmarks();
+
+    struct BenchmarkRegistration
+    {
+        BenchmarkRegistration(const char* name, BenchmarkFunction function) { getBenchmarks().push_back({ name, function }); }
+    };
+
+#define RHI_BENCHMARK(name) \
+    static void name(RHI::Benchmarks::HeadlessDevice& device, [[maybe_unused]] const RHI::Benchmarks::BenchmarkOptions& options); \
+    static RHI::Benchmarks::BenchmarkRegistration s_##name##Registration(#name, name); \
+    static void name(RHI::Benchmarks::HeadlessDevice& device, [[maybe_unused]] const RHI::Benchmarks::BenchmarkOptions& options)
+
+    class Timer
+    {
+    public:
+        Timer() : m_Start(std::chrono::steady_clock::now()) {}
+
+        double elapsedMilliseconds() const
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count();
+        }
+
+    private:
+        std::chrono::steady_clock::time_point m_Start;
+    };
+
+    // fastest of several runs of function in milliseconds, for loops short enough to be disturbed by the scheduler
+    template <typename Function>
+    double measureFastest(uint32_t runCount, Function&& function)
+    {
+        double fastest = 0.0;
+        for (uint32_t run = 0; run < runCount; run++) {
+            Timer timer;
+            function();
+            const double elapsed = timer.elapsedMilliseconds();
+            fastest = run == 0 ? elapsed : std::min(fastest, elapsed);
+        }
+        return fastest;
+    }
+
+    inline void report(const char* measurement, double value, const char* unit)
+    {
+        printf("  %-48s %14.2f %s\n", measurement, value, unit);
+    }
+
+    inline void report(const char* measurement, uint64_t count)
+    {
+        printf("  %-48s %14llu\n", measurement, static_cast<unsigned long long>(count));
+    }
+}
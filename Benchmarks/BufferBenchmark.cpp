@@ -0,0 +1,89 @@
+#include "Benchmark.hpp"
+
+using namespace RHI;
+using namespace RHI::Benchmarks;
+
+static constexpr uint32_t kBufferCount = 100000;
+static constexpr uint64_t kBufferSize = 16 * 1024;
+
+// Device::createBuffer sub-allocates from memory blocks
+RHI_BENCHMARK(BufferCreateDestroy)
+{
+    std::vector<BufferHandle> buffers;
+    buffers.reserve(kBufferCount);
+
+    const BufferDesc desc = BufferDesc{}
+        .setSize(kBufferSize)
+        .setIsVertexBuffer(true)
+        .setIsTransferDst(true);
+
+    Timer createTimer;
+    for (uint32_t i = 0; i < kBufferCount; i++)
+        buffers.push_back(device.rhiDevice->createBuffer(desc));
+    const double createTime = createTimer.elapsedMilliseconds();
+
+    const MemoryStatistics statistics = device.rhiDevice->getMemoryStatistics();
+
+    Timer destroyTimer;
+    buffers.clear();
+    const double destroyTime = destroyTimer.elapsedMilliseconds();
+
+    report("create 100k buffers", createTime, "ms");
+    report("destroy 100k buffers", destroyTime, "ms");
+    report("device memory allocations", uint64_t(statistics.blockCount + statistics.dedicatedAllocationCount));
+}
+
+// the same buffers with one vkAllocateMemory each, as createBuffer did before the allocator
+RHI_BENCHMARK(BufferCreateDestroyPerResourceMemory)
+{
+    struct RawBuffer
+    {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+    };
+    std::vector<RawBuffer> buffers;
+    buffers.reserve(kBufferCount);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = kBufferSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    Timer createTimer;
+    for (uint32_t i = 0; i < kBufferCount; i++) {
+        RawBuffer raw{};
+        Vulkan::checkSuccess(vkCreateBuffer(device.device, &bufferInfo, nullptr, &raw.buffer));
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device.device, raw.buffer, &requirements);
+
+        VkMemoryAllocateInfo allocateInfo{};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.allocationSize = requirements.size;
+        allocateInfo.memoryTypeIndex = device.findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        // drivers may refuse allocations past maxMemoryAllocationCount
+        if (vkAllocateMemory(device.device, &allocateInfo, nullptr, &raw.memory) != VK_SUCCESS) {
+            vkDestroyBuffer(device.device, raw.buffer, nullptr);
+            printf("  vkAllocateMemory failed after %u allocations\n", uint32_t(buffers.size()));
+            break;
+        }
+
+        Vulkan::checkSuccess(vkBindBufferMemory(device.device, raw.buffer, raw.memory, 0));
+        buffers.push_back(raw);
+    }
+    const double createTime = createTimer.elapsedMilliseconds();
+    const size_t allocationCount = buffers.size();
+
+    Timer destroyTimer;
+    for (const RawBuffer& raw : buffers) {
+        vkDestroyBuffer(device.device, raw.buffer, nullptr);
+        vkFreeMemory(device.device, raw.memory, nullptr);
+    }
+    const double destroyTime = destroyTimer.elapsedMilliseconds();
+
+    report("create 100k buffers", createTime, "ms");
+    report("destroy 100k buffers", destroyTime, "ms");
+    report("device memory allocations", uint64_t(allocationCount));
+}
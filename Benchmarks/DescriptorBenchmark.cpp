@@ -0,0 +1,126 @@
+#include "Benchmark.hpp"
+
+using namespace RHI;
+using namespace RHI::Benchmarks;
+
+static constexpr uint32_t kMaterialCount = 1000;
+static constexpr uint32_t kRequestCount = 100000;
+static constexpr uint32_t kUniformSize = 256;
+static constexpr uint32_t kRunCount = 3;
+
+// material-like sets, a uniform buffer of their own and a texture shared by all of them
+struct MaterialSets
+{
+    std::vector<BufferHandle> uniformBuffers;
+    TextureHandle texture;
+    SamplerHandle sampler;
+    BindingLayoutHandle layout;
+
+    MaterialSets(IDevice* device)
+    {
+        for (uint32_t i = 0; i < kMaterialCount; i++) {
+            uniformBuffers.push_back(device->createBuffer(BufferDesc{}
+                .setSize(kUniformSize)
+                .setIsUniformBuffer(true)
+                .setMemoryProperties(MemoryPropertiesBits::HOST_VISIBLE_BIT | MemoryPropertiesBits::HOST_COHERENT_BIT)));
+        }
+
+        texture = device->createImage(TextureDesc{}.setWidth(256).setHeight(256).setFormat(Format::RGBA8_UNORM));
+        sampler = device->createTextureSampler();
+        layout = device->createDescriptorSetLayout(getInfo(0));
+    }
+
+    DescriptorSetInfo getInfo(uint32_t material) const
+    {
+        DescriptorSetInfo info;
+        info.buffers.push_back(BufferAttachment{}
+            .setDescriptorInfo(DescriptorInfo(DescriptorType::UNIFORM_BUFFER, ShaderStageFlagBits::VERTEX_BIT))
+            .setBuffer(uniformBuffers[material].get())
+            .setOffset(0)
+            .setSize(kUniformSize));
+        info.textures.push_back(TextureAttachment{}
+            .setDescriptorType(DescriptorType::COMBINED_IMAGE_SAMPLER)
+            .setShaderStages(ShaderStageFlagBits::FRAGMENT_BIT)
+            .setTexture(texture.get())
+            .setSampler(sampler.get()));
+        return info;
+    }
+};
+
+// 100k set requests spread over 1000 distinct materials, every material is asked for 100 times. The sets are released
+// inside the timed runs, so no run starts on an allocator left behind by the previous one
+RHI_BENCHMARK(CachedDescriptorSet)
+{
+    RHI::IDevice* rhiDevice = device.rhiDevice.get();
+    MaterialSets materials(rhiDevice);
+
+    std::vector<DescriptorSetInfo> infos;
+    for (uint32_t i = 0; i < kMaterialCount; i++)
+        infos.push_back(materials.getInfo(i));
+
+    std::vector<BindingSetHandle> sets;
+    sets.reserve(kRequestCount);
+
+    const double uncachedTime = measureFastest(kRunCount, [&] {
+        for (uint32_t i = 0; i < kRequestCount; i++)
+            sets.push_back(rhiDevice->createDescriptorSet(infos[i % kMaterialCount], 1, materials.layout.get()));
+        sets.clear();
+    });
+
+    const BindingSetCacheStatistics before = rhiDevice->getBindingSetCacheStatistics();
+    const double cachedTime = measureFastest(kRunCount, [&] {
+        for (uint32_t i = 0; i < kRequestCount; i++)
+            sets.push_back(rhiDevice->createCachedDescriptorSet(infos[i % kMaterialCount], materials.layout.get()));
+        sets.clear();
+    });
+    const BindingSetCacheStatistics after = rhiDevice->getBindingSetCacheStatistics();
+
+    // one live set per material keeps every entry in the cache, the requests only hit
+    std::vector<BindingSetHandle> materialSets;
+    for (uint32_t i = 0; i < kMaterialCount; i++)
+        materialSets.push_back(rhiDevice->createCachedDescriptorSet(infos[i], materials.layout.get()));
+
+    const double hitTime = measureFastest(kRunCount, [&] {
+        for (uint32_t i = 0; i < kRequestCount; i++)
+            sets.push_back(rhiDevice->createCachedDescriptorSet(infos[i % kMaterialCount], materials.layout.get()));
+        sets.clear();
+    });
+
+    materialSets.clear();
+    rhiDevice->runGarbageCollection();
+
+    report("createDescriptorSet", uncachedTime * 1e6 / kRequestCount, "ns/set");
+    report("createCachedDescriptorSet, 1% misses", cachedTime * 1e6 / kRequestCount, "ns/set");
+    report("createCachedDescriptorSet, hits only", hitTime * 1e6 / kRequestCount, "ns/set");
+    report("cache hits per 100k requests", (after.hits - before.hits) / kRunCount);
+    report("cache misses per 100k requests", (after.misses - before.misses) / kRunCount);
+}
+
+// every frame each of 1000 sets is pointed at the uniform buffer of another material
+RHI_BENCHMARK(DescriptorSetUpdate)
+{
+    RHI::IDevice* rhiDevice = device.rhiDevice.get();
+    MaterialSets materials(rhiDevice);
+
+    std::vector<DescriptorSetInfo> infos;
+    for (uint32_t i = 0; i < kMaterialCount; i++)
+        infos.push_back(materials.getInfo(i));
+
+    std::vector<BindingSetHandle> sets;
+    for (uint32_t i = 0; i < kMaterialCount; i++)
+        sets.push_back(rhiDevice->createDescriptorSet(infos[i], 1, materials.layout.get()));
+
+    const uint32_t frameCount = kRequestCount / kMaterialCount;
+    const double updateTime = measureFastest(kRunCount, [&] {
+        for (uint32_t frame = 1; frame <= frameCount; frame++) {
+            for (uint32_t i = 0; i < kMaterialCount; i++)
+                rhiDevice->updateDescriptorSet(sets[i].get(), infos[(i + frame) % kMaterialCount]);
+        }
+    });
+
+    sets.clear();
+    rhiDevice->runGarbageCollection();
+
+    report("updateDescriptorSet", updateTime * 1e6 / kRequestCount, "ns/update");
+    report("updateDescriptorSet", kRequestCount / updateTime * 1e3, "updates/s");
+}
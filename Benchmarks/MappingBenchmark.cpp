@@ -0,0 +1,81 @@
+#include "Benchmark.hpp"
+
+#include <cstring>
+
+using namespace RHI;
+using namespace RHI::Benchmarks;
+
+static constexpr uint32_t kUploadCount = 1000000;
+static constexpr uint64_t kUploadSize = 256;
+static constexpr uint64_t kBufferSize = 64 * 1024;
+static constexpr uint32_t kRunCount = 5;
+
+// uploadBufferData writes through the pointer mapped when the buffer was created
+RHI_BENCHMARK(UploadBufferData)
+{
+    const BufferDesc desc = BufferDesc{}
+        .setSize(kBufferSize)
+        .setIsUniformBuffer(true)
+        .setMemoryProperties(MemoryPropertiesBits::HOST_VISIBLE_BIT | MemoryPropertiesBits::HOST_COHERENT_BIT);
+    BufferHandle buffer = device.rhiDevice->createBuffer(desc);
+
+    uint8_t data[kUploadSize] = {};
+
+    const double uploadTime = measureFastest(kRunCount, [&] {
+        for (uint32_t i = 0; i < kUploadCount; i++)
+            device.rhiDevice->uploadBufferData(buffer.get(), (i * kUploadSize) % kBufferSize, data, kUploadSize);
+    });
+
+    const double mapTime = measureFastest(kRunCount, [&] {
+        for (uint32_t i = 0; i < kUploadCount; i++) {
+            void* mapped = device.rhiDevice->mapBufferMemory(buffer.get(), (i * kUploadSize) % kBufferSize, kUploadSize);
+            memcpy(mapped, data, kUploadSize);
+            device.rhiDevice->unmapBufferMemory(buffer.get());
+        }
+    });
+
+    report("uploadBufferData, 256 bytes", uploadTime * 1e6 / kUploadCount, "ns/call");
+    report("mapBufferMemory + unmapBufferMemory, 256 bytes", mapTime * 1e6 / kUploadCount, "ns/call");
+}
+
+// the same uploads with vkMapMemory / vkUnmapMemory around each copy, as the upload paths did before
+RHI_BENCHMARK(UploadRawMapPerCall)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = kBufferSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer;
+    Vulkan::checkSuccess(vkCreateBuffer(device.device, &bufferInfo, nullptr, &buffer));
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = device.findMemoryType(requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VkDeviceMemory memory;
+    Vulkan::checkSuccess(vkAllocateMemory(device.device, &allocateInfo, nullptr, &memory));
+    Vulkan::checkSuccess(vkBindBufferMemory(device.device, buffer, memory, 0));
+
+    uint8_t data[kUploadSize] = {};
+
+    const double uploadTime = measureFastest(kRunCount, [&] {
+        for (uint32_t i = 0; i < kUploadCount; i++) {
+            void* mapped = nullptr;
+            vkMapMemory(device.device, memory, (i * kUploadSize) % kBufferSize, kUploadSize, 0, &mapped);
+            memcpy(mapped, data, kUploadSize);
+            vkUnmapMemory(device.device, memory);
+        }
+    });
+
+    vkDestroyBuffer(device.device, buffer, nullptr);
+    vkFreeMemory(device.device, memory, nullptr);
+
+    report("vkMapMemory + copy + vkUnmapMemory, 256 bytes", uploadTime * 1e6 / kUploadCount, "ns/call");
+}
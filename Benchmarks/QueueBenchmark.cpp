@@ -0,0 +1,74 @@
+#include "Benchmark.hpp"
+
+#include <barrier>
+#include <thread>
+
+using namespace RHI;
+using namespace RHI::Benchmarks;
+
+static constexpr uint32_t kListsPerThread = 256;
+static constexpr uint32_t kRoundCount = 80;
+
+// threads acquire command buffers for empty command lists of their own at the same time, the main thread then submits
+// all of them. Submission is not thread safe, so it is timed on its own and only acquiring runs concurrently
+RHI_BENCHMARK(CommandBufferAcquireSubmit)
+{
+    RHI::IDevice* rhiDevice = device.rhiDevice.get();
+
+    const uint32_t threadCounts[] = { 1, options.threadCount };
+    for (uint32_t threadCount : threadCounts) {
+        std::vector<CommandListHandle> commandLists;
+        std::vector<IRHICommandList*> submittedLists;
+        for (uint32_t i = 0; i < threadCount * kListsPerThread; i++) {
+            commandLists.push_back(rhiDevice->createCommandList());
+            submittedLists.push_back(commandLists.back().get());
+        }
+
+        std::barrier roundStart(threadCount + 1);
+        std::barrier roundEnd(threadCount + 1);
+        std::vector<std::thread> workers;
+
+        for (uint32_t worker = 0; worker < threadCount; worker++) {
+            workers.emplace_back([&, worker] {
+                for (uint32_t round = 0; round < kRoundCount; round++) {
+                    roundStart.arrive_and_wait();
+
+                    for (uint32_t i = worker * kListsPerThread; i < (worker + 1) * kListsPerThread; i++) {
+                        submittedLists[i]->beginSingleTimeCommands();
+                        submittedLists[i]->endSingleTimeCommands();
+                    }
+
+                    roundEnd.arrive_and_wait();
+                }
+            });
+        }
+
+        double acquireTime = 0.0;
+        double submitTime = 0.0;
+        for (uint32_t round = 0; round < kRoundCount; round++) {
+            Timer acquireTimer;
+            roundStart.arrive_and_wait();
+            roundEnd.arrive_and_wait();
+            acquireTime += acquireTimer.elapsedMilliseconds();
+
+            Timer submitTimer;
+            rhiDevice->executeCommandLists(submittedLists, submittedLists.size());
+            rhiDevice->runGarbageCollection();
+            submitTime += submitTimer.elapsedMilliseconds();
+        }
+
+        for (std::thread& worker : workers)
+            worker.join();
+
+        const double commandBufferCount = double(kRoundCount) * submittedLists.size();
+
+        char measurement[64];
+        snprintf(measurement, sizeof(measurement), "acquire + record, %u thread%s", threadCount, threadCount > 1 ? "s" : "");
+        report(measurement, commandBufferCount / acquireTime * 1e3, "command buffers/s");
+        snprintf(measurement, sizeof(measurement), "submit + retire, %u thread%s", threadCount, threadCount > 1 ? "s" : "");
+        report(measurement, commandBufferCount / submitTime * 1e3, "command buffers/s");
+    }
+
+    rhiDevice->waitForIdle();
+    rhiDevice->runGarbageCollection();
+}
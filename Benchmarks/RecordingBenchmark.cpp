@@ -0,0 +1,155 @@
+#include "Benchmark.hpp"
+
+#include <barrier>
+#include <thread>
+
+using namespace RHI;
+using namespace RHI::Benchmarks;
+
+static constexpr uint32_t kDrawCount = 100000;
+static constexpr uint32_t kFrameCount = 10;
+static constexpr uint32_t kFramebufferSize = 256;
+
+// void main() {} for the vertex and the fragment stage, nothing is rasterized
+static const std::vector<unsigned int> kVertexShader = {
+    0x07230203, 0x00010000, 0x00000000, 0x00000006, 0x00000000,
+    0x00020011, 0x00000001,                                     // OpCapability Shader
+    0x0003000e, 0x00000000, 0x00000001,                         // OpMemoryModel Logical GLSL450
+    0x0005000f, 0x00000000, 0x00000004, 0x6e69616d, 0x00000000, // OpEntryPoint Vertex %4 "main"
+    0x00020013, 0x00000002,                                     // %2 = OpTypeVoid
+    0x00030021, 0x00000003, 0x00000002,                         // %3 = OpTypeFunction %2
+    0x00050036, 0x00000002, 0x00000004, 0x00000000, 0x00000003, // %4 = OpFunction %2 None %3
+    0x000200f8, 0x00000005,                                     // %5 = OpLabel
+    0x000100fd,                                                 // OpReturn
+    0x00010038                                                  // OpFunctionEnd
+};
+
+static const std::vector<unsigned int> kFragmentShader = {
+    0x07230203, 0x00010000, 0x00000000, 0x00000006, 0x00000000,
+    0x00020011, 0x00000001,                                     // OpCapability Shader
+    0x0003000e, 0x00000000, 0x00000001,                         // OpMemoryModel Logical GLSL450
+    0x0005000f, 0x00000004, 0x00000004, 0x6e69616d, 0x00000000, // OpEntryPoint Fragment %4 "main"
+    0x00030010, 0x00000004, 0x00000007,                         // OpExecutionMode %4 OriginUpperLeft
+    0x00020013, 0x00000002,                                     // %2 = OpTypeVoid
+    0x00030021, 0x00000003, 0x00000002,                         // %3 = OpTypeFunction %2
+    0x00050036, 0x00000002, 0x00000004, 0x00000000, 0x00000003, // %4 = OpFunction %2 None %3
+    0x000200f8, 0x00000005,                                     // %5 = OpLabel
+    0x000100fd,                                                 // OpReturn
+    0x00010038                                                  // OpFunctionEnd
+};
+
+// records 100k draws of one render pass split across secondary command lists on 1, 2, 4 .. threadCount threads
+RHI_BENCHMARK(SecondaryCommandListRecording)
+{
+    RHI::IDevice* rhiDevice = device.rhiDevice.get();
+
+    TextureDesc textureDesc = TextureDesc{}
+        .setWidth(kFramebufferSize)
+        .setHeight(kFramebufferSize)
+        .setFormat(Format::RGBA8_UNORM)
+        .setIsRenderTarget(true);
+    textureDesc.initialState = ResourceStates::RenderTarget;
+    textureDesc.keepInitialState = true;
+    TextureHandle colorTexture = rhiDevice->createImage(textureDesc);
+
+    const FramebufferDesc framebufferDesc = FramebufferDesc{}
+        .addColorAttachment(FramebufferAttachment{}.setTexture(colorTexture.get()).setFormat(Format::RGBA8_UNORM));
+    std::unique_ptr<IRenderPass> renderPass(rhiDevice->createRenderPass(framebufferDesc));
+    FramebufferHandle framebuffer = rhiDevice->createFramebuffer(renderPass.get(), framebufferDesc);
+
+    GraphicsPipelineDesc pipelineDesc;
+    pipelineDesc.VS = rhiDevice->createShaderModule("empty.vert", kVertexShader);
+    pipelineDesc.PS = rhiDevice->createShaderModule("empty.frag", kFragmentShader);
+    pipelineDesc.renderState.cullMode = RasterizerCullMode::None;
+    pipelineDesc.pipelineInfo.width = kFramebufferSize;
+    pipelineDesc.pipelineInfo.height = kFramebufferSize;
+    GraphicsPipelineHandle pipeline = rhiDevice->createGraphicsPipeline(pipelineDesc, framebuffer.get());
+
+    GraphicsState state = GraphicsState{}
+        .setPipeline(pipeline.get())
+        .setFramebuffer(framebuffer.get())
+        .setViewport(ViewportState{}
+            .setViewport(Viewport(0.f, float(kFramebufferSize), 0.f, float(kFramebufferSize), 0.f, 1.f))
+            .setScissorRect(Rect(0, int32_t(kFramebufferSize), 0, int32_t(kFramebufferSize))));
+
+    CommandListHandle primary = rhiDevice->createCommandList();
+
+    // the same draws recorded straight into the primary, what parallel recording has to beat
+    {
+        Timer timer;
+        for (uint32_t frame = 0; frame < kFrameCount; frame++) {
+            primary->beginSingleTimeCommands();
+            for (uint32_t draw = 0; draw < kDrawCount; draw++) {
+                primary->setGraphicsState(state);
+                primary->draw(DrawArguments{}.setVertexCount(3).setStartInstanceLocation(draw));
+            }
+            primary->endSingleTimeCommands();
+
+            std::vector<IRHICommandList*> commandLists = { primary.get() };
+            rhiDevice->executeCommandLists(commandLists, 1);
+            rhiDevice->runGarbageCollection();
+        }
+        report("100k draws, primary only", timer.elapsedMilliseconds() / kFrameCount, "ms/frame");
+    }
+
+    for (uint32_t threadCount = 1; threadCount <= options.threadCount; threadCount *= 2) {
+        std::vector<CommandListHandle> secondaries;
+        std::vector<IRHICommandList*> secondaryLists;
+        for (uint32_t i = 0; i < threadCount; i++) {
+            secondaries.push_back(rhiDevice->createCommandList(CommandListParameters{}.setIsSecondary(true)));
+            secondaryLists.push_back(secondaries.back().get());
+        }
+
+        // workers live as long as the measurement, each keeps its own command pool ring
+        std::barrier frameStart(threadCount + 1);
+        std::barrier frameEnd(threadCount + 1);
+        std::vector<std::thread> workers;
+
+        for (uint32_t worker = 0; worker < threadCount; worker++) {
+            workers.emplace_back([&, worker] {
+                IRHICommandList* commandList = secondaryLists[worker];
+                const uint32_t firstDraw = kDrawCount * worker / threadCount;
+                const uint32_t lastDraw = kDrawCount * (worker + 1) / threadCount;
+
+                for (uint32_t frame = 0; frame < kFrameCount; frame++) {
+                    frameStart.arrive_and_wait();
+
+                    commandList->beginSecondaryCommands(framebuffer.get());
+                    for (uint32_t draw = firstDraw; draw < lastDraw; draw++) {
+                        commandList->setGraphicsState(state);
+                        commandList->draw(DrawArguments{}.setVertexCount(3).setStartInstanceLocation(draw));
+                    }
+                    commandList->endSingleTimeCommands();
+
+                    frameEnd.arrive_and_wait();
+                }
+            });
+        }
+
+        Timer timer;
+        for (uint32_t frame = 0; frame < kFrameCount; frame++) {
+            primary->beginSingleTimeCommands();
+
+            frameStart.arrive_and_wait();
+            frameEnd.arrive_and_wait();
+
+            primary->executeSecondaryCommandLists(framebuffer.get(), secondaryLists);
+            primary->endSingleTimeCommands();
+
+            std::vector<IRHICommandList*> commandLists = { primary.get() };
+            rhiDevice->executeCommandLists(commandLists, 1);
+            rhiDevice->runGarbageCollection();
+        }
+        const double frameTime = timer.elapsedMilliseconds() / kFrameCount;
+
+        for (std::thread& worker : workers)
+            worker.join();
+
+        char measurement[64];
+        snprintf(measurement, sizeof(measurement), "100k draws, %u thread%s", threadCount, threadCount > 1 ? "s" : "");
+        report(measurement, frameTime, "ms/frame");
+    }
+
+    rhiDevice->waitForIdle();
+    rhiDevice->runGarbageCollection();
+}
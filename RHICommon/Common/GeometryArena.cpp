@@ -0,0 +1,84 @@
+#include <Common/GeometryArena.hpp>
+
+#include <cassert>
+
+namespace RHI {
+
+GeometryArena::GeometryArena(IDevice *device, uint64_t vertexBufferSize, uint64_t indexBufferSize, const std::string &debugName)
+    : m_VertexAllocator(vertexBufferSize), m_IndexAllocator(indexBufferSize) {
+    BufferDesc vertexDesc{};
+    vertexDesc.setSize(vertexBufferSize)
+        .setIsVertexBuffer(true)
+        .setIsTransferDst(true)
+        .setDebugName(debugName + " vertices");
+    m_VertexBuffer = device->createBuffer(vertexDesc);
+
+    BufferDesc indexDesc{};
+    indexDesc.setSize(indexBufferSize)
+        .setIsIndexBuffer(true)
+        .setIsTransferDst(true)
+        .setDebugName(debugName + " indices");
+    m_IndexBuffer = device->createBuffer(indexDesc);
+}
+
+BufferRange GeometryArena::allocateRange(TLSFAllocator &allocator, IBuffer *buffer, uint64_t size, uint32_t stride) {
+    BufferRange range;
+    if (size == 0) {
+        return range;
+    }
+
+    TLSFAllocator::Allocation allocation = allocator.allocate(size, stride);
+    if (!allocation.isValid()) {
+        return range;
+    }
+
+    range.buffer = buffer;
+    range.offset = allocation.offset;
+    range.size = size;
+    range.stride = stride;
+    range.allocationNode = allocation.node;
+    return range;
+}
+
+BufferRange GeometryArena::allocateVertices(uint32_t vertexCount, uint32_t vertexStride) {
+    assert(vertexStride > 0);
+    return allocateRange(m_VertexAllocator, m_VertexBuffer.get(), uint64_t(vertexCount) * vertexStride, vertexStride);
+}
+
+BufferRange GeometryArena::allocateIndices(uint32_t indexCount, bool index32BitType) {
+    const uint32_t indexSize = index32BitType ? 4 : 2;
+    return allocateRange(m_IndexAllocator, m_IndexBuffer.get(), uint64_t(indexCount) * indexSize, indexSize);
+}
+
+void GeometryArena::free(const BufferRange &range) {
+    if (!range.isValid()) {
+        return;
+    }
+
+    TLSFAllocator::Allocation allocation;
+    allocation.offset = range.offset;
+    allocation.size = range.size;
+    allocation.node = range.allocationNode;
+
+    if (range.buffer == m_VertexBuffer.get()) {
+        m_VertexAllocator.free(allocation);
+    } else {
+        assert(range.buffer == m_IndexBuffer.get());
+        m_IndexAllocator.free(allocation);
+    }
+}
+
+void GeometryArena::write(IRHICommandList *commandList, const BufferRange &range, const void *data) {
+    assert(range.isValid());
+    commandList->writeBuffer(range.buffer, range.size, data, range.offset);
+}
+
+VertexBufferBinding GeometryArena::getVertexBufferBinding(uint32_t bindingSlot) const {
+    return VertexBufferBinding().setBuffer(m_VertexBuffer.get()).setSlot(bindingSlot).setOffset(0);
+}
+
+IndexBufferBinding GeometryArena::getIndexBufferBinding(bool index32BitType) const {
+    return IndexBufferBinding().setBuffer(m_IndexBuffer.get()).setOffset(0).setIndex32BitType(index32BitType);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Common/TLSFAllocator.hpp>
+#include <RHICommon.hpp>
+
+#include <string>
+
+namespace RHI
+{
+
+/*
+    Vertex and index data of many meshes packed into one device local vertex buffer and one index buffer.
+    Both buffers are bound once with getVertexBufferBinding / getIndexBufferBinding, a mesh is then
+    selected per draw with DrawArguments::setVertexRange / setIndexRange, so draws never rebind buffers.
+    Vertex ranges are aligned to their stride and index ranges to the index size, which keeps
+    firstVertex / firstIndex exact. 16 and 32 bit indices can share the index buffer, but one draw
+    only sees the index type of the current binding.
+*/
+class GeometryArena {
+  public:
+    GeometryArena(IDevice *device, uint64_t vertexBufferSize, uint64_t indexBufferSize, const std::string &debugName = "GeometryArena");
+
+    // invalid range when the arena is full
+    [[nodiscard]] BufferRange allocateVertices(uint32_t vertexCount, uint32_t vertexStride);
+    [[nodiscard]] BufferRange allocateIndices(uint32_t indexCount, bool index32BitType = false);
+    void free(const BufferRange &range);
+
+    // copies size bytes of data into the range through the command list upload path
+    void write(IRHICommandList *commandList, const BufferRange &range, const void *data);
+
+    IBuffer *getVertexBuffer() const {
+        return m_VertexBuffer.get();
+    }
+
+    IBuffer *getIndexBuffer() const {
+        return m_IndexBuffer.get();
+    }
+
+    VertexBufferBinding getVertexBufferBinding(uint32_t bindingSlot = 0) const;
+    IndexBufferBinding getIndexBufferBinding(bool index32BitType = false) const;
+
+    uint64_t getVertexBytesUsed() const {
+        return m_VertexAllocator.getUsedBytes();
+    }
+
+    uint64_t getIndexBytesUsed() const {
+        return m_IndexAllocator.getUsedBytes();
+    }
+
+  private:
+    static BufferRange allocateRange(TLSFAllocator &allocator, IBuffer *buffer, uint64_t size, uint32_t stride);
+
+    BufferHandle m_VertexBuffer;
+    BufferHandle m_IndexBuffer;
+    TLSFAllocator m_VertexAllocator;
+    TLSFAllocator m_IndexAllocator;
+};
+
+}
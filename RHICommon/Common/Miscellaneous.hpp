@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 namespace RHI {
 template<typename T, typename U> [[nodiscard]] bool arraysAreDifferent(const T& a, const U& b)
 {
@@ -14,4 +16,9 @@ template<typename T, typename U> [[nodiscard]] bool arraysAreDifferent(const T&
 
     return false;
 }
+
+template<typename T> void hashCombine(size_t& seed, const T& value)
+{
+    seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
 }
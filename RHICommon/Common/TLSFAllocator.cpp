@@ -0,0 +1,278 @@
+#include <Common/TLSFAllocator.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace RHI {
+namespace {
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return alignment > 1 ? ((value + alignment - 1) / alignment) * alignment : value;
+}
+}
+
+TLSFAllocator::TLSFAllocator(uint64_t size)
+    : m_Size(size) {
+    for (auto &heads : m_FreeHeads) {
+        for (uint32_t &head : heads) {
+            head = kInvalidNode;
+        }
+    }
+
+    if (size == 0) {
+        return;
+    }
+
+    uint32_t root = createNode();
+    m_Nodes[root].offset = 0;
+    m_Nodes[root].size = size;
+    insertFreeNode(root);
+}
+
+void TLSFAllocator::mapping(uint64_t size, uint32_t &firstLevel, uint32_t &secondLevel) {
+    if (size < kSecondLevelCount) {
+        firstLevel = 0;
+        secondLevel = uint32_t(size);
+        return;
+    }
+
+    const uint32_t msb = 63 - uint32_t(std::countl_zero(size));
+    firstLevel = msb - kSecondLevelBits + 1;
+    secondLevel = uint32_t(size >> (msb - kSecondLevelBits)) - kSecondLevelCount;
+}
+
+uint32_t TLSFAllocator::findFreeNode(uint64_t size) const {
+    // Round the request up to the next bin boundary, so every node of the found bin is large enough
+    if (size >= kSecondLevelCount) {
+        const uint32_t msb = 63 - uint32_t(std::countl_zero(size));
+        size += (uint64_t(1) << (msb - kSecondLevelBits)) - 1;
+    }
+
+    uint32_t firstLevel, secondLevel;
+    mapping(size, firstLevel, secondLevel);
+
+    if (firstLevel >= kFirstLevelCount) {
+        return kInvalidNode;
+    }
+
+    uint32_t secondLevelMap = m_SecondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (!secondLevelMap) {
+        const uint64_t firstLevelMap =
+            (firstLevel + 1 < 64) ? m_FirstLevelBitmap & (~uint64_t(0) << (firstLevel + 1)) : 0;
+        if (!firstLevelMap) {
+            return kInvalidNode;
+        }
+
+        firstLevel = uint32_t(std::countr_zero(firstLevelMap));
+        secondLevelMap = m_SecondLevelBitmaps[firstLevel];
+    }
+
+    secondLevel = uint32_t(std::countr_zero(secondLevelMap));
+    return m_FreeHeads[firstLevel][secondLevel];
+}
+
+void TLSFAllocator::insertFreeNode(uint32_t nodeIndex) {
+    Node &node = m_Nodes[nodeIndex];
+
+    uint32_t firstLevel, secondLevel;
+    mapping(node.size, firstLevel, secondLevel);
+
+    const uint32_t head = m_FreeHeads[firstLevel][secondLevel];
+    node.prevFree = kInvalidNode;
+    node.nextFree = head;
+    if (head != kInvalidNode) {
+        m_Nodes[head].prevFree = nodeIndex;
+    }
+
+    m_FreeHeads[firstLevel][secondLevel] = nodeIndex;
+    m_SecondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+    m_FirstLevelBitmap |= uint64_t(1) << firstLevel;
+}
+
+void TLSFAllocator::removeFreeNode(uint32_t nodeIndex) {
+    Node &node = m_Nodes[nodeIndex];
+
+    if (node.prevFree != kInvalidNode) {
+        m_Nodes[node.prevFree].nextFree = node.nextFree;
+    }
+    if (node.nextFree != kInvalidNode) {
+        m_Nodes[node.nextFree].prevFree = node.prevFree;
+    }
+
+    uint32_t firstLevel, secondLevel;
+    mapping(node.size, firstLevel, secondLevel);
+
+    if (m_FreeHeads[firstLevel][secondLevel] == nodeIndex) {
+        m_FreeHeads[firstLevel][secondLevel] = node.nextFree;
+
+        if (node.nextFree == kInvalidNode) {
+            m_SecondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+            if (!m_SecondLevelBitmaps[firstLevel]) {
+                m_FirstLevelBitmap &= ~(uint64_t(1) << firstLevel);
+            }
+        }
+    }
+
+    node.prevFree = kInvalidNode;
+    node.nextFree = kInvalidNode;
+}
+
+uint32_t TLSFAllocator::createNode() {
+    if (!m_UnusedNodes.empty()) {
+        uint32_t nodeIndex = m_UnusedNodes.back();
+        m_UnusedNodes.pop_back();
+        m_Nodes[nodeIndex] = Node();
+        return nodeIndex;
+    }
+
+    m_Nodes.emplace_back();
+    return uint32_t(m_Nodes.size() - 1);
+}
+
+void TLSFAllocator::releaseNode(uint32_t nodeIndex) {
+    m_UnusedNodes.push_back(nodeIndex);
+}
+
+TLSFAllocator::Allocation TLSFAllocator::allocate(uint64_t size, uint64_t alignment) {
+    if (size == 0) {
+        size = 1;
+    }
+
+    if (size > getFreeBytes()) {
+        return Allocation();
+    }
+
+    // The head of the matching bin usually satisfies the alignment already, otherwise search for a node
+    // large enough to absorb the worst case padding
+    uint32_t nodeIndex = findFreeNode(size);
+    if (nodeIndex == kInvalidNode ||
+        alignUp(m_Nodes[nodeIndex].offset, alignment) + size > m_Nodes[nodeIndex].offset + m_Nodes[nodeIndex].size) {
+        nodeIndex = alignment > 1 ? findFreeNode(size + alignment - 1) : kInvalidNode;
+    }
+
+    if (nodeIndex == kInvalidNode) {
+        return Allocation();
+    }
+
+    removeFreeNode(nodeIndex);
+
+    const uint64_t alignedOffset = alignUp(m_Nodes[nodeIndex].offset, alignment);
+    const uint64_t padding = alignedOffset - m_Nodes[nodeIndex].offset;
+
+    // Give the alignment padding back as a free node in front of the allocation
+    if (padding > 0) {
+        uint32_t paddingIndex = createNode();
+        Node &node = m_Nodes[nodeIndex];
+        Node &paddingNode = m_Nodes[paddingIndex];
+
+        paddingNode.offset = node.offset;
+        paddingNode.size = padding;
+        paddingNode.prevPhysical = node.prevPhysical;
+        paddingNode.nextPhysical = nodeIndex;
+        if (node.prevPhysical != kInvalidNode) {
+            m_Nodes[node.prevPhysical].nextPhysical = paddingIndex;
+        }
+
+        node.prevPhysical = paddingIndex;
+        node.offset = alignedOffset;
+        node.size -= padding;
+
+        insertFreeNode(paddingIndex);
+    }
+
+    // Split off the tail
+    if (m_Nodes[nodeIndex].size > size) {
+        uint32_t tailIndex = createNode();
+        Node &node = m_Nodes[nodeIndex];
+        Node &tailNode = m_Nodes[tailIndex];
+
+        tailNode.offset = node.offset + size;
+        tailNode.size = node.size - size;
+        tailNode.prevPhysical = nodeIndex;
+        tailNode.nextPhysical = node.nextPhysical;
+        if (node.nextPhysical != kInvalidNode) {
+            m_Nodes[node.nextPhysical].prevPhysical = tailIndex;
+        }
+
+        node.nextPhysical = tailIndex;
+        node.size = size;
+
+        insertFreeNode(tailIndex);
+    }
+
+    Node &node = m_Nodes[nodeIndex];
+    node.used = true;
+
+    m_UsedBytes += node.size;
+    m_AllocationCount++;
+
+    Allocation allocation;
+    allocation.offset = node.offset;
+    allocation.size = node.size;
+    allocation.node = nodeIndex;
+    return allocation;
+}
+
+void TLSFAllocator::free(const Allocation &allocation) {
+    if (!allocation.isValid()) {
+        return;
+    }
+
+    uint32_t nodeIndex = allocation.node;
+
+    m_Nodes[nodeIndex].used = false;
+    m_UsedBytes -= m_Nodes[nodeIndex].size;
+    m_AllocationCount--;
+
+    // Merge with the previous physical node
+    const uint32_t prevIndex = m_Nodes[nodeIndex].prevPhysical;
+    if (prevIndex != kInvalidNode && !m_Nodes[prevIndex].used) {
+        removeFreeNode(prevIndex);
+
+        Node &prev = m_Nodes[prevIndex];
+        Node &node = m_Nodes[nodeIndex];
+        prev.size += node.size;
+        prev.nextPhysical = node.nextPhysical;
+        if (node.nextPhysical != kInvalidNode) {
+            m_Nodes[node.nextPhysical].prevPhysical = prevIndex;
+        }
+
+        releaseNode(nodeIndex);
+        nodeIndex = prevIndex;
+    }
+
+    // Merge with the next physical node
+    const uint32_t nextIndex = m_Nodes[nodeIndex].nextPhysical;
+    if (nextIndex != kInvalidNode && !m_Nodes[nextIndex].used) {
+        removeFreeNode(nextIndex);
+
+        Node &node = m_Nodes[nodeIndex];
+        Node &next = m_Nodes[nextIndex];
+        node.size += next.size;
+        node.nextPhysical = next.nextPhysical;
+        if (next.nextPhysical != kInvalidNode) {
+            m_Nodes[next.nextPhysical].prevPhysical = nodeIndex;
+        }
+
+        releaseNode(nextIndex);
+    }
+
+    insertFreeNode(nodeIndex);
+}
+
+uint64_t TLSFAllocator::getLargestFreeRegion() const {
+    if (!m_FirstLevelBitmap) {
+        return 0;
+    }
+
+    const uint32_t firstLevel = 63 - uint32_t(std::countl_zero(m_FirstLevelBitmap));
+    const uint32_t secondLevel = 31 - uint32_t(std::countl_zero(m_SecondLevelBitmaps[firstLevel]));
+
+    uint64_t largest = 0;
+    for (uint32_t nodeIndex = m_FreeHeads[firstLevel][secondLevel]; nodeIndex != kInvalidNode;
+         nodeIndex = m_Nodes[nodeIndex].nextFree) {
+        largest = std::max(largest, m_Nodes[nodeIndex].size);
+    }
+
+    return largest;
+}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace RHI
+{
+
+/*
+    Two-level segregated fit allocator over an abstract [0, size) range.
+    It only hands out offsets, the owner decides what the range is backed with
+    (a device memory block, a mega-buffer, a descriptor buffer ...).
+    Allocation and free are O(1), free neighbours are merged immediately.
+*/
+class TLSFAllocator {
+  public:
+    static constexpr uint32_t kInvalidNode = ~0u;
+
+    struct Allocation {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t node = kInvalidNode;
+
+        bool isValid() const {
+            return node != kInvalidNode;
+        }
+    };
+
+    explicit TLSFAllocator(uint64_t size);
+
+    // alignment does not have to be a power of two
+    [[nodiscard]] Allocation allocate(uint64_t size, uint64_t alignment = 1);
+    void free(const Allocation &allocation);
+
+    uint64_t getSize() const {
+        return m_Size;
+    }
+
+    uint64_t getUsedBytes() const {
+        return m_UsedBytes;
+    }
+
+    uint64_t getFreeBytes() const {
+        return m_Size - m_UsedBytes;
+    }
+
+    uint32_t getAllocationCount() const {
+        return m_AllocationCount;
+    }
+
+    bool isEmpty() const {
+        return m_AllocationCount == 0;
+    }
+
+    uint64_t getLargestFreeRegion() const;
+
+  private:
+    static constexpr uint32_t kSecondLevelBits = 4;
+    static constexpr uint32_t kSecondLevelCount = 1u << kSecondLevelBits;
+    static constexpr uint32_t kFirstLevelCount = 64 - kSecondLevelBits + 1;
+
+    struct Node {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t prevPhysical = kInvalidNode;
+        uint32_t nextPhysical = kInvalidNode;
+        uint32_t prevFree = kInvalidNode;
+        uint32_t nextFree = kInvalidNode;
+        bool used = false;
+    };
+
+    static void mapping(uint64_t size, uint32_t &firstLevel, uint32_t &secondLevel);
+
+    uint32_t findFreeNode(uint64_t size) const;
+    void insertFreeNode(uint32_t nodeIndex);
+    void removeFreeNode(uint32_t nodeIndex);
+
+    uint32_t createNode();
+    void releaseNode(uint32_t nodeIndex);
+
+    uint64_t m_Size = 0;
+    uint64_t m_UsedBytes = 0;
+    uint32_t m_AllocationCount = 0;
+
+    uint64_t m_FirstLevelBitmap = 0;
+    uint32_t m_SecondLevelBitmaps[kFirstLevelCount] = {};
+    uint32_t m_FreeHeads[kFirstLevelCount][kSecondLevelCount];
+
+    std::vector<Node> m_Nodes;
+    std::vector<uint32_t> m_UnusedNodes;
+};
+
+}
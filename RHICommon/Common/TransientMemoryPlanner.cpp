@@ -0,0 +1,103 @@
+#include <Common/TransientMemoryPlanner.hpp>
+
+#include <algorithm>
+#include <cassert>
+
+namespace RHI {
+namespace {
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return alignment > 1 ? ((value + alignment - 1) / alignment) * alignment : value;
+}
+}
+
+uint32_t TransientMemoryPlanner::addResource(uint64_t size, uint64_t alignment, uint32_t firstPass, uint32_t lastPass) {
+    assert(firstPass <= lastPass);
+
+    Resource resource;
+    resource.size = size;
+    resource.alignment = std::max<uint64_t>(alignment, 1);
+    resource.firstPass = firstPass;
+    resource.lastPass = lastPass;
+
+    m_Resources.push_back(resource);
+    return uint32_t(m_Resources.size() - 1);
+}
+
+void TransientMemoryPlanner::plan() {
+    // largest first, small resources then fill the holes left between them
+    std::vector<uint32_t> order(m_Resources.size());
+    for (uint32_t i = 0; i < uint32_t(order.size()); i++) {
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        if (m_Resources[a].size != m_Resources[b].size) {
+            return m_Resources[a].size > m_Resources[b].size;
+        }
+        return m_Resources[a].firstPass < m_Resources[b].firstPass;
+    });
+
+    m_HeapSize = 0;
+    m_HeapAlignment = 1;
+
+    std::vector<uint32_t> placed;
+    std::vector<const Resource *> overlapping;
+
+    for (uint32_t index : order) {
+        Resource &resource = m_Resources[index];
+
+        overlapping.clear();
+        for (uint32_t other : placed) {
+            const Resource &o = m_Resources[other];
+            if (o.firstPass <= resource.lastPass && resource.firstPass <= o.lastPass) {
+                overlapping.push_back(&o);
+            }
+        }
+
+        std::sort(overlapping.begin(), overlapping.end(), [](const Resource *a, const Resource *b) {
+            return a->offset < b->offset;
+        });
+
+        // first gap between the resources alive at the same time that is large enough
+        uint64_t offset = 0;
+        for (const Resource *o : overlapping) {
+            const uint64_t candidate = alignUp(offset, resource.alignment);
+            if (candidate + resource.size <= o->offset) {
+                break;
+            }
+            offset = std::max(offset, o->offset + o->size);
+        }
+
+        resource.offset = alignUp(offset, resource.alignment);
+        placed.push_back(index);
+
+        m_HeapSize = std::max(m_HeapSize, resource.offset + resource.size);
+        m_HeapAlignment = std::max(m_HeapAlignment, resource.alignment);
+    }
+}
+
+uint64_t TransientMemoryPlanner::getOffset(uint32_t resource) const {
+    assert(resource < m_Resources.size());
+    return m_Resources[resource].offset;
+}
+
+TransientMemoryPlanner::Report TransientMemoryPlanner::getReport() const {
+    Report report;
+    report.resourceCount = uint32_t(m_Resources.size());
+
+    for (const Resource &resource : m_Resources) {
+        report.unaliasedBytes = alignUp(report.unaliasedBytes, resource.alignment) + resource.size;
+    }
+
+    report.heapBytes = m_HeapSize;
+    report.savedBytes = report.unaliasedBytes > m_HeapSize ? report.unaliasedBytes - m_HeapSize : 0;
+    return report;
+}
+
+void TransientMemoryPlanner::reset() {
+    m_Resources.clear();
+    m_HeapSize = 0;
+    m_HeapAlignment = 1;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace RHI
+{
+
+/*
+    Packs transient resources into one shared heap.
+    Every resource is described by its memory requirements and the range of passes
+    [firstPass, lastPass] it is alive in. Resources whose lifetimes do not overlap may
+    share memory, so the heap only has to be as large as the worst moment of the frame.
+    The result is a list of offsets to place the resources at with bindTextureMemory / bindBufferMemory.
+*/
+class TransientMemoryPlanner {
+  public:
+    static constexpr uint32_t kInvalidResource = ~0u;
+
+    struct Report {
+        uint32_t resourceCount = 0;
+        uint64_t unaliasedBytes = 0; // memory needed if every resource had its own allocation
+        uint64_t heapBytes = 0;      // size of the shared heap after packing
+        uint64_t savedBytes = 0;
+    };
+
+    // returns the id used to query the placement after plan()
+    uint32_t addResource(uint64_t size, uint64_t alignment, uint32_t firstPass, uint32_t lastPass);
+
+    // computes the offsets, can be called again after adding more resources
+    void plan();
+
+    uint64_t getOffset(uint32_t resource) const;
+
+    uint64_t getHeapSize() const {
+        return m_HeapSize;
+    }
+
+    uint64_t getHeapAlignment() const {
+        return m_HeapAlignment;
+    }
+
+    Report getReport() const;
+
+    void reset();
+
+  private:
+    struct Resource {
+        uint64_t size = 0;
+        uint64_t alignment = 1;
+        uint32_t firstPass = 0;
+        uint32_t lastPass = 0;
+        uint64_t offset = 0;
+    };
+
+    std::vector<Resource> m_Resources;
+    uint64_t m_HeapSize = 0;
+    uint64_t m_HeapAlignment = 1;
+};
+
+}
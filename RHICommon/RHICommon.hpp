@@ -1,8 +1,10 @@
 #pragma once
 
 #include <Common/Resources.hpp>
+#include <Common/TransientMemoryPlanner.hpp>
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -33,6 +35,7 @@ namespace RHI
     class IComputePipeline;
     class IFramebuffer;
     class IRHICommandList;
+    class IHeap;
     class IDevice;
 
     typedef std::shared_ptr<IBuffer> BufferHandle;
@@ -46,6 +49,7 @@ namespace RHI
     typedef std::shared_ptr<IComputePipeline> ComputePipelineHandle;
     typedef std::shared_ptr<IFramebuffer> FramebufferHandle;
     typedef std::shared_ptr<IRHICommandList> CommandListHandle;
+    typedef std::shared_ptr<IHeap> HeapHandle;
     typedef std::shared_ptr<IDevice> DeviceHandle;
 
     enum class GraphicsAPI : uint8_t
@@ -241,29 +245,32 @@ namespace RHI
         HOST_VISIBLE_BIT = 0x00000002,
         HOST_COHERENT_BIT = 0x00000004,
         HOST_CACHED_BIT = 0x00000008,
+        LAZILY_ALLOCATED_BIT = 0x00000010,
         FLAG_BITS_MAX_ENUM = 0x7FFFFFFF
     };
 
     ENUM_CLASS_FLAG_OPERATORS(MemoryPropertiesBits)
 
-    enum class CreateFlagBits : uint8_t
+    enum class CreateFlagBits : uint32_t
     {
         NONE_BIT = 0,
-        SPARSE_BINDING_BIT,
-        SPARSE_RESIDENCY_BIT,
-        SPARSE_ALIASED_BIT,
-        MUTABLE_FORMAT_BIT,
-        CUBE_COMPATIBLE_BIT,
-        ALIAS_BIT,
-        SPLIT_INSTANCE_BIND_REGIONS_BIT,
-        ARRAY_2D_COMPATIBLE_BIT,
-    	BLOCK_TEXEL_VIEW_COMPATIBLE_BIT,
-        EXTENDED_USAGE_BIT,
-        PROTECTED_BIT,
-        DISJOINT_BIT,
-        FLAG_BITS_MAX_ENUM
+        SPARSE_BINDING_BIT = 0x00000001,
+        SPARSE_RESIDENCY_BIT = 0x00000002,
+        SPARSE_ALIASED_BIT = 0x00000004,
+        MUTABLE_FORMAT_BIT = 0x00000008,
+        CUBE_COMPATIBLE_BIT = 0x00000010,
+        ALIAS_BIT = 0x00000020,
+        SPLIT_INSTANCE_BIND_REGIONS_BIT = 0x00000040,
+        ARRAY_2D_COMPATIBLE_BIT = 0x00000080,
+        BLOCK_TEXEL_VIEW_COMPATIBLE_BIT = 0x00000100,
+        EXTENDED_USAGE_BIT = 0x00000200,
+        PROTECTED_BIT = 0x00000400,
+        DISJOINT_BIT = 0x00000800,
+        FLAG_BITS_MAX_ENUM = 0x7FFFFFFF
     };
 
+    ENUM_CLASS_FLAG_OPERATORS(CreateFlagBits)
+
     enum class ResourceStates : uint32_t {
         Unknown = 0,
         Common = 1 << 0,
@@ -421,6 +428,18 @@ namespace RHI
             maxAnisotropy = value;
             return *this;
         }
+
+        bool operator ==(const SamplerDesc& b) const {
+            return addressU == b.addressU
+                && addressV == b.addressV
+                && addressW == b.addressW
+                && minFilter == b.minFilter
+                && magFilter == b.magFilter
+                && mipFilter == b.mipFilter
+                && anisotropyEnable == b.anisotropyEnable
+                && maxAnisotropy == b.maxAnisotropy;
+        }
+        bool operator !=(const SamplerDesc& b) const { return !(*this == b); }
     };
 
     class ISampler : public IResource {
@@ -434,6 +453,9 @@ namespace RHI
         bool isShaderResource = false;
         bool isRenderTarget = false;
         bool isUAV = false;
+        // contents only live inside a render pass (MSAA surfaces resolved in the pass, discarded depth),
+        // never stored to memory and backed by lazily allocated memory when the device has it
+        bool isTransientAttachment = false;
     };
 
     struct TextureDesc {
@@ -446,6 +468,8 @@ namespace RHI
         Format format = Format::UNKNOWN;
         MemoryPropertiesBits memoryProperties = MemoryPropertiesBits::DEVICE_LOCAL_BIT;
         bool isLinearTiling = false;
+        // created without memory, it has to be placed in a heap with IDevice::bindTextureMemory
+        bool isVirtual = false;
         CreateFlagBits flags = CreateFlagBits::NONE_BIT;
         TextureDimension dimension = TextureDimension::Texture2D;
         ImageUsage usage = {};
@@ -524,6 +548,21 @@ namespace RHI
             return *this;
         }
 
+        TextureDesc &setIsTransientAttachment(bool value) {
+            usage.isTransientAttachment = value;
+            return *this;
+        }
+
+        TextureDesc &setIsVirtual(bool value) {
+            isVirtual = value;
+            return *this;
+        }
+
+        TextureDesc &setFlags(CreateFlagBits value) {
+            flags = value;
+            return *this;
+        }
+
         TextureDesc &setDebugName(const std::string &value) {
             debugName = value;
             return *this;
@@ -775,12 +814,32 @@ namespace RHI
         virtual const VertexInputBindingDesc* getVertexBindingDesc(uint32_t index) const = 0;
     };
 
+    // slice of a buffer shared by many resources, e.g. the vertices of one mesh in a GeometryArena
+    struct BufferRange
+    {
+        IBuffer* buffer = nullptr;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t stride = 0;                 // size of one element, vertex stride or index size
+        uint32_t allocationNode = ~0u;       // owned by the allocator that handed out the range
+
+        bool isValid() const { return buffer != nullptr; }
+        uint32_t getFirstElement() const { return stride ? uint32_t(offset / stride) : 0; }
+        uint32_t getElementCount() const { return stride ? uint32_t(size / stride) : 0; }
+    };
+
     struct VertexBufferBinding
     {
         IBuffer* buffer = nullptr;
         uint32_t bindingSlot = 0;
         size_t offset = 0;
 
+        VertexBufferBinding& setBuffer(IBuffer* value) { buffer = value; return *this; }
+        VertexBufferBinding& setSlot(uint32_t value) { bindingSlot = value; return *this; }
+        VertexBufferBinding& setOffset(size_t value) { offset = value; return *this; }
+        // binds the whole buffer the range lives in, draws select the range with DrawArguments::setVertexRange
+        VertexBufferBinding& setRange(const BufferRange& range) { buffer = range.buffer; offset = 0; return *this; }
+
         bool operator ==(const VertexBufferBinding& b) const
         {
             return buffer == b.buffer
@@ -795,8 +854,35 @@ namespace RHI
         IBuffer* buffer = nullptr;
         size_t offset = 0;
         bool index32BitType = false;
+
+        IndexBufferBinding& setBuffer(IBuffer* value) { buffer = value; return *this; }
+        IndexBufferBinding& setOffset(size_t value) { offset = value; return *this; }
+        IndexBufferBinding& setIndex32BitType(bool value) { index32BitType = value; return *this; }
+        // binds the whole buffer the range lives in, draws select the range with DrawArguments::setIndexRange
+        IndexBufferBinding& setRange(const BufferRange& range) { buffer = range.buffer; offset = 0; index32BitType = range.stride == 4; return *this; }
+
+        bool operator ==(const IndexBufferBinding& b) const
+        {
+            return buffer == b.buffer
+                && offset == b.offset
+                && index32BitType == b.index32BitType;
+        }
+        bool operator !=(const IndexBufferBinding& b) const { return !(*this == b); }
+    };
+
+    enum class BindingLayoutFlags : uint32_t
+    {
+        None = 0,
+        // no binding sets are allocated from the layout, its descriptors are written into the command buffer
+        // with IRHICommandList::pushDescriptorSet. Dynamic buffers are not allowed in such a layout
+        PushDescriptor = 1 << 0,
+        // the samplers of the combined image sampler textures and texture arrays are baked into the layout,
+        // the samplers given to sets made from it are ignored
+        ImmutableSamplers = 1 << 1,
     };
 
+    ENUM_CLASS_FLAG_OPERATORS(BindingLayoutFlags)
+
     class IBindingLayout : public IResource
     {
     public:
@@ -819,6 +905,14 @@ namespace RHI
     struct CommandListParameters
     {
         CommandQueue queueType = CommandQueue::Graphics;
+        // size of the persistently mapped chunks used by writeBuffer, larger writes get a chunk of their own
+        uint64_t uploadChunkSize = 64 * 1024;
+        // records draws into a render pass of a parent command list, see IRHICommandList::beginSecondaryCommands
+        bool isSecondary = false;
+
+        CommandListParameters& setQueueType(CommandQueue value) { queueType = value; return *this; }
+        CommandListParameters& setUploadChunkSize(uint64_t value) { uploadChunkSize = value; return *this; }
+        CommandListParameters& setIsSecondary(bool value) { isSecondary = value; return *this; }
     };
 
     struct ViewportState
@@ -836,11 +930,17 @@ namespace RHI
         IFramebuffer* framebuffer = nullptr;
 
         std::vector<IBindingSet*> bindingSets;
+        // one offset per dynamic buffer binding, in set and binding order
+        std::vector<uint32_t> dynamicOffsets;
         std::vector<VertexBufferBinding> vertexBufferBindings;
         IndexBufferBinding indexBufferBinding;
 
         IBuffer* indirectParams = nullptr;
 
+        // contents that will be given to IRHICommandList::pushDescriptorSet inside the render pass of this state,
+        // their textures are moved into the ShaderResource state before the render pass begins
+        std::vector<const DescriptorSetInfo*> pushDescriptorSets;
+
         ViewportState viewport;
         Color blendColorFactor;
         uint8_t dynamicStencilReference = 0;
@@ -853,9 +953,11 @@ namespace RHI
         GraphicsState& setBindingSets(const std::vector<IBindingSet*>& value) { bindingSets = value; return *this; }
         GraphicsState& setVertexBufferBindings(const std::vector<VertexBufferBinding>& value) { vertexBufferBindings = value; return *this; }
         GraphicsState& addBindingSet(IBindingSet* value) { bindingSets.push_back(value); return *this; }
+        GraphicsState& setDynamicOffsets(const std::vector<uint32_t>& value) { dynamicOffsets = value; return *this; }
         GraphicsState& addVertexBufferBinding(const VertexBufferBinding& value) { vertexBufferBindings.push_back(value); return *this; }
         GraphicsState& setIndexBufferBinding(const IndexBufferBinding& value) { indexBufferBinding = value; return *this; }
         GraphicsState& setIndirectParams(IBuffer* value) { indirectParams = value; return *this; }
+        GraphicsState& addPushDescriptorSet(const DescriptorSetInfo* value) { pushDescriptorSets.push_back(value); return *this; }
     };
 
     struct DrawArguments
@@ -871,6 +973,21 @@ namespace RHI
         DrawArguments& setStartIndexLocation(uint32_t value) { startIndexLocation = value; return *this; }
         DrawArguments& setStartVertexLocation(uint32_t value) { startVertexLocation = value; return *this; }
         DrawArguments& setStartInstanceLocation(uint32_t value) { startInstanceLocation = value; return *this; }
+
+        // ranges of buffers bound once with VertexBufferBinding::setRange / IndexBufferBinding::setRange
+        DrawArguments& setVertexRange(const BufferRange& vertices)
+        {
+            vertexCount = vertices.getElementCount();
+            startVertexLocation = vertices.getFirstElement();
+            return *this;
+        }
+        DrawArguments& setIndexRange(const BufferRange& indices, const BufferRange& vertices)
+        {
+            vertexCount = indices.getElementCount();
+            startIndexLocation = indices.getFirstElement();
+            startVertexLocation = vertices.getFirstElement();
+            return *this;
+        }
     };
 
     struct DrawIndirectArguments
@@ -895,11 +1012,13 @@ namespace RHI
         IComputePipeline* pipeline = nullptr;
 
         std::vector<IBindingSet*> bindings;
+        std::vector<uint32_t> dynamicOffsets;
 
         IBuffer* indirectParams = nullptr;
 
         ComputeState& setPipeline(IComputePipeline* value) { pipeline = value; return *this; }
         ComputeState& addBindingSet(IBindingSet* value) { bindings.push_back(value); return *this; }
+        ComputeState& setDynamicOffsets(const std::vector<uint32_t>& value) { dynamicOffsets = value; return *this; }
         ComputeState& setIndirectParams(IBuffer* value) { indirectParams = value; return *this; }
     };
 
@@ -925,6 +1044,8 @@ namespace RHI
         Format format = Format::UNKNOWN;
         MemoryPropertiesBits memoryProperties = MemoryPropertiesBits::DEVICE_LOCAL_BIT;
         BufferUsage usage = {};
+        // created without memory, it has to be placed in a heap with IDevice::bindBufferMemory
+        bool isVirtual = false;
         std::string debugName;
 
         constexpr BufferDesc& setSize(uint64_t value) { size = value; return *this; }
@@ -937,6 +1058,7 @@ namespace RHI
         constexpr BufferDesc& setIsUniformBuffer(bool value) { usage.isUniformBuffer = value; return *this; }
         constexpr BufferDesc& setIsStorageBuffer(bool value) { usage.isStorageBuffer = value; return *this; }
         constexpr BufferDesc& setIsDrawIndirectBuffer(bool value) { usage.isDrawIndirectBuffer = value; return *this; }
+        constexpr BufferDesc& setIsVirtual(bool value) { isVirtual = value; return *this; }
         constexpr BufferDesc& setDebugName(const std::string& value) { debugName = value; return *this; }
     };
 
@@ -946,6 +1068,28 @@ namespace RHI
         virtual const BufferDesc& getDesc() const = 0;
     };
 
+    struct ConstantBufferAllocation
+    {
+        IBuffer* buffer = nullptr;
+        uint32_t offset = 0;        // dynamic offset to pass with the UNIFORM_BUFFER_DYNAMIC binding
+        void* cpuAddress = nullptr;
+
+        bool isValid() const { return buffer != nullptr; }
+    };
+
+    // Linear allocator for per-draw constants, split into one region per frame in flight.
+    // Bind getBuffer() once as UNIFORM_BUFFER_DYNAMIC and select the slice with dynamic offsets.
+    class IConstantBufferArena : public IResource
+    {
+    public:
+        // resets the region of the frame, the GPU must be done with its previous use
+        virtual void beginFrame(uint32_t frameIndex) = 0;
+        virtual ConstantBufferAllocation allocate(size_t size) = 0;
+        virtual IBuffer* getBuffer() const = 0;
+    };
+
+    typedef std::shared_ptr<IConstantBufferArena> ConstantBufferArenaHandle;
+
     struct ShaderDesc
     {
 
@@ -1247,11 +1391,34 @@ namespace RHI
             virtual const ComputePipelineDesc &getDesc() const = 0;
     };
 
+    struct CommandListStatistics
+    {
+        uint32_t setGraphicsStateCalls = 0;
+        uint32_t pipelineBinds = 0;
+        uint32_t pipelineBindsSkipped = 0;
+        uint32_t descriptorSetBinds = 0;          // counted per set slot
+        uint32_t descriptorSetBindsSkipped = 0;
+        uint32_t descriptorSetPushes = 0;
+        uint32_t vertexBufferBinds = 0;           // counted per binding slot
+        uint32_t vertexBufferBindsSkipped = 0;
+        uint32_t indexBufferBinds = 0;
+        uint32_t indexBufferBindsSkipped = 0;
+        uint32_t dynamicStateUpdates = 0;         // viewport, scissor, stencil reference and blend constants
+        uint32_t dynamicStateUpdatesSkipped = 0;
+    };
+
     class IRHICommandList : public IResource {
       public:
         virtual void beginSingleTimeCommands() = 0;
         virtual void endSingleTimeCommands() = 0;
 
+        // Secondary command lists record the draws of one render pass on several threads.
+        // Each worker opens its list for the framebuffer with beginSecondaryCommands, records only
+        // setGraphicsState / draw calls on that framebuffer and closes it with endSingleTimeCommands.
+        // The parent then runs them in the given order inside a single render pass.
+        virtual void beginSecondaryCommands(IFramebuffer *framebuffer) = 0;
+        virtual void executeSecondaryCommandLists(IFramebuffer *framebuffer, const std::vector<IRHICommandList *> &commandLists) = 0;
+
         // Clears the graphics state of the underlying command list object and resets the state cache.
         virtual void clearState() = 0;
 
@@ -1304,9 +1471,22 @@ namespace RHI
             std::vector<ITexture *> colorAttachments, ITexture *depthAttachment, const std::vector<Rect> &rects
         ) = 0;
         virtual void copyMIPBufferToImage(IBuffer *buffer, ITexture *texture) = 0;
+        // uploads every mip and layer at once, imageData is laid out as expected by copyMIPBufferToImage
+        virtual bool updateTextureImageAllMips(ITexture *texture, const void *imageData) = 0;
         virtual void copyBuffer(IBuffer *srcBuffer, IBuffer *dstBuffer, size_t size) = 0;
-        virtual void writeBuffer(IBuffer *srcBuffer, size_t size, const void *data) = 0;
+        virtual void copyBuffer(
+            IBuffer *srcBuffer, uint64_t srcOffsetBytes, IBuffer *dstBuffer, uint64_t dstOffsetBytes, size_t size
+        ) = 0;
+        virtual void writeBuffer(IBuffer *srcBuffer, size_t size, const void *data, uint64_t destOffsetBytes = 0) = 0;
         virtual void setPushConstants(const void *data, size_t byteSize) = 0;
+        // Binding set for per-frame data, valid until the submission of this command list has finished on the queue.
+        // It is never destroyed individually, its descriptor pool is reset as a whole once the submission retires.
+        virtual IBindingSet *createTransientBindingSet(IBindingLayout *bindingLayout, const DescriptorSetInfo &dsInfo) = 0;
+        // Writes dsInfo into the command buffer for set setIndex of the pipeline set last by setGraphicsState or setComputeState.
+        // The pipeline's layout at setIndex must be a BindingLayoutFlags::PushDescriptor layout, leave that slot null in the state.
+        // Barriers cannot be recorded inside a render pass, sets pushed there must be listed in GraphicsState::pushDescriptorSets.
+        // Secondary lists record their pushes, the parent transitions the textures before it executes them.
+        virtual void pushDescriptorSet(uint32_t setIndex, const DescriptorSetInfo &dsInfo) = 0;
 
         virtual void
         beginTrackingTextureState(ITexture *texture, TextureSubresource subresource, ResourceStates states) = 0;
@@ -1314,8 +1494,139 @@ namespace RHI
         virtual void setPermanentTextureState(ITexture *texture, ResourceStates states) = 0;
 
         virtual void commitBarriers() = 0;
+
+        // counts of state changes recorded and filtered as redundant since the last reset
+        virtual const CommandListStatistics &getStatistics() const = 0;
+        virtual void resetStatistics() = 0;
+    };
+
+    struct MemoryStatistics
+    {
+        uint32_t blockCount = 0;             // sub-allocated device memory blocks
+        uint32_t dedicatedAllocationCount = 0;
+        uint32_t allocationCount = 0;        // resources living in device memory
+        uint64_t blockBytes = 0;             // bytes reserved from the driver
+        uint64_t usedBytes = 0;              // bytes handed out to resources
+    };
+
+    struct HeapDesc
+    {
+        uint64_t capacity = 0;
+        MemoryPropertiesBits memoryProperties = MemoryPropertiesBits::DEVICE_LOCAL_BIT;
+        // memory types the heap may use, the intersection of MemoryRequirements::memoryTypeBits
+        // of every resource that will be placed in it
+        uint32_t memoryTypeBits = ~0u;
+        std::string debugName;
+
+        HeapDesc& setCapacity(uint64_t value) { capacity = value; return *this; }
+        HeapDesc& setMemoryProperties(MemoryPropertiesBits value) { memoryProperties = value; return *this; }
+        HeapDesc& setMemoryTypeBits(uint32_t value) { memoryTypeBits = value; return *this; }
+        HeapDesc& setDebugName(const std::string& value) { debugName = value; return *this; }
+    };
+
+    // a block of device memory that virtual textures and buffers are placed into, several resources may alias it
+    class IHeap : public IResource
+    {
+    public:
+        virtual const HeapDesc& getDesc() const = 0;
+    };
+
+    struct MemoryRequirements
+    {
+        uint64_t size = 0;
+        uint64_t alignment = 0;
+        uint32_t memoryTypeBits = 0;
+    };
+
+    struct MemoryHeapBudget
+    {
+        uint64_t size = 0;                   // total size of the heap
+        uint64_t budget = 0;                 // bytes the process can use before allocations may fail or get paged out
+        uint64_t usage = 0;                  // bytes currently used by the process
+        bool isDeviceLocal = false;
+    };
+
+    // position of a tile of a sparse texture, x, y and z are counted in tiles
+    struct TextureTile
+    {
+        uint32_t mipLevel = 0;
+        uint32_t arrayLayer = 0;
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t z = 0;
+
+        TextureTile& setMipLevel(uint32_t value) { mipLevel = value; return *this; }
+        TextureTile& setArrayLayer(uint32_t value) { arrayLayer = value; return *this; }
+        TextureTile& setCoordinates(uint32_t valueX, uint32_t valueY, uint32_t valueZ = 0) { x = valueX; y = valueY; z = valueZ; return *this; }
     };
 
+    struct TextureTiling
+    {
+        struct MipLevel
+        {
+            uint32_t tilesX = 0;
+            uint32_t tilesY = 0;
+            uint32_t tilesZ = 0;
+        };
+
+        uint32_t tileWidth = 0;              // tile size in texels
+        uint32_t tileHeight = 0;
+        uint32_t tileDepth = 0;
+        uint64_t tileSizeInBytes = 0;
+
+        // levels from packedMipLevel on are too small for tiles and share the mip tail, made resident as a whole
+        uint32_t packedMipLevel = 0;
+        uint32_t mipTailTileCount = 0;
+        bool singleMipTail = false;          // one mip tail for all array layers
+
+        std::vector<MipLevel> mipLevels;     // tile counts of the levels below packedMipLevel
+    };
+
+    struct DefragmentationStats
+    {
+        uint32_t resourcesMoved = 0;
+        uint64_t bytesMoved = 0;
+        uint32_t bindingSetsUpdated = 0;
+    };
+
+    struct BindingSetCacheStatistics
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;     // entries dropped because a resource they reference was destroyed
+        uint32_t entries = 0;
+    };
+
+    static constexpr uint32_t kInvalidBindlessIndex = ~0u;
+
+    // bindings of the bindless descriptor set, each one an array indexed by the bindless index of a resource
+    enum class BindlessDescriptorType : uint8_t
+    {
+        SampledImage = 0,   // textures with isShaderResource, in SHADER_READ_ONLY layout
+        StorageImage,       // textures with isUAV, mip 0 in GENERAL layout
+        StorageBuffer,      // buffers with isStorageBuffer, whole buffer
+        Sampler,
+
+        Count
+    };
+
+    struct BindlessHeapDesc
+    {
+        // array sizes of the bindings, clamped to the update after bind limits of the device
+        uint32_t maxSampledImages = 16384;
+        uint32_t maxStorageImages = 1024;
+        uint32_t maxStorageBuffers = 16384;
+        uint32_t maxSamplers = 256;
+
+        BindlessHeapDesc& setMaxSampledImages(uint32_t value) { maxSampledImages = value; return *this; }
+        BindlessHeapDesc& setMaxStorageImages(uint32_t value) { maxStorageImages = value; return *this; }
+        BindlessHeapDesc& setMaxStorageBuffers(uint32_t value) { maxStorageBuffers = value; return *this; }
+        BindlessHeapDesc& setMaxSamplers(uint32_t value) { maxSamplers = value; return *this; }
+    };
+
+    // called when a heap is over budget, returns true when resources were released and the allocation should retry
+    typedef std::function<bool(uint32_t heapIndex, uint64_t requiredBytes)> MemoryEvictionCallback;
+
     class IDevice : public IResource
     {
     public:
@@ -1331,16 +1642,23 @@ namespace RHI
         virtual void initPipelineCache(const std::vector<uint8_t>& initialData = {}) = 0;
         virtual std::vector<uint8_t> getPipelineCacheData() const = 0;
         virtual ShaderHandle createShaderModule(const char* fileName, const std::vector<unsigned int>& SPIRV) = 0;
-        virtual BindingLayoutHandle createDescriptorSetLayout(const DescriptorSetInfo& dsInfo) = 0;
+        virtual BindingLayoutHandle createDescriptorSetLayout(const DescriptorSetInfo& dsInfo, BindingLayoutFlags flags = BindingLayoutFlags::None) = 0;
         virtual BindingSetHandle createDescriptorSet(const DescriptorSetInfo& dsInfo, uint32_t dSetCount, IBindingLayout* bindingLayout) = 0;
+        // Sets with the same layout and the same DescriptorSetInfo are shared, the handle may point to a set returned before.
+        // Only for sets that are not updated afterwards: updating a shared set with different content takes it out of the cache,
+        // but every holder sees the change.
+        virtual BindingSetHandle createCachedDescriptorSet(const DescriptorSetInfo& dsInfo, IBindingLayout* bindingLayout) = 0;
         virtual void updateDescriptorSet(IBindingSet *ds, const DescriptorSetInfo &dsInfo) = 0;
+        virtual BindingSetCacheStatistics getBindingSetCacheStatistics() const = 0;
         virtual InputLayoutHandle createInputLayout(const VertexInputAttributeDesc* attributes, uint32_t attributeCount, const VertexInputBindingDesc* bindings, uint32_t bindingCount) = 0;
         virtual TextureHandle createImage(const TextureDesc& desc) = 0;
+        // samplers are shared, an identical desc returns the sampler that is already alive
         virtual SamplerHandle createTextureSampler(const SamplerDesc& desc = SamplerDesc()) = 0;
         virtual SamplerHandle createDepthSampler() = 0;
         virtual BufferHandle createBuffer(const BufferDesc& desc) = 0;
         virtual BufferHandle createSharedBuffer(const BufferDesc& desc) = 0;
         virtual BufferHandle addBuffer(const BufferDesc& desc, bool createMapping = false) = 0;
+        virtual ConstantBufferArenaHandle createConstantBufferArena(uint64_t bytesPerFrame, uint32_t frameCount) = 0;
         virtual void uploadBufferData(IBuffer* buffer, size_t deviceOffset, const void* data, const size_t dataSize) = 0;
         virtual void uploadVertexIndexBufferData(IBuffer* buffer, size_t deviceOffset, size_t vertexDataSize, const void* vertexData,
             size_t indexDataSize, const void* indexData, const size_t dataSize) = 0;
@@ -1355,6 +1673,35 @@ namespace RHI
         virtual void* mapStagingTextureMemory(ITexture* texture, size_t offset, size_t size) = 0;
         virtual void unmapBufferMemory(IBuffer* buffer) = 0;
         virtual void unmapStagingTextureMemory(ITexture* texture) = 0;
+        virtual MemoryStatistics getMemoryStatistics() const = 0;
+        virtual std::vector<MemoryHeapBudget> getMemoryHeapBudgets() const = 0;
+        virtual void setMemoryEvictionCallback(MemoryEvictionCallback callback) = 0;
+        // placed resources
+        virtual HeapHandle createHeap(const HeapDesc& desc) = 0;
+        virtual MemoryRequirements getTextureMemoryRequirements(ITexture* texture) = 0;
+        virtual MemoryRequirements getBufferMemoryRequirements(IBuffer* buffer) = 0;
+        virtual bool bindTextureMemory(ITexture* texture, IHeap* heap, uint64_t offset) = 0;
+        virtual bool bindBufferMemory(IBuffer* buffer, IHeap* heap, uint64_t offset) = 0;
+        // Moves resources out of sparsely used device memory blocks so the blocks can be released.
+        // Copies are recorded into commandList, at most maxBytesToMove per call to spread the work over frames.
+        // Binding sets that reference moved resources are switched to new descriptors, command lists recorded before the call
+        // keep the old ones and must be submitted no later than commandList, the old memory is released once it has executed.
+        virtual DefragmentationStats defragmentMemory(IRHICommandList* commandList, uint64_t maxBytesToMove) = 0;
+        // sparse textures (SPARSE_BINDING_BIT | SPARSE_RESIDENCY_BIT) get memory per tile from a pool with a fixed budget,
+        // residency changes fail when the budget is exhausted and tiles have to be evicted first
+        virtual TextureTiling getTextureTiling(ITexture* texture) = 0;
+        virtual bool setTextureTilesResident(ITexture* texture, const std::vector<TextureTile>& tiles, bool resident,
+            CommandQueue executionQueue = CommandQueue::Graphics) = 0;
+        virtual bool setTextureMipTailResident(ITexture* texture, uint32_t arrayLayer, bool resident,
+            CommandQueue executionQueue = CommandQueue::Graphics) = 0;
+        virtual void setSparseMemoryBudget(uint64_t bytes) = 0;
+        virtual uint64_t getSparseMemoryUsage() const = 0;
+        // bindless mode (DeviceParams::enableBindless), shader visible resources get a stable index into one global
+        // descriptor set when they are created, so a draw passes indices in push constants instead of binding a set per material.
+        // The layout is null when the device does not support update after bind descriptors.
+        virtual BindingLayoutHandle getBindlessLayout() const = 0;
+        virtual IBindingSet* getBindlessSet() const = 0;
+        virtual uint32_t getBindlessIndex(IResource* resource, BindlessDescriptorType type) const = 0;
 
         uint64_t executeCommandList(IRHICommandList* commandList, CommandQueue executionQueue = CommandQueue::Graphics)
         {
@@ -1382,6 +1729,15 @@ namespace RHI
         bool vSyncEnabled = false;
         bool supportScreenshots = false;
 
+        bool enableBindless = false;
+        BindlessHeapDesc bindlessHeapDesc = {};
+
+        // binding sets become ranges of one host visible descriptor buffer (VK_EXT_descriptor_buffer) when the device
+        // supports it, otherwise they keep coming from descriptor pools. Not combined with bindless mode, and layouts
+        // cannot hold dynamic buffers or be push descriptor layouts in this mode
+        bool enableDescriptorBuffer = false;
+        uint64_t descriptorBufferSize = 16 * 1024 * 1024;
+
         std::vector<const char *> requiredVulkanInstanceExtensions;
     };
 
@@ -3,12 +3,15 @@
 #include <Vulkan.hpp>
 
 #include <Common/ResourcesStateTracking.hpp>
+#include <Common/TLSFAllocator.hpp>
 
 #include <vector>
 #include <functional>
 
 #include <map>
 #include <array>
+#include <atomic>
+#include <deque>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -21,6 +24,18 @@ namespace RHI::Vulkan
 	class Device;
 	class CommandList;
 	class Texture;
+	class MemoryAllocator;
+	class MemoryResource;
+	class StagingBufferPool;
+	class BindingSetRegistry;
+	class SparseTilePool;
+	struct SparsePageTable;
+	class BindlessHeap;
+	class DescriptorAllocator;
+	class BindingSetCache;
+	class DescriptorBufferHeap;
+	class LayoutCache;
+	class SamplerCache;
 
         struct ResourceStateMapping {
             ResourceStates state;
@@ -62,8 +77,14 @@ namespace RHI::Vulkan
 
         VkImageAspectFlags pickImageAspect(Format format);
 
+        // one region per mip level covering all layers, mips packed tightly one after another, returns the total size
+        uint64_t fillMipCopyRegions(const TextureDesc &desc, std::vector<VkBufferImageCopy> &regions);
+
         void countShaders(IShader* shader, uint32_t& numShaders);
 
+        // indices into dsInfo.textures of the textures whose state has to be tracked
+        void getTexturesWithoutPermanentState(const DescriptorSetInfo &dsInfo, std::vector<uint16_t> &textureIndices);
+
 	// Features we need for our Vulkan context
 	struct VulkanContextFeatures
 	{
@@ -97,6 +118,16 @@ namespace RHI::Vulkan
 
 		/* for multiview rendering */
 		bool multiview = false;
+
+		/* for virtual textures, enabled when the device supports them */
+		bool sparseBinding = false;
+		bool sparseResidencyImage2D = false;
+
+		/* for the bindless descriptor heap, enabled when requested and the device supports update after bind */
+		bool bindlessDescriptors = false;
+
+		/* binding sets in a descriptor buffer instead of pools, enabled when requested and supported */
+		bool descriptorBuffer = false;
 	};
 
 	struct VulkanContextExtensions
@@ -105,6 +136,9 @@ namespace RHI::Vulkan
 		bool KHR_maintenance3 = false;
 		bool EXT_discriptor_indexing = false;
 		bool EXT_draw_indirect_count = false;
+		bool EXT_memory_budget = false; // enabled when the device supports it
+		bool KHR_push_descriptor = false; // enabled when the device supports it
+		bool EXT_descriptor_buffer = false;
 #if defined (__APPLE__)
 		bool KHR_portability_subset = false; // either KHR_ or Vulkan 1.2 versions
 #endif
@@ -175,11 +209,24 @@ namespace RHI::Vulkan
 		VkQueue graphicsQueue;
 		VkDescriptorPool descriptorPool;
 	        VkPipelineCache pipelineCache;
+		MemoryAllocator* memoryAllocator = nullptr;
+		StagingBufferPool* stagingBufferPool = nullptr;
+		BindingSetRegistry* bindingSetRegistry = nullptr;
+		SparseTilePool* sparseTilePool = nullptr;
+		BindlessHeap* bindlessHeap = nullptr;
+		DescriptorAllocator* descriptorAllocator = nullptr;
+		BindingSetCache* bindingSetCache = nullptr;
+		DescriptorBufferHeap* descriptorBufferHeap = nullptr;
+		LayoutCache* layoutCache = nullptr;
+		SamplerCache* samplerCache = nullptr;
 
 		VulkanContextExtensions ctxExtensions;
 		VulkanContextFeatures ctxFeatures;
 	};
 
+	struct CommandPoolSlot;
+	struct UploadChunk;
+
 	// command buffer with resource tracking
 	class TrackedCommandBuffer
 	{
@@ -187,10 +234,15 @@ namespace RHI::Vulkan
 
 		// the command buffer itself
 		VkCommandBuffer commandBuffer = VkCommandBuffer();
-		VkCommandPool commandPool = VkCommandPool();
+		VkCommandPool commandPool = VkCommandPool(); // owned by the slot
+		VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		CommandPoolSlot* slot = nullptr;
 
 		std::vector<IResource*> referencedResources; // to keep them alive
 		std::vector<BufferHandle> referencedStagingBuffers; // to allow synchronous mapBuffer
+		std::vector<std::shared_ptr<IResource>> referencedRelocatedResources; // old copies of defragmented resources
+		std::vector<std::shared_ptr<TrackedCommandBuffer>> referencedSecondaryBuffers; // executed by this one, recycled with it
+		std::vector<std::shared_ptr<UploadChunk>> referencedUploadChunks; // read by the copies of this submission
 
 		uint64_t recordingID = 0;
 		uint64_t submissionID = 0;
@@ -200,14 +252,44 @@ namespace RHI::Vulkan
 		{
 		}
 
-		~TrackedCommandBuffer();
-
 	private:
 		const VulkanContext& m_Context;
 	};
 
 	typedef std::shared_ptr<TrackedCommandBuffer> TrackedCommandBufferPtr;
 
+	// one command pool of a ring, every command buffer allocated from it is reset at once with vkResetCommandPool
+	struct CommandPoolSlot
+	{
+		VkCommandPool commandPool = VkCommandPool();
+		// indexed by VkCommandBufferLevel, allocated once and reused after every reset
+		std::vector<TrackedCommandBufferPtr> commandBuffers[2];
+		uint32_t usedCount[2] = {};
+		uint64_t frameIndex = 0;
+		// handed out and not yet retired by Queue::retireCommandBuffers
+		std::atomic<uint32_t> pendingCount = 0;
+	};
+
+	// command pools of one recording thread on one queue, the thread moves to the next slot every frame
+	// and only resets a slot once all of its command buffers have finished executing
+	class CommandPoolRing
+	{
+	public:
+		CommandPoolRing(const VulkanContext& context, uint32_t queueFamilyIndex);
+		~CommandPoolRing();
+
+		TrackedCommandBufferPtr getCommandBuffer(VkCommandBufferLevel level, uint64_t frameIndex);
+
+	private:
+		CommandPoolSlot* acquireSlot(uint64_t frameIndex);
+
+		const VulkanContext& m_Context;
+		uint32_t m_QueueFamilyIndex;
+
+		std::vector<std::unique_ptr<CommandPoolSlot>> m_Slots;
+		uint32_t m_CurrentSlot = 0;
+	};
+
 	class Queue
 	{
 	public:
@@ -216,9 +298,8 @@ namespace RHI::Vulkan
 
 		VkSemaphore trackingSemaphore;
 
-		TrackedCommandBufferPtr createCommandBuffer();
-
-		TrackedCommandBufferPtr getOrCreateCommandBuffer();
+		// takes a command buffer from the ring of the calling thread, no lock once the thread has its ring
+		TrackedCommandBufferPtr getOrCreateCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
 		void addWaitSemaphore(VkSemaphore semaphore, uint64_t value);
 		void addSignalSemaphore(VkSemaphore semaphore, uint64_t value);
@@ -226,22 +307,46 @@ namespace RHI::Vulkan
 		// submits a command buffer to this queue, returns submissionID
 		uint64_t submit(std::vector<IRHICommandList*>& commandLists, size_t numCommandLists);
 
+		// changes sparse bindings after all work submitted so far, later submissions wait for it, returns submissionID
+		uint64_t bindSparse(const std::vector<VkSparseImageMemoryBindInfo>& imageBinds,
+			const std::vector<VkSparseImageOpaqueMemoryBindInfo>& imageOpaqueBinds);
+		bool supportsSparseBinding() const { return m_SupportsSparseBinding; }
+
 		// retire any command buffers that have finished execution from the pending execution list
 		void retireCommandBuffers();
+		// gives back a command buffer whose recording will never be submitted, from any thread
+		void discardCommandBuffer(const TrackedCommandBufferPtr& commandBuffer);
+
+		// calls release from retireCommandBuffers once the submission has finished on this queue, for objects
+		// whose owner goes away while the GPU may still use them. The submission stays 0 while its ID is unknown,
+		// the release then waits until it is stamped, or until the queue is destroyed
+		void deferRelease(std::shared_ptr<std::atomic<uint64_t>> submission, std::function<void()> release);
+		void deferRelease(uint64_t submissionID, std::function<void()> release);
+		// runs every deferred release regardless of its submission, the device must be idle
+		void releaseDeferred();
 
 		uint64_t updateLastFinishedID();
+		uint64_t getLastSubmittedID() const { return m_LastSubmittedID; }
 		CommandQueue getQueueID() const { return m_QueueID; }
 		uint32_t getQueueFamilyIndex() const { return m_QueueFamilyIndex; }
 		VkQueue getVkQueue() const { return m_Queue; }
 
 	private:
+		// drops what the command buffer and its secondaries keep alive and lets their slots be reset
+		void releaseCommandBuffer(TrackedCommandBuffer& commandBuffer);
+
 		const VulkanContext& m_Context;
 
 		VkQueue m_Queue;
 		CommandQueue m_QueueID;
 		uint32_t m_QueueFamilyIndex = uint32_t(-1);
+		bool m_SupportsSparseBinding = false;
 
-		std::mutex m_Mutex;
+		std::mutex m_Mutex; // only taken when a thread records on this queue for the first time
+
+		uint64_t m_UID = 0; // identifies the queue in the thread local ring lookup
+		std::atomic<uint64_t> m_FrameIndex = 0; // advanced by every retireCommandBuffers
+		std::vector<std::unique_ptr<CommandPoolRing>> m_CommandPoolRings;
 
 		std::vector<VkSemaphore> m_WaitSemaphores;
 		std::vector<uint64_t> m_WaitSemaphoreValues;
@@ -251,9 +356,18 @@ namespace RHI::Vulkan
 		uint64_t m_LastSubmittedID = 0;
 		uint64_t m_LastFinishedID = 0;
 
-		// tracks the list of command buffers in flight on this queue
-		std::list<TrackedCommandBufferPtr> m_CommandBuffersInFlight;
-		std::list<TrackedCommandBufferPtr> m_CommandBuffersPool;
+		// command buffers in flight on this queue in submission order, retired from the front
+		std::deque<TrackedCommandBufferPtr> m_CommandBuffersInFlight;
+
+		struct DeferredRelease
+		{
+			std::shared_ptr<std::atomic<uint64_t>> submission;
+			std::function<void()> release;
+		};
+
+		// filled from any thread, unlike the in flight list
+		std::mutex m_DeferredReleaseMutex;
+		std::vector<DeferredRelease> m_DeferredReleases;
 	};
 
 	class VulkanRHIModule : public IRHIModule
@@ -291,6 +405,9 @@ namespace RHI::Vulkan
 		uint32_t transferFamily;
 		VkQueue transferQueue;
 		bool useTransferQueue;
+
+		BindlessHeapDesc bindlessHeapDesc;
+		uint64_t descriptorBufferSize = 0;
 	};
 
 	class VulkanDynamicRHI : public IDynamicRHI
@@ -378,11 +495,128 @@ namespace RHI::Vulkan
 		std::vector<VkPresentModeKHR> presentModes;
 	};
 
+	// A single vkAllocateMemory, either carved up between many resources or dedicated to one
+	struct MemoryBlock
+	{
+		explicit MemoryBlock(VkDeviceSize blockSize)
+			: size(blockSize)
+			, allocator(blockSize)
+		{}
+
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		uint32_t pool = 0;
+		bool dedicated = false;
+
+		/* host visible blocks are mapped once on creation, resources get pointers into it */
+		void* mappedPtr = nullptr;
+		bool coherent = true;
+
+		TLSFAllocator allocator;
+
+		/* resources living in the block, the defragmenter moves them out of sparsely used blocks */
+		std::unordered_set<MemoryResource*> resources;
+	};
+
+	struct MemoryAllocation
+	{
+		MemoryBlock* block = nullptr;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		TLSFAllocator::Allocation range;
+		MemoryResource* owner = nullptr;
+
+		bool isValid() const { return block != nullptr; }
+	};
+
+	class MemoryAllocator
+	{
+	public:
+		explicit MemoryAllocator(const VulkanContext& context);
+		~MemoryAllocator();
+
+		MemoryAllocation allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties);
+		MemoryAllocation allocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, bool linearTiling);
+		// standalone allocation for a heap, placed resources are bound at offsets inside it.
+		// Returns an invalid allocation when the driver refuses the memory
+		MemoryAllocation allocateHeapMemory(VkDeviceSize size, VkMemoryPropertyFlags properties, uint32_t memoryTypeBits);
+		void free(MemoryAllocation& allocation);
+
+		// persistent CPU address of the allocation, nullptr when the memory is not host visible
+		void* getMappedPointer(const MemoryAllocation& allocation) const;
+
+		// no-ops for host coherent memory
+		void flush(const MemoryAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		void invalidate(const MemoryAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+		MemoryStatistics getStatistics() const;
+
+		std::vector<MemoryHeapBudget> getHeapBudgets() const;
+		void setEvictionCallback(MemoryEvictionCallback callback);
+
+		// makes the resource visible to the defragmenter, call once its memory is bound
+		void registerResource(MemoryResource* resource, const std::shared_ptr<IResource>& handle);
+		// resources of the least used block of every pool, up to maxBytes in total, resources being destroyed are skipped
+		std::vector<std::shared_ptr<IResource>> getRelocationCandidates(VkDeviceSize maxBytes) const;
+		// new place for a resource in another existing block of its pool, never allocates a new block
+		MemoryAllocation allocateForRelocation(const VkMemoryRequirements& requirements, const MemoryAllocation& current);
+		// moves the resource to the new allocation and returns the old one, which has to be freed once the GPU copy is done
+		MemoryAllocation relocate(MemoryResource* resource, const MemoryAllocation& allocation);
+
+	private:
+		// exits when no memory can be allocated, unless mayFail is set, an invalid allocation is returned then
+		MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+			uint32_t pool, bool dedicated, const VkMemoryDedicatedAllocateInfo& dedicatedInfo, bool mayFail = false);
+		uint32_t selectMemoryType(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, uint32_t pool, bool dedicated);
+		// size padded for the type, and whether it gets its own device memory instead of a block suballocation
+		VkDeviceSize getPaddedSize(uint32_t memoryTypeIndex, VkDeviceSize size) const;
+		bool needsDedicatedBlock(uint32_t memoryTypeIndex, VkDeviceSize paddedSize) const;
+		// bytes requested from the driver when the allocation does not fit an existing block of the type
+		VkDeviceSize getDeviceAllocationSize(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated) const;
+		bool isOverBudget(uint32_t heapIndex, VkDeviceSize size) const;
+		bool canSuballocate(uint32_t memoryTypeIndex, uint32_t pool, VkDeviceSize size, VkDeviceSize alignment) const;
+		MemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, const void* pNext);
+		void destroyBlock(MemoryBlock* block);
+		VkDeviceSize getPreferredBlockSize(uint32_t memoryTypeIndex) const;
+		VkMappedMemoryRange getMappedRange(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+		// pool 1 holds optimal tiled images, everything else goes to pool 0
+		static constexpr uint32_t kPoolCount = 2;
+
+		const VulkanContext& m_Context;
+		VkPhysicalDeviceMemoryProperties m_MemoryProperties{};
+		VkDeviceSize m_BufferImageGranularity = 1;
+		VkDeviceSize m_NonCoherentAtomSize = 1;
+
+		mutable std::mutex m_Mutex;
+		std::vector<std::unique_ptr<MemoryBlock>> m_Blocks[VK_MAX_MEMORY_TYPES][kPoolCount];
+		std::vector<std::unique_ptr<MemoryBlock>> m_DedicatedBlocks;
+
+		// bytes allocated from the driver per heap, used as usage when VK_EXT_memory_budget is missing
+		VkDeviceSize m_HeapAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+
+		// the budget is queried from the driver every kBudgetRefreshInterval device allocations and by every getHeapBudgets call,
+		// allocation decisions in between use the cached one
+		static constexpr uint32_t kBudgetRefreshInterval = 16;
+		mutable std::vector<MemoryHeapBudget> m_CachedBudgets;
+		mutable VkDeviceSize m_AllocatedBytesAtBudgetRefresh[VK_MAX_MEMORY_HEAPS] = {};
+		mutable uint32_t m_AllocationsSinceBudgetRefresh = 0;
+		MemoryEvictionCallback m_EvictionCallback;
+	};
+
 	class MemoryResource
 	{
 	public:
+		virtual ~MemoryResource() = default;
+
 		bool managed = true;
-		VkDeviceMemory memory = VK_NULL_HANDLE;
+		MemoryAllocation allocation;
+		// set by registerResource, lets the defragmenter hold a resource that another thread may release
+		std::weak_ptr<IResource> handle;
 	};
 
 	class Shader final : public IShader
@@ -402,6 +636,105 @@ namespace RHI::Vulkan
 		const VulkanContext &m_Context;
 	};
 
+	class Heap : public IHeap
+	{
+	public:
+		explicit Heap(const VulkanContext& context)
+			: m_Context(context)
+		{}
+		~Heap() override;
+
+		HeapDesc desc;
+		MemoryAllocation allocation;
+
+		virtual const HeapDesc& getDesc() const override { return desc; }
+
+	private:
+		const VulkanContext& m_Context;
+	};
+
+	struct SparseTileChunk;
+
+	struct SparseTile
+	{
+		SparseTileChunk* chunk = nullptr;
+		uint32_t index = 0;
+
+		bool isValid() const { return chunk != nullptr; }
+	};
+
+	// Device memory for the tiles of sparse textures, requested from the allocator in chunks of tiles
+	// and given back as soon as a chunk has no tile in use. Usage never grows beyond the budget.
+	class SparseTilePool
+	{
+	public:
+		explicit SparseTilePool(const VulkanContext& context);
+		~SparseTilePool();
+
+		SparseTile allocate(VkDeviceSize tileSize, uint32_t memoryTypeBits);
+		// the tile may still be in use by the GPU until submissionID has finished on the queue, nullptr frees it right away
+		void release(const SparseTile& tile, Queue* queue, uint64_t submissionID);
+
+		VkDeviceMemory getMemory(const SparseTile& tile) const;
+		VkDeviceSize getMemoryOffset(const SparseTile& tile) const;
+
+		void setBudget(VkDeviceSize bytes);
+		VkDeviceSize getUsage() const;
+
+	private:
+		struct PendingTile
+		{
+			SparseTile tile;
+			Queue* queue = nullptr;
+			uint64_t submissionID = 0;
+		};
+
+		void reclaimPendingTiles();
+		void freeTile(const SparseTile& tile);
+
+		static constexpr uint32_t kTilesPerChunk = 256;
+		static constexpr VkDeviceSize kDefaultBudget = 256ull * 1024 * 1024;
+
+		const VulkanContext& m_Context;
+
+		mutable std::mutex m_Mutex;
+		std::vector<std::unique_ptr<SparseTileChunk>> m_Chunks;
+		std::vector<PendingTile> m_PendingTiles;
+		VkDeviceSize m_Budget = kDefaultBudget;
+		VkDeviceSize m_UsedBytes = 0;
+	};
+
+	// Tiles of a sparse texture and the pool memory backing them
+	struct SparsePageTable
+	{
+		VkSparseImageMemoryRequirements requirements{};
+		VkDeviceSize tileSize = 0;
+		uint32_t memoryTypeBits = 0;
+		TextureTiling tiling;
+
+		std::vector<uint32_t> firstTile; // index into tiles of the first tile of every (layer, mip) below the mip tail
+		std::vector<SparseTile> tiles;
+		std::vector<std::vector<SparseTile>> mipTails; // per array layer, a single one with singleMipTail
+	};
+
+	class ConstantBufferArena : public IConstantBufferArena
+	{
+	public:
+		BufferHandle buffer;
+		uint8_t* mappedMemory = nullptr;
+
+		uint64_t bytesPerFrame = 0;
+		uint32_t frameCount = 0;
+		uint64_t alignment = 256;
+
+		uint64_t frameBase = 0;
+		uint64_t writePointer = 0;
+
+		virtual void beginFrame(uint32_t frameIndex) override;
+		virtual ConstantBufferAllocation allocate(size_t size) override;
+		virtual IBuffer* getBuffer() const override { return buffer.get(); }
+	};
+
 	class Buffer : public IBuffer, public MemoryResource
 	{
 	public:
@@ -412,12 +745,15 @@ namespace RHI::Vulkan
 
 		BufferDesc		desc = {};
 
+		VkBufferCreateInfo bufferInfo{};
 		VkBuffer		buffer = VK_NULL_HANDLE;
 		VkDeviceSize	size = 0u;
 
-		/* Permanent mapping to CPU address space (see VulkanResources::addBuffer) */
+		/* Permanent mapping to CPU address space, set on creation for host visible buffers */
 		void* ptr = nullptr;
 
+		uint32_t bindlessIndex = kInvalidBindlessIndex;
+
 		virtual const BufferDesc& getDesc() const override
 		{
 			return desc;
@@ -443,11 +779,38 @@ namespace RHI::Vulkan
 		}
 
 		VkSampler sampler = VK_NULL_HANDLE;
+		uint32_t bindlessIndex = kInvalidBindlessIndex;
+		bool depthSampler = false; // made by createDepthSampler, its state is not described by desc
+		bool isCached = false; // shared through the SamplerCache under cacheHash
+		size_t cacheHash = 0;
 
 	private:
 		const VulkanContext& m_Context;
 	};
 
+	// Live samplers by their desc, so identical samplers are created once
+	class SamplerCache
+	{
+	public:
+		static size_t hash(const SamplerDesc& desc, bool depthSampler);
+
+		SamplerHandle find(const SamplerDesc& desc, bool depthSampler, size_t hash);
+		// the handle of a live sampler, null if it did not come from the cache
+		SamplerHandle getHandle(Sampler* sampler);
+		void add(size_t hash, const SamplerHandle& sampler);
+		void remove(Sampler* sampler);
+
+	private:
+		struct Entry
+		{
+			Sampler* sampler = nullptr;
+			std::weak_ptr<ISampler> handle;
+		};
+
+		std::mutex m_Mutex;
+		std::unordered_multimap<size_t, Entry> m_Entries;
+	};
+
         inline bool operator==(const VkImageSubresourceRange &a, const VkImageSubresourceRange &b) noexcept {
             return a.aspectMask == b.aspectMask && a.baseMipLevel == b.baseMipLevel && a.levelCount == b.levelCount &&
                    a.baseArrayLayer == b.baseArrayLayer && a.layerCount == b.layerCount;
@@ -506,6 +869,12 @@ namespace RHI::Vulkan
 	    VkImage image = nullptr;
 	    std::unordered_map<SubresourceViewKey, TextureView, SubresourceViewKeyHash> subresourceViews;
 
+	    // set for sparse textures, their memory is bound per tile
+	    std::unique_ptr<SparsePageTable> pageTable;
+
+	    uint32_t bindlessSampledIndex = kInvalidBindlessIndex;
+	    uint32_t bindlessStorageIndex = kInvalidBindlessIndex;
+
 	    // Offscreen buffers require VK_IMAGE_LAYOUT_GENERAL && static textures have VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 	    VkImageLayout currentLayout = VkImageLayout::VK_IMAGE_LAYOUT_UNDEFINED;
 
@@ -582,6 +951,8 @@ namespace RHI::Vulkan
 		return createInfo;
 	}
 
+	VkDescriptorImageInfo getImageDescriptor(ITexture* texture, ISampler* sampler, DescriptorType type, const TextureSubresource& subresource);
+
 	inline VkDescriptorSetLayoutBinding descriptorSetLayoutBinding(uint32_t binding, VkDescriptorType descriptorType, VkShaderStageFlags stageFlags, uint32_t descriptorCount = 1)
 	{
 		return VkDescriptorSetLayoutBinding{
@@ -749,10 +1120,58 @@ namespace RHI::Vulkan
 		virtual const VertexInputBindingDesc* getVertexBindingDesc(uint32_t index) const override;
 	};
 
+	// Update template built with a BindingLayout for its exact shape. The sets allocated from the layout share it,
+	// so the defragmenter can still rewrite them after the layout handle is gone
+	class DescriptorUpdateTemplate
+	{
+	public:
+		// one slot of the packed update data, every descriptor takes one slot whatever its kind
+		union Entry
+		{
+			VkDescriptorBufferInfo buffer;
+			VkDescriptorImageInfo image;
+		};
+
+		// updates with at most this many descriptors pack their data on the stack
+		static constexpr uint32_t kMaxStackEntries = 64;
+
+		VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+		uint32_t entryCount = 0;
+
+		uint32_t bufferCount = 0;
+		uint32_t textureCount = 0;
+		std::vector<uint32_t> textureArraySizes;
+		std::vector<uint32_t> bufferArraySizes;
+
+		DescriptorUpdateTemplate(const VulkanContext &context, VkDescriptorSetLayout layout, const DescriptorSetInfo &dsInfo);
+		~DescriptorUpdateTemplate();
+
+		// false when dsInfo has a different shape than the layout, the update then falls back to descriptor writes
+		bool matches(const DescriptorSetInfo &dsInfo) const;
+
+	private:
+		const VulkanContext &m_Context;
+	};
+
+	// Where the descriptors of a layout go inside its range of the descriptor buffer
+	struct DescriptorBufferLayout
+	{
+		VkDeviceSize size = 0; // aligned to descriptorBufferOffsetAlignment
+		std::vector<VkDeviceSize> bindingOffsets;
+		// per binding, combined image samplers are written with it instead of the sampler of the set
+		std::vector<VkSampler> immutableSamplers;
+	};
+
 	class BindingLayout : public IBindingLayout
 	{
 	public:
 		VkDescriptorSetLayout descriptorSetLayout;
+		std::shared_ptr<DescriptorBufferLayout> descriptorBufferLayout; // descriptor buffer mode only
+		std::shared_ptr<DescriptorUpdateTemplate> updateTemplate; // null for push descriptor layouts
+		bool pushDescriptor = false;
+		std::vector<SamplerHandle> immutableSamplers; // baked into descriptorSetLayout, kept alive with it
+		bool isCached = false; // interned by the LayoutCache under cacheHash
+		size_t cacheHash = 0;
 
 		explicit BindingLayout(const VulkanContext &context)
 		: m_Context(context)
@@ -766,19 +1185,330 @@ namespace RHI::Vulkan
 	class BindingSet : public IBindingSet
 	{
 	public:
-		VkDescriptorPool descriptorPool;
-		VkDescriptorSet descriptorSet;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE; // shared pool the set was allocated from, unless ownsDescriptorPool
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		std::vector<VkDescriptorPoolSize> descriptorPoolSizes; // taken from the shared pool, given back when the set is freed
+		bool ownsDescriptorPool = false;
+		bool isCached = false; // shared through the BindingSetCache under cacheHash
+		size_t cacheHash = 0;
+		std::shared_ptr<DescriptorUpdateTemplate> updateTemplate; // from the layout, null for the bindless set
+		// descriptor buffer mode, the set is descriptorBufferLayout->size bytes at descriptorBufferOffset
+		std::shared_ptr<DescriptorBufferLayout> descriptorBufferLayout;
+		VkDeviceSize descriptorBufferOffset = 0;
+		TLSFAllocator::Allocation descriptorBufferRange; // owned range, invalid for transient sets
+		BindingLayoutHandle layout; // descriptor pool mode, the defragmenter allocates replacement sets from it
                 DescriptorSetInfo desc;
 
 	        std::vector<uint16_t> texturesWithoutPermanentState;
+		// dynamic offsets this set takes from GraphicsState::dynamicOffsets
+		uint32_t dynamicBufferCount = 0;
 
 		BindingSet(const VulkanContext& context);
 		virtual ~BindingSet();
 
                 virtual const DescriptorSetInfo &getDesc() const override { return desc; }
 
+                bool referencesAny(const std::unordered_set<IResource*>& resources) const;
+
+	private:
+		const VulkanContext& m_Context;
+	};
+
+	// Live binding sets, their descriptors are rewritten from desc when the defragmenter relocates a resource
+	class BindingSetRegistry
+	{
+	public:
+		void add(BindingSet* bindingSet);
+		void remove(BindingSet* bindingSet);
+
+		// the lock is held during the callback, so no set can be destroyed while it is being rewritten
+		void forEach(const std::function<void(BindingSet*)>& callback);
+
+	private:
+		std::mutex m_Mutex;
+		std::unordered_set<BindingSet*> m_BindingSets;
+	};
+
+	// Binding sets shared by identical DescriptorSetInfos, see IDevice::createCachedDescriptorSet. Entries are weak, an entry goes away when the last handle
+	// to its set is released or when a resource the set references is destroyed, so a new resource at the same address never hits.
+	class BindingSetCache
+	{
+	public:
+		static size_t hash(IBindingLayout* layout, const DescriptorSetInfo& dsInfo);
+
+		BindingSetHandle find(IBindingLayout* layout, const DescriptorSetInfo& dsInfo, size_t hash);
+		void add(IBindingLayout* layout, size_t hash, const BindingSetHandle& bindingSet);
+		void remove(BindingSet* bindingSet);
+		void evictResource(IResource* resource);
+
+		BindingSetCacheStatistics getStatistics() const;
+
+	private:
+		struct Entry
+		{
+			IBindingLayout* layout = nullptr;
+			BindingSet* bindingSet = nullptr;
+			std::weak_ptr<IBindingSet> handle;
+		};
+
+		void removeLocked(BindingSet* bindingSet);
+
+		mutable std::mutex m_Mutex;
+		std::unordered_multimap<size_t, Entry> m_Entries;
+		std::unordered_map<IResource*, std::vector<BindingSet*>> m_SetsByResource;
+		BindingSetCacheStatistics m_Statistics;
+	};
+
+	// A pipeline layout shared by all pipelines with the same set layouts and push constants
+	class PipelineLayout
+	{
+	public:
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		std::vector<BindingLayoutHandle> bindingLayouts; // the set layouts live as long as the pipeline layout
+		std::vector<VkPushConstantRange> pushConstantRanges; // as the layout was created with
+		bool isCached = false;
+		size_t cacheHash = 0;
+
+		explicit PipelineLayout(const VulkanContext& context)
+			: m_Context(context)
+		{}
+		~PipelineLayout();
+
+	private:
+		const VulkanContext& m_Context;
+	};
+
+	// Interns binding layouts and pipeline layouts by structure. Identical layouts come back as the same object,
+	// so pipelines built from them share their VkPipelineLayout and keep the sets they have in common bound.
+	class LayoutCache
+	{
+	public:
+		struct BindingLayoutKey
+		{
+			std::vector<VkDescriptorSetLayoutBinding> bindings; // without their immutable samplers
+			std::vector<VkSampler> immutableSamplers; // per binding, VK_NULL_HANDLE where sets provide the sampler
+			// buffers, textures, texture arrays and buffer arrays of the DescriptorSetInfo, they decide how sets are written
+			uint32_t attachmentCounts[4] = {};
+			BindingLayoutFlags flags = BindingLayoutFlags::None;
+
+			bool operator==(const BindingLayoutKey& other) const;
+		};
+
+		struct PipelineLayoutKey
+		{
+			std::vector<VkDescriptorSetLayout> setLayouts; // interned, equal handles mean equal layouts
+			std::vector<VkPushConstantRange> pushConstantRanges;
+
+			bool operator==(const PipelineLayoutKey& other) const;
+		};
+
+		static size_t hash(const BindingLayoutKey& key);
+		static size_t hash(const PipelineLayoutKey& key);
+
+		BindingLayoutHandle find(const BindingLayoutKey& key, size_t hash);
+		BindingLayoutHandle getHandle(BindingLayout* layout);
+		std::shared_ptr<PipelineLayout> find(const PipelineLayoutKey& key, size_t hash);
+		// a thread that created an equal layout in the meantime wins, its layout is returned and the one passed in
+		// is left uncached to be dropped by the caller
+		BindingLayoutHandle add(BindingLayoutKey key, size_t hash, const BindingLayoutHandle& layout);
+		std::shared_ptr<PipelineLayout> add(PipelineLayoutKey key, size_t hash, const std::shared_ptr<PipelineLayout>& layout);
+		void remove(BindingLayout* layout);
+		void remove(PipelineLayout* layout);
+
+	private:
+		BindingLayoutHandle findLocked(const BindingLayoutKey& key, size_t hash);
+		std::shared_ptr<PipelineLayout> findLocked(const PipelineLayoutKey& key, size_t hash);
+
+		struct BindingLayoutEntry
+		{
+			BindingLayoutKey key;
+			BindingLayout* layout = nullptr;
+			std::weak_ptr<IBindingLayout> handle;
+		};
+
+		struct PipelineLayoutEntry
+		{
+			PipelineLayoutKey key;
+			PipelineLayout* layout = nullptr;
+			std::weak_ptr<PipelineLayout> handle;
+		};
+
+		std::mutex m_Mutex;
+		std::unordered_multimap<size_t, BindingLayoutEntry> m_BindingLayouts;
+		std::unordered_multimap<size_t, PipelineLayoutEntry> m_PipelineLayouts;
+	};
+
+	// Allocates binding sets out of a list of shared descriptor pools and opens another pool when all of them are full.
+	// The pools are created with FREE_DESCRIPTOR_SET_BIT, so a destroyed set goes back to the pool it came from.
+	class DescriptorAllocator
+	{
+	public:
+		explicit DescriptorAllocator(const VulkanContext& context);
+		~DescriptorAllocator();
+
+		// poolSizes are the descriptors the set needs, a new pool is made large enough for them
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& poolSizes, VkDescriptorPool* pool);
+		// poolSizes must be the ones the set was allocated with
+		void free(VkDescriptorPool pool, VkDescriptorSet descriptorSet, const std::vector<VkDescriptorPoolSize>& poolSizes);
+
+	private:
+		struct Pool
+		{
+			VkDescriptorPool pool = VK_NULL_HANDLE;
+			uint32_t allocatedSets = 0;
+			// descriptors of each type not handed out yet, a pool is only tried when every type of the set fits,
+			// so running out of one type does not keep sets of other types away from it
+			std::vector<VkDescriptorPoolSize> available;
+			bool fragmented = false; // refused a set that fit the counts, tried again once a set is freed
+		};
+
+		Pool* createPool(const std::vector<VkDescriptorPoolSize>& requiredSizes);
+
+		static constexpr uint32_t kSetsPerPool = 1024;
+
+		const VulkanContext& m_Context;
+
+		std::mutex m_Mutex;
+		std::vector<std::unique_ptr<Pool>> m_Pools;
+		std::unordered_map<VkDescriptorPool, Pool*> m_PoolLookup;
+	};
+
+	struct TransientDescriptorPool
+	{
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		// descriptor buffer mode, sets are carved linearly out of a range of the descriptor buffer instead of a pool
+		TLSFAllocator::Allocation descriptorBufferRange;
+		VkDeviceSize descriptorBufferUsed = 0;
+		std::vector<std::unique_ptr<BindingSet>> bindingSets; // reused after every reset
+		uint32_t usedSets = 0;
+
+		// submission of the recording that allocated from the pool, 0 until it has been submitted
+		std::shared_ptr<std::atomic<uint64_t>> submission;
+	};
+
+	typedef std::shared_ptr<TransientDescriptorPool> TransientDescriptorPoolPtr;
+
+	// Binding sets that live until the submission of a command list has finished. They are never freed one by one,
+	// their pools are reset with vkResetDescriptorPool once the tracking semaphore of the queue has passed the submission.
+	class TransientDescriptorManager
+	{
+	public:
+		TransientDescriptorManager(Device* device, const VulkanContext& context, CommandQueue queueID);
+		~TransientDescriptorManager();
+
+		BindingSet* allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& poolSizes);
+		BindingSet* allocate(const std::shared_ptr<DescriptorBufferLayout>& layout);
+		void submitPools(uint64_t submissionID);
+
+		// ends the recording without submitting it, the primary list executing the commands stamps the result
+		std::shared_ptr<std::atomic<uint64_t>> closeRecording();
+
+	private:
+		bool allocateFromCurrentPool(VkDescriptorSetLayout layout, VkDescriptorSet* descriptorSet);
+		// puts a pool whose submission has finished back in m_CurrentPool
+		bool recycleFinishedPool(const std::function<bool(const TransientDescriptorPool&)>& fits);
+		BindingSet* nextBindingSet();
+
+		static constexpr uint32_t kSetsPerPool = 256;
+		static constexpr VkDeviceSize kDescriptorBufferRangeSize = 64 * 1024;
+
+		Device* m_Device;
+		const VulkanContext& m_Context;
+		CommandQueue m_QueueID;
+
+		std::shared_ptr<std::atomic<uint64_t>> m_Submission;
+		TransientDescriptorPoolPtr m_CurrentPool;
+		std::list<TransientDescriptorPoolPtr> m_PoolList;
+	};
+
+	// One update after bind descriptor set shared by all draws, every binding is an array indexed by the bindless index
+	// of a resource. Indices are handed out when a resource is created and recycled once the work submitted
+	// before the resource was destroyed has finished, so a slot is never rewritten while the GPU may still read it.
+	class BindlessHeap
+	{
+	public:
+		BindlessHeap(Device* device, const VulkanContext& context, const BindlessHeapDesc& desc);
+
+		void registerTexture(Texture* texture);
+		void registerBuffer(Buffer* buffer);
+		void registerSampler(Sampler* sampler);
+		void releaseTexture(Texture* texture);
+		void releaseBuffer(Buffer* buffer);
+		void releaseSampler(Sampler* sampler);
+
+		BindingLayoutHandle getLayout() const { return m_Layout; }
+		BindingSet* getSet() const { return m_Set.get(); }
+
+	private:
+		struct PendingIndex
+		{
+			BindlessDescriptorType type;
+			uint32_t index = kInvalidBindlessIndex;
+			std::array<uint64_t, uint32_t(CommandQueue::Count)> submissionIDs{};
+		};
+
+		uint32_t allocateIndex(BindlessDescriptorType type);
+		void releaseIndex(BindlessDescriptorType type, uint32_t index);
+		void reclaimPendingIndices();
+		void writeImage(BindlessDescriptorType type, uint32_t index, VkImageView imageView, VkSampler sampler);
+		void writeBuffer(uint32_t index, VkBuffer buffer);
+
+		Device* m_Device;
+		const VulkanContext& m_Context;
+
+		uint32_t m_Capacity[uint32_t(BindlessDescriptorType::Count)] = {};
+
+		BindingLayoutHandle m_Layout;
+		std::shared_ptr<BindingSet> m_Set;
+
+		std::mutex m_Mutex;
+		uint32_t m_NextIndex[uint32_t(BindlessDescriptorType::Count)] = {};
+		std::vector<uint32_t> m_FreeIndices[uint32_t(BindlessDescriptorType::Count)];
+		std::vector<PendingIndex> m_PendingIndices;
+	};
+
+	// Host visible buffer holding the descriptors of every binding set in descriptor buffer mode. A set is a range of it,
+	// creating one is a range allocation plus vkGetDescriptorEXT writes, binding it is vkCmdSetDescriptorBufferOffsetsEXT.
+	// Freed ranges are reused once the work submitted before the free has finished, like bindless indices.
+	class DescriptorBufferHeap
+	{
+	public:
+		DescriptorBufferHeap(Device* device, const VulkanContext& context, VkDeviceSize size);
+		~DescriptorBufferHeap();
+
+		// invalid allocation when the heap is full
+		TLSFAllocator::Allocation allocate(VkDeviceSize size);
+		void free(const TLSFAllocator::Allocation& range);
+
+		std::shared_ptr<DescriptorBufferLayout> createLayout(VkDescriptorSetLayout layout, uint32_t bindingCount) const;
+		void writeDescriptors(VkDeviceSize offset, const DescriptorBufferLayout& layout, const DescriptorSetInfo& dsInfo);
+
+		VkDescriptorBufferBindingInfoEXT getBindingInfo() const;
+
 	private:
+		struct PendingRange
+		{
+			TLSFAllocator::Allocation range;
+			std::array<uint64_t, uint32_t(CommandQueue::Count)> submissionIDs{};
+		};
+
+		void reclaimPendingRanges();
+		size_t getDescriptorSize(VkDescriptorType type) const;
+		void writeDescriptor(uint8_t* dst, VkDescriptorType type, const VkDescriptorDataEXT& data);
+
+		Device* m_Device;
 		const VulkanContext& m_Context;
+
+		VkPhysicalDeviceDescriptorBufferPropertiesEXT m_Properties{};
+		VkBufferUsageFlags m_Usage = 0;
+		VkBuffer m_Buffer = VK_NULL_HANDLE;
+		MemoryAllocation m_Allocation;
+		uint8_t* m_MappedPtr = nullptr;
+		VkDeviceAddress m_Address = 0;
+
+		std::mutex m_Mutex;
+		TLSFAllocator m_Allocator;
+		std::vector<PendingRange> m_PendingRanges;
 	};
 
 	class GraphicsPipeline : public IGraphicsPipeline
@@ -786,8 +1516,11 @@ namespace RHI::Vulkan
 	public:
 		GraphicsPipelineDesc desc = {};
 		VkPipeline pipeline;
-		VkPipelineLayout pipelineLayout;
+		std::shared_ptr<PipelineLayout> layout;
+		VkPipelineLayout pipelineLayout; // layout->pipelineLayout
 		VkShaderStageFlags pushConstantsVisibility;
+		uint32_t pushConstantsSize = 0;
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts; // the layout is compatible with others sharing a prefix of these
 		bool usesBlendConstants = false;
 
 		explicit GraphicsPipeline(const VulkanContext& context)
@@ -806,8 +1539,11 @@ namespace RHI::Vulkan
 
             std::vector<BindingLayout*> pipelineBindingLayouts;
             VkPipeline pipeline;
-            VkPipelineLayout pipelineLayout;
+            std::shared_ptr<PipelineLayout> layout;
+            VkPipelineLayout pipelineLayout; // layout->pipelineLayout
             VkShaderStageFlags pushConstantsVisibility;
+            uint32_t pushConstantsSize = 0;
+            std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
             bool usesBlendConstants = false;
 
             explicit ComputePipeline(const VulkanContext& context)
@@ -820,6 +1556,69 @@ namespace RHI::Vulkan
             const VulkanContext& m_Context;
         };
 
+	// Recycles persistently mapped staging buffers in power of two size classes.
+	// Buffers referenced by a command buffer come back once the queue retires it.
+	class StagingBufferPool
+	{
+	public:
+		explicit StagingBufferPool(Device* device);
+
+		BufferHandle acquire(uint64_t size);
+		void release(const BufferHandle& buffer);
+
+	private:
+		static uint32_t getSizeClass(uint64_t size);
+
+		static constexpr uint32_t kMinSizeClassLog2 = 16;
+		static constexpr uint32_t kSizeClassCount = 13; // 64KB .. 256MB
+		static constexpr uint64_t kMaxPooledBytes = 256ull * 1024 * 1024;
+
+		Device* m_Device;
+
+		std::mutex m_Mutex;
+		std::vector<BufferHandle> m_FreeBuffers[kSizeClassCount];
+		uint64_t m_PooledBytes = 0;
+	};
+
+	struct UploadChunk
+	{
+		BufferHandle buffer;
+		uint64_t size = 0;
+		uint64_t writePointer = 0;
+		uint8_t* mappedMemory = nullptr;
+
+		// submission that last used the chunk, 0 while commands using it are still being recorded
+		uint64_t submissionID = 0;
+	};
+
+	typedef std::shared_ptr<UploadChunk> UploadChunkPtr;
+
+	// Linear allocator over persistently mapped chunks, used to stage data uploaded by a command list.
+	// Chunks are recycled once the tracking semaphore of the queue has passed the submission that used them,
+	// the command buffer of that submission keeps them alive until it is retired.
+	class UploadManager
+	{
+	public:
+		UploadManager(Device* device, CommandQueue queueID, uint64_t defaultChunkSize);
+
+		bool suballocate(uint64_t size, uint64_t alignment, Buffer** buffer, uint64_t* offset, void** cpuAddress);
+		void submitChunks(TrackedCommandBuffer& commandBuffer, uint64_t submissionID);
+
+	private:
+		UploadChunkPtr createChunk(uint64_t size);
+
+		// finished chunks kept for reuse, counted in default chunk sizes
+		static constexpr uint64_t kMaxIdleChunks = 4;
+
+		Device* m_Device;
+		CommandQueue m_QueueID;
+		uint64_t m_DefaultChunkSize;
+
+		UploadChunkPtr m_CurrentChunk;
+		std::vector<UploadChunkPtr> m_RecordingChunks;
+		std::list<UploadChunkPtr> m_ChunkPool;
+	};
+
 	class Device : public IDevice
 	{
 	public:
@@ -852,6 +1651,7 @@ namespace RHI::Vulkan
 		virtual BufferHandle createSharedBuffer(const BufferDesc& desc) override;
 
 		virtual BufferHandle addBuffer(const BufferDesc& desc, bool createMapping = false) override;
+		virtual ConstantBufferArenaHandle createConstantBufferArena(uint64_t bytesPerFrame, uint32_t frameCount) override;
 
 		inline BufferHandle addUniformBuffer(uint64_t bufferSize, bool createMapping = false)
 		{
@@ -899,13 +1699,38 @@ namespace RHI::Vulkan
 			size_t deviceRowSize) override; // GPU expected row size
 
 		/** Copy GPU device buffer data to [outData] */
-		void downloadBufferData(const VkDeviceMemory& bufferMemory, VkDeviceSize deviceOffset, void* outData, size_t dataSize);
+		void downloadBufferData(IBuffer* buffer, VkDeviceSize deviceOffset, void* outData, size_t dataSize);
 
 		virtual void* mapBufferMemory(IBuffer* buffer, size_t offset, size_t size) override;
 		virtual void* mapStagingTextureMemory(ITexture* texture, size_t offset, size_t size) override;
 		virtual void unmapBufferMemory(IBuffer* buffer) override;
 		virtual void unmapStagingTextureMemory(ITexture* texture) override;
 
+		virtual MemoryStatistics getMemoryStatistics() const override;
+		virtual std::vector<MemoryHeapBudget> getMemoryHeapBudgets() const override;
+		virtual void setMemoryEvictionCallback(MemoryEvictionCallback callback) override;
+
+		virtual HeapHandle createHeap(const HeapDesc& desc) override;
+		virtual MemoryRequirements getTextureMemoryRequirements(ITexture* texture) override;
+		virtual MemoryRequirements getBufferMemoryRequirements(IBuffer* buffer) override;
+		virtual bool bindTextureMemory(ITexture* texture, IHeap* heap, uint64_t offset) override;
+		virtual bool bindBufferMemory(IBuffer* buffer, IHeap* heap, uint64_t offset) override;
+
+		virtual DefragmentationStats defragmentMemory(IRHICommandList* commandList, uint64_t maxBytesToMove) override;
+
+		virtual TextureTiling getTextureTiling(ITexture* texture) override;
+		virtual bool setTextureTilesResident(ITexture* texture, const std::vector<TextureTile>& tiles, bool resident,
+			CommandQueue executionQueue = CommandQueue::Graphics) override;
+		virtual bool setTextureMipTailResident(ITexture* texture, uint32_t arrayLayer, bool resident,
+			CommandQueue executionQueue = CommandQueue::Graphics) override;
+		virtual void setSparseMemoryBudget(uint64_t bytes) override;
+		virtual uint64_t getSparseMemoryUsage() const override;
+		void initSparsePageTable(Texture* texture);
+
+		virtual BindingLayoutHandle getBindlessLayout() const override;
+		virtual IBindingSet* getBindlessSet() const override;
+		virtual uint32_t getBindlessIndex(IResource* resource, BindlessDescriptorType type) const override;
+
 		inline uint32_t getVulkanBufferAlignment()
 		{
 			VkPhysicalDeviceProperties devProps;
@@ -924,9 +1749,9 @@ namespace RHI::Vulkan
 		IRenderPass* addDepthRenderPass(const RenderPassCreateInfo ci = {
 			false, true, true, eRenderPassBit_Offscreen | eRenderPassBit_First });
 
-		bool createPipelineLayout(
-			std::vector<VkDescriptorSetLayout> &dsLayouts, const PushConstantsDesc &constantsDesc, VkPipelineLayout *pipelineLayout,
-			VkShaderStageFlags pushConstantStages);
+		// the interned layout for these set layouts and push constants, created on first use
+		std::shared_ptr<PipelineLayout> getPipelineLayout(
+			const std::vector<BindingLayoutHandle> &bindingLayouts, VkShaderStageFlags pushConstantsVisibility, uint32_t pushConstantsSize);
 
 		bool createPipelineLayoutWithConstants(VkDescriptorSetLayout dsLayout, VkPipelineLayout* pipelineLayout, uint32_t vtxConstSize, uint32_t fragConstSize);
 
@@ -934,18 +1759,17 @@ namespace RHI::Vulkan
 
 		VkPipeline addPipeline(const GraphicsPipelineDesc& desc, IFramebuffer* framebuffer);
 
-		/* Calculate the descriptor pool size from the list of buffers and textures */
-		VkDescriptorPool createDescriptorPool(const DescriptorSetInfo& dsInfo, uint32_t dSetCount = 1);
-
-		virtual BindingLayoutHandle createDescriptorSetLayout(const DescriptorSetInfo& dsInfo);
+		virtual BindingLayoutHandle createDescriptorSetLayout(const DescriptorSetInfo& dsInfo, BindingLayoutFlags flags = BindingLayoutFlags::None);
 
 		virtual BindingSetHandle createDescriptorSet(const DescriptorSetInfo& dsInfo, uint32_t dSetCount, IBindingLayout* bindingLayout) override;
+		virtual BindingSetHandle createCachedDescriptorSet(const DescriptorSetInfo& dsInfo, IBindingLayout* bindingLayout) override;
 
 		virtual InputLayoutHandle createInputLayout(
 			const VertexInputAttributeDesc* attributes, uint32_t attributeCount,
 			const VertexInputBindingDesc* bindings, uint32_t bindingCount) override;
 
 		virtual void updateDescriptorSet(IBindingSet* ds, const DescriptorSetInfo& dsInfo) override;
+		virtual BindingSetCacheStatistics getBindingSetCacheStatistics() const override;
 
 		bool createColorAndDepthFramebuffers(VkRenderPass renderPass, VkImageView depthImageView, std::vector<VkFramebuffer>& swapchainFramebuffers);
 
@@ -975,12 +1799,31 @@ namespace RHI::Vulkan
 		DeviceDesc m_DeviceDesc;
 		VulkanResources m_Resources;
 
+		// declared before the queues so that staging buffers held by in-flight command buffers are released first
+		std::unique_ptr<MemoryAllocator> m_MemoryAllocator;
+		std::unique_ptr<StagingBufferPool> m_StagingBufferPool;
+		std::unique_ptr<SparseTilePool> m_SparseTilePool;
+		BindingSetRegistry m_BindingSetRegistry;
+		BindingSetCache m_BindingSetCache;
+		LayoutCache m_LayoutCache;
+		SamplerCache m_SamplerCache;
+		std::unique_ptr<DescriptorAllocator> m_DescriptorAllocator;
+		std::unique_ptr<BindlessHeap> m_BindlessHeap;
+		std::unique_ptr<DescriptorBufferHeap> m_DescriptorBufferHeap;
+
 		// array of submission queues
 		std::array<std::unique_ptr<Queue>, uint32_t(CommandQueue::Count)> m_Queues;
 
 		// a list of all queues indices (for shared buffer allocations)
 		std::vector<uint32_t> m_DeviceQueueIndices;
 
+		// allocates, binds and maps the memory of a new buffer, then registers it with the allocator and the bindless heap
+		BufferHandle allocateBufferMemory(Buffer* buffer);
+
+		// moves the binding set to a new descriptor set or descriptor buffer range written from its desc,
+		// returns the old one, which work recorded earlier still uses
+		BindingSetHandle replaceDescriptorSet(BindingSet* bindingSet);
+
 		virtual GraphicsPipelineHandle createGraphicsPipeline(const GraphicsPipelineDesc& desc, IFramebuffer* framebuffer) override;
 	        virtual ComputePipelineHandle createComputePipeline(const ComputePipelineDesc& desc) override;
 	};
@@ -995,11 +1838,14 @@ namespace RHI::Vulkan
 
 		virtual void beginSingleTimeCommands() override;
 		virtual void endSingleTimeCommands() override;
+		virtual void beginSecondaryCommands(IFramebuffer* framebuffer) override;
+		virtual void executeSecondaryCommandLists(IFramebuffer* framebuffer, const std::vector<IRHICommandList*>& commandLists) override;
 		virtual void clearState() override;
 		virtual void queueWaitIdle() override;
 
 		virtual void copyBuffer(IBuffer* srcBuffer, IBuffer* dstBuffer, size_t size) override;
-		virtual void writeBuffer(IBuffer* srcBuffer, size_t size, const void* data) override;
+		virtual void copyBuffer(IBuffer* srcBuffer, uint64_t srcOffsetBytes, IBuffer* dstBuffer, uint64_t dstOffsetBytes, size_t size) override;
+		virtual void writeBuffer(IBuffer* srcBuffer, size_t size, const void* data, uint64_t destOffsetBytes = 0) override;
 		virtual void transitionBufferLayout(IBuffer* texture, ImageLayout oldLayout, ImageLayout newLayout) override;
 		void transitionBufferLayoutCmd(VkBuffer buffer, VkFormat format, VkAccessFlags oldAccess, VkAccessFlags newAccess, uint32_t offset = 0, uint32_t size = 0);
 
@@ -1011,6 +1857,7 @@ namespace RHI::Vulkan
 
 		virtual void copyBufferToImage(IBuffer* buffer, ITexture* texture, uint32_t mipLevel = 0, uint32_t baseArrayLayer = 0) override;
 		virtual void copyMIPBufferToImage(IBuffer* buffer, ITexture* texture) override;
+		virtual bool updateTextureImageAllMips(ITexture* texture, const void* imageData) override;
 		void copyImageToBuffer(VkImage image, VkBuffer buffer, uint32_t width, uint32_t height, uint32_t layerCount = 1);
 		virtual void copyTexture(ITexture *srcTexture, const TextureSubresource &srcSubresource, const TextureRegion &srcRegion,
 			ITexture *dstTexture, const TextureSubresource &dstSubresource, const TextureRegion &dstRegion) override;
@@ -1024,7 +1871,7 @@ namespace RHI::Vulkan
                 ) override;
 		virtual void clearAttachments(std::vector<ITexture*> colorAttachments, ITexture* depthAttachment, const std::vector<Rect>& rects) override;
 
-		void beginRenderPass(Framebuffer* framebuffer);
+		void beginRenderPass(Framebuffer* framebuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 		void endRenderPass();
 
 		void setGraphicsState(const GraphicsState& state) override;
@@ -1044,19 +1891,42 @@ namespace RHI::Vulkan
 	        void setComputeState(const ComputeState& state) override;
 	        void dispatch(uint32_t groupsX, uint32_t groupsY = 1, uint32_t groupsZ = 1) override;
 
-		void bindBindingSets(VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, const std::vector<IBindingSet*> bindings);
+		// binds the contiguous ranges of sets that are not bound yet, null sets are skipped
+		template<typename PipelineType>
+		void bindBindingSets(VkPipelineBindPoint bindPoint, const PipelineType* pipeline, const std::vector<IBindingSet*>& bindingSets,
+			const std::vector<uint32_t>& dynamicOffsets)
+		{
+			bindBindingSets(bindPoint, pipeline->pipelineLayout, pipeline->descriptorSetLayouts, pipeline->layout->pushConstantRanges,
+				bindingSets, dynamicOffsets);
+		}
+		void bindBindingSets(VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, const std::vector<VkDescriptorSetLayout>& setLayouts,
+			const std::vector<VkPushConstantRange>& pushConstantRanges, const std::vector<IBindingSet*>& bindingSets,
+			const std::vector<uint32_t>& dynamicOffsets);
 		void setPushConstants(const void* data, size_t byteSize) override;
+		IBindingSet* createTransientBindingSet(IBindingLayout* bindingLayout, const DescriptorSetInfo& dsInfo) override;
+		void pushDescriptorSet(uint32_t setIndex, const DescriptorSetInfo& dsInfo) override;
 
                 void beginTrackingTextureState(ITexture *texture, TextureSubresource subresource, ResourceStates states) override;
 	        void setTextureState(ITexture *texture, TextureSubresource subresource, ResourceStates states) override;
 	        void setPermanentTextureState(ITexture *texture, ResourceStates states) override;
                 void setTextureStatesForFramebuffer(IFramebuffer *framebuffer);
                 void setResourceStatesForBindingSet(IBindingSet *bindingSet);
+                void requireDescriptorTextureStates(const DescriptorSetInfo &dsInfo, const std::vector<uint16_t> &textureIndices);
                 void commitBarriers() override;
 
 		TrackedCommandBufferPtr getCurrentCommandBuffer() const { return m_CurrentCommandBuffer; }
 
+		const CommandListStatistics& getStatistics() const override { return m_Statistics; }
+		void resetStatistics() override { m_Statistics = CommandListStatistics(); }
+
+		// record a copy of the resource into memory picked by the allocator and swap it in, see Device::defragmentMemory
+		bool relocateBuffer(Buffer* buffer);
+		bool relocateTexture(Texture* texture);
+
 	private:
+		// hands a recording that was never executed back to the queue
+		void discardRecording();
+
 		Device* m_Device;
 		const VulkanContext& m_Context;
 		CommandListParameters m_CommandListParameters;
@@ -1066,16 +1936,64 @@ namespace RHI::Vulkan
 
 		TrackedCommandBufferPtr m_CurrentCommandBuffer;
 
+		UploadManager m_UploadManager;
+		TransientDescriptorManager m_TransientDescriptors;
+
 		VkCommandPool m_CommandPool;
 		VkCommandBuffer m_CommandBuffer;
 
 		VkPipelineLayout m_CurrentPipelineLayout;
 		VkShaderStageFlags m_CurrentPushConstantsVisibility;
 
-		GraphicsState m_CurrentGraphicsState{};
+		// the fields of the last GraphicsState that the next one is compared against, its binding sets are in m_BoundGraphicsSets
+		// and its buffer bindings in m_BoundVertexBuffers and m_BoundIndexBuffer, so no vector is copied per call.
+		// A null pipeline means nothing was set since the last compute state or command buffer
+		struct CurrentGraphicsState
+		{
+			IGraphicsPipeline* pipeline = nullptr;
+			IFramebuffer* framebuffer = nullptr;
+			IBuffer* indirectParams = nullptr;
+			ViewportState viewport;
+			Color blendColorFactor;
+			uint8_t dynamicStencilReference = 0;
+		};
+
+		CurrentGraphicsState m_CurrentGraphicsState{};
 	        ComputeState m_CurrentComputeState{};
 
+		// descriptor sets bound at one bind point and the layout they were bound with
+		struct BoundBindingSets
+		{
+			VkPipelineLayout pipelineLayout = VkPipelineLayout();
+			std::vector<VkDescriptorSetLayout> setLayouts;
+			std::vector<VkPushConstantRange> pushConstantRanges;
+
+			std::array<IBindingSet*, kMaxBindingSets> sets{}; // null when the slot is not bound or was disturbed
+			std::array<std::vector<uint32_t>, kMaxBindingSets> dynamicOffsets;
+
+			void reset();
+		};
+
+		BoundBindingSets m_BoundGraphicsSets;
+		BoundBindingSets m_BoundComputeSets;
+		bool m_DescriptorBufferBound = false; // vkCmdBindDescriptorBuffersEXT recorded in the current command buffer
+
+		std::array<VertexBufferBinding, kMaxVertexAttributes> m_BoundVertexBuffers{};
+		IndexBufferBinding m_BoundIndexBuffer{};
+
+		CommandListStatistics m_Statistics{};
+
+		// binding sets used by a secondary list, the parent moves their resources into the right states
+		std::vector<IBindingSet*> m_SecondaryBindingSets;
+		// contents pushed by a secondary list, transitioned by the parent like the binding sets
+		std::vector<DescriptorSetInfo> m_SecondaryPushDescriptors;
+		std::vector<uint16_t> m_PushTextureIndices; // scratch for the pushed textures that need state tracking
+		// transient descriptor pools of the executed secondary lists, stamped with the submission of this one
+		std::vector<std::shared_ptr<std::atomic<uint64_t>>> m_SecondaryTransientSubmissions;
+
 	        void requireTextureState(ITexture *texture, const TextureSubresource &subresource, ResourceStates requiredState);
                 void trackResourcesAndBarriers(const GraphicsState &state);
+		// whether the sets differ from the ones the last graphics state bound, their resources are tracked again then
+		bool graphicsBindingSetsChanged(const std::vector<IBindingSet*> &bindingSets) const;
 	};
 }
@@ -0,0 +1,324 @@
+#include <VulkanBackend.hpp>
+
+#include <algorithm>
+
+namespace RHI::Vulkan
+{
+    // indexed by BindlessDescriptorType, which is also the binding number
+    static const VkDescriptorType kBindlessDescriptorTypes[] = {
+        VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_SAMPLER
+    };
+
+    static const char* kBindlessDescriptorNames[] = { "sampled image", "storage image", "storage buffer", "sampler" };
+
+    BindlessHeap::BindlessHeap(Device* device, const VulkanContext& context, const BindlessHeapDesc& desc)
+        : m_Device(device)
+        , m_Context(context)
+    {
+        VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &indexingProperties;
+        vkGetPhysicalDeviceProperties2(m_Context.physicalDevice, &properties);
+
+        // the bindings are visible to all stages, so the per stage limits apply to the whole array
+        m_Capacity[uint32_t(BindlessDescriptorType::SampledImage)] = std::min({ desc.maxSampledImages,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages });
+        m_Capacity[uint32_t(BindlessDescriptorType::StorageImage)] = std::min({ desc.maxStorageImages,
+            indexingProperties.maxDescriptorSetUpdateAfterBindStorageImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageImages });
+        m_Capacity[uint32_t(BindlessDescriptorType::StorageBuffer)] = std::min({ desc.maxStorageBuffers,
+            indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+        m_Capacity[uint32_t(BindlessDescriptorType::Sampler)] = std::min({ desc.maxSamplers,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSamplers, indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlags> bindingFlags;
+        std::vector<VkDescriptorPoolSize> poolSizes;
+
+        for (uint32_t type = 0; type < uint32_t(BindlessDescriptorType::Count); type++)
+        {
+            bindings.push_back(descriptorSetLayoutBinding(type, kBindlessDescriptorTypes[type], VK_SHADER_STAGE_ALL, m_Capacity[type]));
+
+            // slots without a resource are never read, and free slots are written while the set is in use
+            bindingFlags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                   VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT);
+
+            if (m_Capacity[type])
+                poolSizes.push_back(VkDescriptorPoolSize{ kBindlessDescriptorTypes[type], m_Capacity[type] });
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo layoutBindingFlags{};
+        layoutBindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        layoutBindingFlags.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        layoutBindingFlags.pBindingFlags = bindingFlags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &layoutBindingFlags;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        BindingLayout* layout = new BindingLayout(m_Context);
+        m_Layout = BindingLayoutHandle(layout);
+
+        if (vkCreateDescriptorSetLayout(m_Context.device, &layoutInfo, nullptr, &layout->descriptorSetLayout) != VK_SUCCESS)
+        {
+            printf("Failed to create bindless descriptor set layout\n");
+            exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.empty() ? nullptr : poolSizes.data();
+
+        m_Set = std::make_shared<BindingSet>(m_Context);
+        m_Set->ownsDescriptorPool = true;
+
+        if (vkCreateDescriptorPool(m_Context.device, &poolInfo, nullptr, &m_Set->descriptorPool) != VK_SUCCESS)
+        {
+            printf("Cannot allocate bindless descriptor pool\n");
+            exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_Set->descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout->descriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(m_Context.device, &allocInfo, &m_Set->descriptorSet) != VK_SUCCESS)
+        {
+            printf("Cannot allocate bindless descriptor set\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    void BindlessHeap::reclaimPendingIndices()
+    {
+        uint64_t finishedIDs[uint32_t(CommandQueue::Count)];
+        for (uint32_t queueID = 0; queueID < uint32_t(CommandQueue::Count); queueID++)
+        {
+            Queue* queue = m_Device->getQueue(CommandQueue(queueID));
+            finishedIDs[queueID] = queue ? queue->updateLastFinishedID() : ~0ull;
+        }
+
+        auto finished = [&finishedIDs](const PendingIndex& pending) {
+            for (uint32_t queueID = 0; queueID < uint32_t(CommandQueue::Count); queueID++)
+            {
+                if (pending.submissionIDs[queueID] > finishedIDs[queueID])
+                    return false;
+            }
+            return true;
+        };
+
+        for (const PendingIndex& pending : m_PendingIndices)
+        {
+            if (finished(pending))
+                m_FreeIndices[uint32_t(pending.type)].push_back(pending.index);
+        }
+
+        m_PendingIndices.erase(std::remove_if(m_PendingIndices.begin(), m_PendingIndices.end(), finished), m_PendingIndices.end());
+    }
+
+    uint32_t BindlessHeap::allocateIndex(BindlessDescriptorType type)
+    {
+        std::vector<uint32_t>& freeIndices = m_FreeIndices[uint32_t(type)];
+
+        if (freeIndices.empty() && !m_PendingIndices.empty())
+            reclaimPendingIndices();
+
+        if (!freeIndices.empty())
+        {
+            const uint32_t index = freeIndices.back();
+            freeIndices.pop_back();
+            return index;
+        }
+
+        if (m_NextIndex[uint32_t(type)] < m_Capacity[uint32_t(type)])
+            return m_NextIndex[uint32_t(type)]++;
+
+        printf("Bindless heap is out of %s descriptors\n", kBindlessDescriptorNames[uint32_t(type)]);
+        return kInvalidBindlessIndex;
+    }
+
+    void BindlessHeap::releaseIndex(BindlessDescriptorType type, uint32_t index)
+    {
+        if (index == kInvalidBindlessIndex)
+            return;
+
+        // work submitted so far may still read the descriptor
+        PendingIndex pending;
+        pending.type = type;
+        pending.index = index;
+
+        for (uint32_t queueID = 0; queueID < uint32_t(CommandQueue::Count); queueID++)
+        {
+            Queue* queue = m_Device->getQueue(CommandQueue(queueID));
+            pending.submissionIDs[queueID] = queue ? queue->getLastSubmittedID() : 0;
+        }
+
+        m_PendingIndices.push_back(pending);
+    }
+
+    void BindlessHeap::writeImage(BindlessDescriptorType type, uint32_t index, VkImageView imageView, VkSampler sampler)
+    {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.sampler = sampler;
+        imageInfo.imageView = imageView;
+        imageInfo.imageLayout = type == BindlessDescriptorType::StorageImage ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet writeSet{};
+        writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeSet.dstSet = m_Set->descriptorSet;
+        writeSet.dstBinding = uint32_t(type);
+        writeSet.dstArrayElement = index;
+        writeSet.descriptorCount = 1;
+        writeSet.descriptorType = kBindlessDescriptorTypes[uint32_t(type)];
+        writeSet.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(m_Context.device, 1, &writeSet, 0, nullptr);
+    }
+
+    void BindlessHeap::writeBuffer(uint32_t index, VkBuffer buffer)
+    {
+        VkDescriptorBufferInfo bufferInfo{ buffer, 0, VK_WHOLE_SIZE };
+
+        VkWriteDescriptorSet writeSet{};
+        writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeSet.dstSet = m_Set->descriptorSet;
+        writeSet.dstBinding = uint32_t(BindlessDescriptorType::StorageBuffer);
+        writeSet.dstArrayElement = index;
+        writeSet.descriptorCount = 1;
+        writeSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeSet.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(m_Context.device, 1, &writeSet, 0, nullptr);
+    }
+
+    void BindlessHeap::registerTexture(Texture* texture)
+    {
+        const TextureDesc& desc = texture->desc;
+
+        // the set is written from any thread that creates a resource, the lock serializes the updates
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (desc.usage.isShaderResource && texture->bindlessSampledIndex == kInvalidBindlessIndex)
+        {
+            texture->bindlessSampledIndex = allocateIndex(BindlessDescriptorType::SampledImage);
+
+            if (texture->bindlessSampledIndex != kInvalidBindlessIndex)
+            {
+                TextureView* view = texture->GetOrCreateSubresourceView(kAllSubresources.resolveTextureSubresource(desc));
+                writeImage(BindlessDescriptorType::SampledImage, texture->bindlessSampledIndex, view->imageView, VK_NULL_HANDLE);
+            }
+        }
+
+        if (desc.usage.isUAV && texture->bindlessStorageIndex == kInvalidBindlessIndex)
+        {
+            texture->bindlessStorageIndex = allocateIndex(BindlessDescriptorType::StorageImage);
+
+            if (texture->bindlessStorageIndex != kInvalidBindlessIndex)
+            {
+                const TextureSubresource firstMip(0, 1, 0, TextureSubresource::kMaxArrayLayer);
+                TextureView* view = texture->GetOrCreateSubresourceView(firstMip.resolveTextureSubresource(desc));
+                writeImage(BindlessDescriptorType::StorageImage, texture->bindlessStorageIndex, view->imageView, VK_NULL_HANDLE);
+            }
+        }
+    }
+
+    void BindlessHeap::registerBuffer(Buffer* buffer)
+    {
+        if (!buffer->desc.usage.isStorageBuffer || buffer->bindlessIndex != kInvalidBindlessIndex)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        buffer->bindlessIndex = allocateIndex(BindlessDescriptorType::StorageBuffer);
+
+        if (buffer->bindlessIndex != kInvalidBindlessIndex)
+            writeBuffer(buffer->bindlessIndex, buffer->buffer);
+    }
+
+    void BindlessHeap::registerSampler(Sampler* sampler)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        sampler->bindlessIndex = allocateIndex(BindlessDescriptorType::Sampler);
+
+        if (sampler->bindlessIndex != kInvalidBindlessIndex)
+            writeImage(BindlessDescriptorType::Sampler, sampler->bindlessIndex, VK_NULL_HANDLE, sampler->sampler);
+    }
+
+    void BindlessHeap::releaseTexture(Texture* texture)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        releaseIndex(BindlessDescriptorType::SampledImage, texture->bindlessSampledIndex);
+        releaseIndex(BindlessDescriptorType::StorageImage, texture->bindlessStorageIndex);
+
+        texture->bindlessSampledIndex = kInvalidBindlessIndex;
+        texture->bindlessStorageIndex = kInvalidBindlessIndex;
+    }
+
+    void BindlessHeap::releaseBuffer(Buffer* buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        releaseIndex(BindlessDescriptorType::StorageBuffer, buffer->bindlessIndex);
+        buffer->bindlessIndex = kInvalidBindlessIndex;
+    }
+
+    void BindlessHeap::releaseSampler(Sampler* sampler)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        releaseIndex(BindlessDescriptorType::Sampler, sampler->bindlessIndex);
+        sampler->bindlessIndex = kInvalidBindlessIndex;
+    }
+
+    BindingLayoutHandle Device::getBindlessLayout() const
+    {
+        return m_BindlessHeap ? m_BindlessHeap->getLayout() : nullptr;
+    }
+
+    IBindingSet* Device::getBindlessSet() const
+    {
+        return m_BindlessHeap ? m_BindlessHeap->getSet() : nullptr;
+    }
+
+    uint32_t Device::getBindlessIndex(IResource* resource, BindlessDescriptorType type) const
+    {
+        switch (type)
+        {
+        case BindlessDescriptorType::SampledImage:
+            if (Texture* texture = dynamic_cast<Texture*>(resource))
+                return texture->bindlessSampledIndex;
+            break;
+        case BindlessDescriptorType::StorageImage:
+            if (Texture* texture = dynamic_cast<Texture*>(resource))
+                return texture->bindlessStorageIndex;
+            break;
+        case BindlessDescriptorType::StorageBuffer:
+            if (Buffer* buffer = dynamic_cast<Buffer*>(resource))
+                return buffer->bindlessIndex;
+            break;
+        case BindlessDescriptorType::Sampler:
+            if (Sampler* sampler = dynamic_cast<Sampler*>(resource))
+                return sampler->bindlessIndex;
+            break;
+        default:
+            break;
+        }
+
+        return kInvalidBindlessIndex;
+    }
+}
@@ -1,3 +1,4 @@
+#include <cassert>
 #include <VulkanBackend.hpp>
 #include <cstring>
 
@@ -5,10 +6,16 @@
 
 namespace RHI::Vulkan
 {
-    static VkBufferUsageFlags pickBufferUsage(const BufferDesc& desc)
+    static VkBufferUsageFlags pickBufferUsage(const BufferDesc& desc, bool deviceAddress)
     {
         VkBufferUsageFlags ret = 0;
 
+        // the defragmenter moves buffers between blocks of device memory with a copy,
+        // host visible and placed buffers always stay where they are
+        const bool movable = !desc.isVirtual && !(desc.memoryProperties & MemoryPropertiesBits::HOST_VISIBLE_BIT);
+        if (movable)
+            ret |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
         if (desc.usage.isTransferSrc)
             ret |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 
@@ -30,21 +37,42 @@ namespace RHI::Vulkan
         if (desc.usage.isDrawIndirectBuffer)
             ret |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
 
+        // descriptors in a descriptor buffer point at buffers by address
+        if (deviceAddress && (desc.usage.isUniformBuffer || desc.usage.isStorageBuffer))
+            ret |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
         return ret;
     }
 
+    BufferHandle Device::allocateBufferMemory(Buffer* buffer)
+    {
+        buffer->allocation = m_MemoryAllocator->allocateBufferMemory(buffer->buffer, pickMemoryProperties(buffer->desc.memoryProperties));
+
+        checkSuccess(vkBindBufferMemory(m_Context.device, buffer->buffer, buffer->allocation.memory, buffer->allocation.offset));
+
+        buffer->ptr = m_MemoryAllocator->getMappedPointer(buffer->allocation);
+
+        BufferHandle handle(buffer);
+        m_MemoryAllocator->registerResource(buffer, handle);
+
+        if (m_BindlessHeap)
+            m_BindlessHeap->registerBuffer(buffer);
+
+        return handle;
+    }
+
 	BufferHandle Device::createBuffer(const BufferDesc& desc)
     {
         Buffer* buffer = new Buffer(m_Context);
 
         buffer->desc = desc;
 
-        VkBufferCreateInfo bufferInfo{};
+        VkBufferCreateInfo &bufferInfo = buffer->bufferInfo;
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.pNext = nullptr;
         bufferInfo.flags = 0;
         bufferInfo.size = desc.size;
-        bufferInfo.usage = pickBufferUsage(desc);
+        bufferInfo.usage = pickBufferUsage(desc, m_Context.ctxFeatures.descriptorBuffer);
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         bufferInfo.queueFamilyIndexCount = 0;
         bufferInfo.pQueueFamilyIndices = nullptr;
@@ -53,20 +81,11 @@ namespace RHI::Vulkan
 
         m_Context.setVkObjectName(buffer->buffer, VkObjectType::VK_OBJECT_TYPE_BUFFER, desc.debugName.c_str());
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(m_Context.device, buffer->buffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, pickMemoryProperties(desc.memoryProperties));
-
-        checkSuccess(vkAllocateMemory(m_Context.device, &allocInfo, nullptr, &buffer->memory));
-
-        vkBindBufferMemory(m_Context.device, buffer->buffer, buffer->memory, 0);
+        // virtual buffers get their memory from bindBufferMemory
+        if (desc.isVirtual)
+            return BufferHandle(buffer);
 
-        return BufferHandle(buffer);
+        return allocateBufferMemory(buffer);
     }
 
     BufferHandle Device::createSharedBuffer(const BufferDesc& desc)
@@ -78,32 +97,25 @@ namespace RHI::Vulkan
 
         Buffer* buffer = new Buffer(m_Context);
 
-        VkBufferCreateInfo bufferInfo{};
+        buffer->desc = desc;
+
+        VkBufferCreateInfo &bufferInfo = buffer->bufferInfo;
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.pNext = nullptr;
         bufferInfo.flags = 0;
         bufferInfo.size = desc.size;
-        bufferInfo.usage = pickBufferUsage(desc);
+        bufferInfo.usage = pickBufferUsage(desc, m_Context.ctxFeatures.descriptorBuffer);
         bufferInfo.sharingMode = (familyCount > 1) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
         bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_DeviceQueueIndices.size());
         bufferInfo.pQueueFamilyIndices = (familyCount > 1) ? m_DeviceQueueIndices.data() : nullptr;
 
         checkSuccess(vkCreateBuffer(m_Context.device, &bufferInfo, nullptr, &buffer->buffer));
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(m_Context.device, buffer->buffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, pickMemoryProperties(desc.memoryProperties));
-
-        checkSuccess(vkAllocateMemory(m_Context.device, &allocInfo, nullptr, &buffer->memory));
+        // virtual buffers get their memory from bindBufferMemory
+        if (desc.isVirtual)
+            return BufferHandle(buffer);
 
-        vkBindBufferMemory(m_Context.device, buffer->buffer, buffer->memory, 0);
-
-        return BufferHandle(buffer);
+        return allocateBufferMemory(buffer);
     }
 
     BufferHandle Device::createUniformBuffer(VkDeviceSize bufferSize)
@@ -121,10 +133,10 @@ namespace RHI::Vulkan
 
     	Buffer* buf = dynamic_cast<Buffer*>(buffer);
 
-    	void* mappedData = nullptr;
-        vkMapMemory(m_Context.device, buf->memory, deviceOffset, dataSize, 0, &mappedData);
-        memcpy(mappedData, data, dataSize);
-        vkUnmapMemory(m_Context.device, buf->memory);
+        assert(buf->ptr);
+
+        memcpy(static_cast<uint8_t*>(buf->ptr) + deviceOffset, data, dataSize);
+        m_MemoryAllocator->flush(buf->allocation, deviceOffset, dataSize);
     }
 
     void Device::uploadVertexIndexBufferData(IBuffer* buffer, size_t deviceOffset, size_t vertexDataSize, const void* vertexData,
@@ -134,11 +146,14 @@ namespace RHI::Vulkan
 
     	Buffer* buf = dynamic_cast<Buffer*>(buffer);
 
-        void* mappedData = nullptr;
-        vkMapMemory(m_Context.device, buf->memory, deviceOffset, dataSize, 0, &mappedData);
+        assert(buf->ptr);
+        // dataSize is the range written, the vertices followed by the indices
+        assert(vertexDataSize + indexDataSize <= dataSize);
+
+        uint8_t* mappedData = static_cast<uint8_t*>(buf->ptr) + deviceOffset;
         memcpy(mappedData, vertexData, vertexDataSize);
-        memcpy((unsigned char*)mappedData + vertexDataSize, indexData, indexDataSize);
-        vkUnmapMemory(m_Context.device, buf->memory);
+        memcpy(mappedData + vertexDataSize, indexData, indexDataSize);
+        m_MemoryAllocator->flush(buf->allocation, deviceOffset, dataSize);
     }
 
     void Device::uploadMipLevelToStagingBuffer(IBuffer *stagingBuffer, size_t deviceOffset, const void *imageData, const size_t imageSize,
@@ -147,8 +162,9 @@ namespace RHI::Vulkan
     {
         Buffer *buf = dynamic_cast<Buffer *>(stagingBuffer);
 
-        void *mappedMemory = nullptr;
-        vkMapMemory(m_Context.device, buf->memory, deviceOffset, imageSize, 0, &mappedMemory);
+        assert(buf->ptr);
+
+        void *mappedMemory = static_cast<uint8_t *>(buf->ptr) + deviceOffset;
 
         uint8_t *dstPtr = reinterpret_cast<uint8_t *>(mappedMemory);
 
@@ -172,39 +188,45 @@ namespace RHI::Vulkan
             }
         }
 
-        vkUnmapMemory(m_Context.device, buf->memory);
+        m_MemoryAllocator->flush(buf->allocation, deviceOffset, imageSize);
     }
 
-    void Device::downloadBufferData(const VkDeviceMemory& bufferMemory, VkDeviceSize deviceOffset, void* outData, size_t dataSize)
+    void Device::downloadBufferData(IBuffer* buffer, VkDeviceSize deviceOffset, void* outData, size_t dataSize)
     {
         //EASY_FUNCTION()
 
-    	void* mappedData = nullptr;
-        vkMapMemory(m_Context.device, bufferMemory, deviceOffset, dataSize, 0, &mappedData);
-        memcpy(outData, mappedData, dataSize);
-        vkUnmapMemory(m_Context.device, bufferMemory);
+    	Buffer* buf = dynamic_cast<Buffer*>(buffer);
+
+        assert(buf->ptr);
+
+        m_MemoryAllocator->invalidate(buf->allocation, deviceOffset, dataSize);
+        memcpy(outData, static_cast<const uint8_t*>(buf->ptr) + deviceOffset, dataSize);
     }
 
     void* Device::mapBufferMemory(IBuffer* buffer, size_t offset, size_t size)
     {
         Buffer* buf = dynamic_cast<Buffer*>(buffer);
 
-        void* mappedData = nullptr;
-        vkMapMemory(m_Context.device, buf->memory, offset, size, 0, &mappedData);
+        if (!buf->ptr)
+            return nullptr;
 
-        return mappedData;
+        m_MemoryAllocator->invalidate(buf->allocation, offset, size);
+
+        return static_cast<uint8_t*>(buf->ptr) + offset;
     }
 
     void Device::unmapBufferMemory(IBuffer* buffer)
     {
         Buffer* buf = dynamic_cast<Buffer*>(buffer);
 
-        vkUnmapMemory(m_Context.device, buf->memory);
+        // the buffer stays mapped, only make the writes visible to the device
+        m_MemoryAllocator->flush(buf->allocation);
     }
 
     BufferHandle Device::addBuffer(const BufferDesc& desc, bool createMapping)
     {
-        Buffer *buffer = dynamic_cast<Buffer*>(createSharedBuffer(desc).get());
+        BufferHandle handle = createSharedBuffer(desc);
+        Buffer *buffer = dynamic_cast<Buffer*>(handle.get());
         if (!buffer)
         {
             printf("Cannot allocate buffer\n");
@@ -216,42 +238,269 @@ namespace RHI::Vulkan
             //m_Resources.allBuffers.push_back(buffer);
         }
 
-        if (createMapping)
-            vkMapMemory(m_Context.device, buffer->memory, 0, VK_WHOLE_SIZE, 0, &buffer->ptr);
+        // host visible buffers are always mapped on creation
+        if (createMapping && !buffer->ptr)
+        {
+            printf("Cannot map a buffer without host visible memory\n");
+        }
 
-        return BufferHandle(buffer);
+        return handle;
     }
 
-    void CommandList::writeBuffer(IBuffer* srcBuffer, size_t size, const void* data)
+    void CommandList::writeBuffer(IBuffer* srcBuffer, size_t size, const void* data, uint64_t destOffsetBytes)
     {
         endRenderPass();
 
-        BufferDesc stagingDesc = BufferDesc{}
+        Buffer* uploadBuffer = nullptr;
+        uint64_t uploadOffset = 0;
+        void* uploadCpuVA = nullptr;
+        if (!m_UploadManager.suballocate(size, 4, &uploadBuffer, &uploadOffset, &uploadCpuVA))
+        {
+            printf("Couldn't suballocate an upload buffer\n");
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(uploadCpuVA, data, size);
+
+        copyBuffer(uploadBuffer, uploadOffset, srcBuffer, destOffsetBytes, size);
+    }
+
+    ConstantBufferArenaHandle Device::createConstantBufferArena(uint64_t bytesPerFrame, uint32_t frameCount)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_Context.physicalDevice, &properties);
+
+        ConstantBufferArena* arena = new ConstantBufferArena();
+        arena->alignment = std::max<uint64_t>(properties.limits.minUniformBufferOffsetAlignment, 1);
+        arena->bytesPerFrame = (bytesPerFrame + arena->alignment - 1) / arena->alignment * arena->alignment;
+        arena->frameCount = std::max(frameCount, 1u);
+
+        BufferDesc desc = BufferDesc{}
+            .setSize(arena->bytesPerFrame * arena->frameCount)
+            .setIsUniformBuffer(true)
+            .setMemoryProperties(MemoryPropertiesBits::HOST_VISIBLE_BIT | MemoryPropertiesBits::HOST_COHERENT_BIT)
+            .setDebugName("ConstantBufferArena");
+
+        arena->buffer = addBuffer(desc, true);
+        arena->mappedMemory = static_cast<uint8_t*>(dynamic_cast<Buffer*>(arena->buffer.get())->ptr);
+
+        return ConstantBufferArenaHandle(arena);
+    }
+
+    void ConstantBufferArena::beginFrame(uint32_t frameIndex)
+    {
+        frameBase = (frameIndex % frameCount) * bytesPerFrame;
+        writePointer = 0;
+    }
+
+    ConstantBufferAllocation ConstantBufferArena::allocate(size_t size)
+    {
+        ConstantBufferAllocation allocation;
+
+        if (writePointer + size > bytesPerFrame)
+            return allocation;
+
+        allocation.buffer = buffer.get();
+        allocation.offset = static_cast<uint32_t>(frameBase + writePointer);
+        allocation.cpuAddress = mappedMemory + allocation.offset;
+
+        writePointer = (writePointer + size + alignment - 1) / alignment * alignment;
+
+        return allocation;
+    }
+
+    StagingBufferPool::StagingBufferPool(Device* device)
+        : m_Device(device)
+    {
+    }
+
+    uint32_t StagingBufferPool::getSizeClass(uint64_t size)
+    {
+        uint32_t sizeClass = 0;
+        while (sizeClass < kSizeClassCount && (1ull << (kMinSizeClassLog2 + sizeClass)) < size)
+            sizeClass++;
+
+        return sizeClass;
+    }
+
+    BufferHandle StagingBufferPool::acquire(uint64_t size)
+    {
+        const uint32_t sizeClass = getSizeClass(size);
+
+        if (sizeClass < kSizeClassCount)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            if (!m_FreeBuffers[sizeClass].empty())
+            {
+                BufferHandle buffer = m_FreeBuffers[sizeClass].back();
+                m_FreeBuffers[sizeClass].pop_back();
+                m_PooledBytes -= buffer->getDesc().size;
+                return buffer;
+            }
+        }
+
+        // sizes above the largest class get an exact fit buffer that is not pooled
+        const uint64_t bufferSize = sizeClass < kSizeClassCount ? (1ull << (kMinSizeClassLog2 + sizeClass)) : size;
+
+        BufferDesc desc = BufferDesc{}
+            .setSize(bufferSize)
+            .setIsTransferSrc(true)
+            .setMemoryProperties(MemoryPropertiesBits::HOST_VISIBLE_BIT | MemoryPropertiesBits::HOST_COHERENT_BIT)
+            .setDebugName("StagingBufferPool_Buffer");
+
+        return m_Device->addBuffer(desc, true);
+    }
+
+    void StagingBufferPool::release(const BufferHandle& buffer)
+    {
+        const uint64_t size = buffer->getDesc().size;
+        const uint32_t sizeClass = getSizeClass(size);
+
+        // only buffers handed out by acquire are exact size classes
+        if (sizeClass >= kSizeClassCount || (1ull << (kMinSizeClassLog2 + sizeClass)) != size)
+            return;
+
+        if (!dynamic_cast<Buffer*>(buffer.get())->ptr)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (m_PooledBytes + size > kMaxPooledBytes)
+            return;
+
+        m_FreeBuffers[sizeClass].push_back(buffer);
+        m_PooledBytes += size;
+    }
+
+    UploadManager::UploadManager(Device* device, CommandQueue queueID, uint64_t defaultChunkSize)
+        : m_Device(device), m_QueueID(queueID), m_DefaultChunkSize(defaultChunkSize)
+    {
+    }
+
+    UploadChunkPtr UploadManager::createChunk(uint64_t size)
+    {
+        UploadChunkPtr chunk = std::make_shared<UploadChunk>();
+
+        BufferDesc desc = BufferDesc{}
             .setSize(size)
             .setIsTransferSrc(true)
             .setMemoryProperties(MemoryPropertiesBits::HOST_VISIBLE_BIT | MemoryPropertiesBits::HOST_COHERENT_BIT)
-            .setDebugName("WriteBuffer_StagingBuffer");
-        BufferHandle stagingBuffer = m_Device->createBuffer(stagingDesc);
+            .setDebugName("UploadManager_Chunk");
+
+        chunk->buffer = m_Device->addBuffer(desc, true);
+        chunk->size = size;
+        chunk->mappedMemory = static_cast<uint8_t*>(dynamic_cast<Buffer*>(chunk->buffer.get())->ptr);
+
+        return chunk;
+    }
+
+    bool UploadManager::suballocate(uint64_t size, uint64_t alignment, Buffer** buffer, uint64_t* offset, void** cpuAddress)
+    {
+        if (m_CurrentChunk)
+        {
+            const uint64_t alignedOffset = (m_CurrentChunk->writePointer + alignment - 1) / alignment * alignment;
+
+            if (alignedOffset + size <= m_CurrentChunk->size)
+            {
+                m_CurrentChunk->writePointer = alignedOffset + size;
+
+                *buffer = dynamic_cast<Buffer*>(m_CurrentChunk->buffer.get());
+                *offset = alignedOffset;
+                *cpuAddress = m_CurrentChunk->mappedMemory + alignedOffset;
+                return true;
+            }
 
-        m_Device->uploadBufferData(stagingBuffer.get(), 0, data, size);
+            m_RecordingChunks.push_back(m_CurrentChunk);
+            m_CurrentChunk = nullptr;
+        }
+
+        const uint64_t lastFinishedID = m_Device->getQueue(m_QueueID)->updateLastFinishedID();
 
-        m_CurrentCommandBuffer->referencedStagingBuffers.push_back(stagingBuffer);
+        for (auto it = m_ChunkPool.begin(); it != m_ChunkPool.end(); ++it)
+        {
+            UploadChunkPtr chunk = *it;
+
+            if (chunk->submissionID <= lastFinishedID && chunk->size >= size)
+            {
+                m_ChunkPool.erase(it);
+                m_CurrentChunk = chunk;
+                break;
+            }
+        }
+
+        // idle chunks past the cap are released, so the staging memory of an upload spike is not kept for good
+        uint64_t idleBytes = 0;
+        for (auto it = m_ChunkPool.begin(); it != m_ChunkPool.end();)
+        {
+            if ((*it)->submissionID > lastFinishedID)
+            {
+                ++it;
+                continue;
+            }
+
+            idleBytes += (*it)->size;
+            if (idleBytes > kMaxIdleChunks * m_DefaultChunkSize)
+            {
+                idleBytes -= (*it)->size;
+                it = m_ChunkPool.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
 
-        copyBuffer(stagingBuffer.get(), srcBuffer, size);
+        if (!m_CurrentChunk)
+            m_CurrentChunk = createChunk(std::max(size, m_DefaultChunkSize));
+
+        if (!m_CurrentChunk->mappedMemory)
+            return false;
+
+        m_CurrentChunk->submissionID = 0;
+        m_CurrentChunk->writePointer = size;
+
+        *buffer = dynamic_cast<Buffer*>(m_CurrentChunk->buffer.get());
+        *offset = 0;
+        *cpuAddress = m_CurrentChunk->mappedMemory;
+        return true;
+    }
+
+    void UploadManager::submitChunks(TrackedCommandBuffer& commandBuffer, uint64_t submissionID)
+    {
+        if (m_CurrentChunk)
+        {
+            m_RecordingChunks.push_back(m_CurrentChunk);
+            m_CurrentChunk = nullptr;
+        }
+
+        for (const auto& chunk : m_RecordingChunks)
+        {
+            chunk->submissionID = submissionID;
+            m_ChunkPool.push_back(chunk);
+            // the command list may be destroyed before the copies ran
+            commandBuffer.referencedUploadChunks.push_back(chunk);
+        }
+
+        m_RecordingChunks.clear();
     }
 
     Buffer::~Buffer()
     {
+        if (m_Context.bindlessHeap)
+            m_Context.bindlessHeap->releaseBuffer(this);
+
+        if (m_Context.bindingSetCache)
+            m_Context.bindingSetCache->evictResource(this);
+
         if (managed)
         {
             if (buffer)
             {
                 vkDestroyBuffer(m_Context.device, buffer, nullptr);
             }
-            if (memory)
-            {
-                vkFreeMemory(m_Context.device, memory, nullptr);
-            }
+            ptr = nullptr;
+            m_Context.memoryAllocator->free(allocation);
         }
     }
 }
@@ -5,15 +5,32 @@ namespace RHI::Vulkan
 {
     CommandList::CommandList(Device *device, VulkanContext &context, const CommandListParameters &parameters)
         : m_Device(device), m_Context(context), m_CommandListParameters(parameters)
+        , m_UploadManager(device, parameters.queueType, parameters.uploadChunkSize)
+        , m_TransientDescriptors(device, context, parameters.queueType)
     {
     }
 
     CommandList::~CommandList()
     {
+        discardRecording();
+    }
+
+    void CommandList::discardRecording()
+    {
+        if (!m_CurrentCommandBuffer)
+            return;
+
+        m_Device->getQueue(m_CommandListParameters.queueType)->discardCommandBuffer(m_CurrentCommandBuffer);
+        m_CurrentCommandBuffer = nullptr;
     }
 
     void CommandList::beginSingleTimeCommands()
     {
+        assert(!m_CommandListParameters.isSecondary);
+
+        // a recording that was never executed is thrown away
+        discardRecording();
+
         m_CurrentCommandBuffer = m_Device->getQueue(m_CommandListParameters.queueType)->getOrCreateCommandBuffer();
 
         //vkResetCommandBuffer(m_CurrentCommandBuffer->commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
@@ -31,6 +48,12 @@ namespace RHI::Vulkan
 
     void CommandList::endSingleTimeCommands()
     {
+        if (m_CommandListParameters.isSecondary)
+        {
+            vkEndCommandBuffer(m_CurrentCommandBuffer->commandBuffer);
+            return;
+        }
+
         endRenderPass();
 
         m_StateTracker.keepTextureInitialStates();
@@ -58,6 +81,93 @@ namespace RHI::Vulkan
         vkFreeCommandBuffers(m_Context.device, m_CurrentCommandBuffer->commandPool, 1, &m_CurrentCommandBuffer->commandBuffer);*/
     }
 
+    void CommandList::beginSecondaryCommands(IFramebuffer* framebuffer)
+    {
+        assert(m_CommandListParameters.isSecondary);
+
+        Framebuffer* fb = dynamic_cast<Framebuffer*>(framebuffer);
+
+        discardRecording();
+
+        m_CurrentCommandBuffer = m_Device->getQueue(m_CommandListParameters.queueType)->getOrCreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = fb->renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = fb->framebuffer;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        vkBeginCommandBuffer(m_CurrentCommandBuffer->commandBuffer, &beginInfo);
+
+        clearState();
+        m_SecondaryBindingSets.clear();
+        m_SecondaryPushDescriptors.clear();
+
+        // the render pass is already open, setGraphicsState must not start another one
+        m_CurrentGraphicsState.framebuffer = framebuffer;
+    }
+
+    void CommandList::executeSecondaryCommandLists(IFramebuffer* framebuffer, const std::vector<IRHICommandList*>& commandLists)
+    {
+        assert(!m_CommandListParameters.isSecondary);
+        assert(m_CurrentCommandBuffer);
+
+        Framebuffer* fb = dynamic_cast<Framebuffer*>(framebuffer);
+
+        endRenderPass();
+
+        std::vector<VkCommandBuffer> commandBuffers;
+        commandBuffers.reserve(commandLists.size());
+
+        for (IRHICommandList* commandList : commandLists)
+        {
+            CommandList* secondary = dynamic_cast<CommandList*>(commandList);
+            assert(secondary && secondary->m_CommandListParameters.isSecondary && secondary->m_CurrentCommandBuffer);
+
+            if (m_EnableAutoBarriers)
+            {
+                for (IBindingSet* bindingSet : secondary->m_SecondaryBindingSets)
+                    setResourceStatesForBindingSet(bindingSet);
+
+                for (const DescriptorSetInfo& dsInfo : secondary->m_SecondaryPushDescriptors)
+                {
+                    getTexturesWithoutPermanentState(dsInfo, m_PushTextureIndices);
+                    requireDescriptorTextureStates(dsInfo, m_PushTextureIndices);
+                }
+            }
+
+            commandBuffers.push_back(secondary->m_CurrentCommandBuffer->commandBuffer);
+
+            // the secondary buffer goes back to its pool once this command buffer has finished executing
+            m_CurrentCommandBuffer->referencedSecondaryBuffers.push_back(secondary->m_CurrentCommandBuffer);
+            secondary->m_CurrentCommandBuffer = nullptr;
+            secondary->m_SecondaryBindingSets.clear();
+            secondary->m_SecondaryPushDescriptors.clear();
+
+            m_SecondaryTransientSubmissions.push_back(secondary->m_TransientDescriptors.closeRecording());
+        }
+
+        if (m_EnableAutoBarriers)
+            setTextureStatesForFramebuffer(framebuffer);
+
+        commitBarriers();
+
+        beginRenderPass(fb, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        if (!commandBuffers.empty())
+            vkCmdExecuteCommands(m_CurrentCommandBuffer->commandBuffer, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+
+        vkCmdEndRenderPass(m_CurrentCommandBuffer->commandBuffer);
+
+        // state bound by the secondary buffers does not carry over to this one
+        clearState();
+    }
+
     void CommandList::clearState()
     {
         endRenderPass();
@@ -65,27 +175,33 @@ namespace RHI::Vulkan
         m_CurrentPipelineLayout = VkPipelineLayout();
         m_CurrentPushConstantsVisibility = VkShaderStageFlags();
 
-        m_CurrentGraphicsState = GraphicsState();
+        m_CurrentGraphicsState = CurrentGraphicsState();
+        m_BoundVertexBuffers.fill(VertexBufferBinding());
+        m_BoundIndexBuffer = IndexBufferBinding();
+        m_BoundGraphicsSets.reset();
+        m_BoundComputeSets.reset();
+        m_DescriptorBufferBound = false;
     }
 
     void CommandList::queueWaitIdle()
     {
+        // the command buffer stays allocated, its pool is reset as a whole by the recording thread
         vkQueueWaitIdle(m_Device->getQueue(m_CommandListParameters.queueType)->getVkQueue());
-
-        if (m_CurrentCommandBuffer) {
-            vkFreeCommandBuffers(m_Context.device, m_CurrentCommandBuffer->commandPool, 1,
-                                 &m_CurrentCommandBuffer->commandBuffer);
-        }
     }
 
     void CommandList::copyBuffer(IBuffer* srcBuffer, IBuffer* dstBuffer, size_t size)
+    {
+        copyBuffer(srcBuffer, 0, dstBuffer, 0, size);
+    }
+
+    void CommandList::copyBuffer(IBuffer* srcBuffer, uint64_t srcOffsetBytes, IBuffer* dstBuffer, uint64_t dstOffsetBytes, size_t size)
     {
         Buffer* srcBuf = dynamic_cast<Buffer*>(srcBuffer);
         Buffer* dstBuf = dynamic_cast<Buffer*>(dstBuffer);
 
         VkBufferCopy copyRegion{};
-        copyRegion.srcOffset = 0;
-        copyRegion.dstOffset = 0;
+        copyRegion.srcOffset = srcOffsetBytes;
+        copyRegion.dstOffset = dstOffsetBytes;
         copyRegion.size = size;
 
         vkCmdCopyBuffer(m_CurrentCommandBuffer->commandBuffer, srcBuf->buffer, dstBuf->buffer, 1, &copyRegion);
@@ -119,38 +235,8 @@ namespace RHI::Vulkan
         Buffer* buf = dynamic_cast<Buffer*>(buffer);
         Texture* tex = dynamic_cast<Texture*>(texture);
 
-        FormatInfo formatInfo = getFormatInfo(tex->getDesc().format);
-        uint32_t mipWidth = tex->getDesc().width, mipHeight = tex->getDesc().height, mipDepth = tex->getDesc().depth;
-        uint32_t offset = 0;
-        std::vector<VkBufferImageCopy> regions(tex->getDesc().mipLevels);
-        for (uint32_t i = 0; i < tex->getDesc().mipLevels; i++)
-        {
-            mipWidth = std::max(mipWidth >> 1, 1u);
-            mipHeight = std::max(mipHeight >> 1, 1u);
-            mipDepth = std::max(mipDepth >> 1, 1u);
-
-            const uint32_t numColumns = (mipWidth + formatInfo.blockSize - 1) / formatInfo.blockSize;
-            const uint32_t numRows = (mipHeight + formatInfo.blockSize - 1) / formatInfo.blockSize;
-            const uint32_t rowSize = numColumns * formatInfo.bytesPerBlock;
-            size_t layerSize = rowSize * numRows * mipDepth;
-
-            VkImageSubresourceLayers subresource{};
-            subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            subresource.mipLevel = i;
-            subresource.baseArrayLayer = 0;
-            subresource.layerCount = tex->getDesc().layerCount;
-            VkBufferImageCopy region{};
-            region.bufferOffset = offset;
-            region.bufferRowLength = 0;
-            region.bufferImageHeight = 0;
-            region.imageSubresource = subresource;
-            region.imageOffset = VkOffset3D{ 0, 0, 0 };
-            region.imageExtent = VkExtent3D{ mipWidth, mipHeight, 1 };
-
-            offset += layerSize * tex->getDesc().layerCount;
-
-            regions[i] = region;
-        }
+        std::vector<VkBufferImageCopy> regions;
+        fillMipCopyRegions(tex->getDesc(), regions);
 
         vkCmdCopyBufferToImage(m_CurrentCommandBuffer->commandBuffer, buf->buffer, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
     }
@@ -186,9 +272,18 @@ namespace RHI::Vulkan
         assert(m_CurrentCommandBuffer);
 
         m_CurrentCommandBuffer->submissionID = submissionID;
+        for (const TrackedCommandBufferPtr& secondary : m_CurrentCommandBuffer->referencedSecondaryBuffers)
+            secondary->submissionID = submissionID;
+
+        m_UploadManager.submitChunks(*m_CurrentCommandBuffer, submissionID);
 
         m_CurrentCommandBuffer = nullptr;
 
+        m_TransientDescriptors.submitPools(submissionID);
+        for (const auto& submission : m_SecondaryTransientSubmissions)
+            *submission = submissionID;
+        m_SecondaryTransientSubmissions.clear();
+
         m_StateTracker.commandListSubmitted();
     }
 
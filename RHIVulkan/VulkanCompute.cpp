@@ -22,27 +22,15 @@ namespace RHI::Vulkan
             descriptorSetLayouts.push_back(layout->descriptorSetLayout);
         }
 
-        std::vector<VkPushConstantRange> ranges;
-
         const PushConstantsDesc &constantsDesc = desc.pushConstants;
         const uint32_t totalSize = constantsDesc.vtxConstSize + constantsDesc.fragConstSize;
 
-        if (totalSize > 0) {
-            ranges.push_back({VK_SHADER_STAGE_COMPUTE_BIT, 0, totalSize});
-        }
-
         pso->pushConstantsVisibility = totalSize > 0 ? VK_SHADER_STAGE_COMPUTE_BIT : 0;
+        pso->pushConstantsSize = totalSize;
+        pso->descriptorSetLayouts = descriptorSetLayouts;
 
-        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
-        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutCreateInfo.pNext = nullptr;
-        pipelineLayoutCreateInfo.flags = 0;
-        pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-        pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
-        pipelineLayoutCreateInfo.pushConstantRangeCount = static_cast<uint32_t>(ranges.size());
-        pipelineLayoutCreateInfo.pPushConstantRanges = ranges.empty() ? nullptr : ranges.data();
-
-        vkCreatePipelineLayout(m_Context.device, &pipelineLayoutCreateInfo, nullptr, &pso->pipelineLayout);
+        pso->layout = getPipelineLayout(desc.bindingLayouts, pso->pushConstantsVisibility, totalSize);
+        pso->pipelineLayout = pso->layout->pipelineLayout;
 
         uint32_t numShaders = 0;
         countShaders(desc.CS.get(), numShaders);
@@ -55,7 +43,7 @@ namespace RHI::Vulkan
         VkComputePipelineCreateInfo computePipelineCreateInfo{};
         computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
         computePipelineCreateInfo.pNext = nullptr;
-        computePipelineCreateInfo.flags = 0;
+        computePipelineCreateInfo.flags = m_Context.ctxFeatures.descriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
         computePipelineCreateInfo.stage = shaderStage;
         computePipelineCreateInfo.layout = pso->pipelineLayout;
         computePipelineCreateInfo.basePipelineHandle = 0;
@@ -72,12 +60,6 @@ namespace RHI::Vulkan
             vkDestroyPipeline(m_Context.device, pipeline, nullptr);
             pipeline = nullptr;
         }
-
-        if (pipelineLayout)
-        {
-            vkDestroyPipelineLayout(m_Context.device, pipelineLayout, nullptr);
-            pipelineLayout = nullptr;
-        }
     }
 
     void CommandList::setComputeState(const ComputeState& state) {
@@ -105,10 +87,7 @@ namespace RHI::Vulkan
             m_CurrentCommandBuffer->referencedResources.push_back(state.pipeline);
         }
 
-        if (arraysAreDifferent(m_CurrentComputeState.bindings, state.bindings))
-        {
-            bindBindingSets(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipelineLayout, state.bindings);
-        }
+        bindBindingSets(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline, state.bindings, state.dynamicOffsets);
 
         m_CurrentPipelineLayout = pipeline->pipelineLayout;
         m_CurrentPushConstantsVisibility = pipeline->pushConstantsVisibility;
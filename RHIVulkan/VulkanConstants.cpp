@@ -176,6 +176,10 @@ namespace RHI::Vulkan
         {
             ret |= VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         }
+        if ((memoryProperties & MemoryPropertiesBits::LAZILY_ALLOCATED_BIT) != 0)
+        {
+            ret |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        }
 
         return ret;
     }
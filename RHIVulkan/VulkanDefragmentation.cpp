@@ -0,0 +1,239 @@
+#include <VulkanBackend.hpp>
+
+#include <algorithm>
+
+namespace RHI::Vulkan
+{
+    static void recordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+        VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+    {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    static void recordImageBarrier(VkCommandBuffer commandBuffer, VkImage image, const VkImageSubresourceRange& range,
+        VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+        VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages)
+    {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = range;
+
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    bool CommandList::relocateBuffer(Buffer* buffer)
+    {
+        // only buffers that can be moved get copy usage, see pickBufferUsage
+        const VkBufferUsageFlags copyUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if ((buffer->bufferInfo.usage & copyUsage) != copyUsage)
+            return false;
+
+        // the bindless descriptor is read by work in flight and can't be rewritten, the index has to stay valid
+        if (buffer->bindlessIndex != kInvalidBindlessIndex)
+            return false;
+
+        VkBuffer newBuffer = VK_NULL_HANDLE;
+        if (!checkSuccess(vkCreateBuffer(m_Context.device, &buffer->bufferInfo, nullptr, &newBuffer)))
+            return false;
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_Context.device, newBuffer, &memRequirements);
+
+        MemoryAllocation allocation = m_Context.memoryAllocator->allocateForRelocation(memRequirements, buffer->allocation);
+        if (!allocation.isValid())
+        {
+            vkDestroyBuffer(m_Context.device, newBuffer, nullptr);
+            return false;
+        }
+
+        checkSuccess(vkBindBufferMemory(m_Context.device, newBuffer, allocation.memory, allocation.offset));
+
+        VkBufferCopy region{};
+        region.size = buffer->bufferInfo.size;
+        vkCmdCopyBuffer(m_CurrentCommandBuffer->commandBuffer, buffer->buffer, newBuffer, 1, &region);
+
+        // the old buffer is still read by the copy and by work submitted earlier, it goes away with the command buffer
+        Buffer* retired = new Buffer(m_Context);
+        retired->buffer = buffer->buffer;
+        retired->allocation = m_Context.memoryAllocator->relocate(buffer, allocation);
+        m_CurrentCommandBuffer->referencedRelocatedResources.push_back(BufferHandle(retired));
+
+        buffer->buffer = newBuffer;
+        return true;
+    }
+
+    bool CommandList::relocateTexture(Texture* texture)
+    {
+        const VkImageUsageFlags copyUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                                  VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+        // framebuffers keep views of attachments, and without copy usage there is no way to move the contents
+        if ((texture->imageInfo.usage & copyUsage) != copyUsage || (texture->imageInfo.usage & attachmentUsage))
+            return false;
+
+        // same for the bindless descriptors of the texture
+        if (texture->bindlessSampledIndex != kInvalidBindlessIndex || texture->bindlessStorageIndex != kInvalidBindlessIndex)
+            return false;
+
+        // the layout the texture is in when this command list starts has to be known
+        const bool hasPermanentState = texture->permanentState != ResourceStates::Unknown;
+        if (!hasPermanentState && !(m_EnableAutoBarriers && texture->desc.keepInitialState && texture->stateInitialized))
+            return false;
+
+        VkImage newImage = VK_NULL_HANDLE;
+        if (!checkSuccess(vkCreateImage(m_Context.device, &texture->imageInfo, nullptr, &newImage)))
+            return false;
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_Context.device, newImage, &memRequirements);
+
+        MemoryAllocation allocation = m_Context.memoryAllocator->allocateForRelocation(memRequirements, texture->allocation);
+        if (!allocation.isValid())
+        {
+            vkDestroyImage(m_Context.device, newImage, nullptr);
+            return false;
+        }
+
+        checkSuccess(vkBindImageMemory(m_Context.device, newImage, allocation.memory, allocation.offset));
+
+        const TextureDesc& desc = texture->desc;
+        const VkImageAspectFlags aspect = pickImageAspect(desc.format);
+        const VkImageSubresourceRange range{ aspect, 0, desc.mipLevels, 0, desc.layerCount };
+        VkCommandBuffer commandBuffer = m_CurrentCommandBuffer->commandBuffer;
+
+        // the new image ends up in the layout the tracker expects for the texture after the copy
+        ResourceStateMapping finalState = convertResourceState(ResourceStates::CopySource);
+
+        if (hasPermanentState)
+        {
+            finalState = convertResourceState(texture->permanentState);
+
+            recordImageBarrier(commandBuffer, texture->image, range, finalState.layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                finalState.accessMask, VK_ACCESS_TRANSFER_READ_BIT, finalState.stages, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        }
+        else
+        {
+            m_StateTracker.requireTextureState(texture, TextureSubresource{ 0, desc.mipLevels, 0, desc.layerCount }, ResourceStates::CopySource);
+            commitBarriers();
+        }
+
+        recordImageBarrier(commandBuffer, newImage, range, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        std::vector<VkImageCopy> regions(desc.mipLevels);
+        for (uint32_t mipLevel = 0; mipLevel < desc.mipLevels; mipLevel++)
+        {
+            VkImageCopy& region = regions[mipLevel];
+            region.srcSubresource = VkImageSubresourceLayers{ aspect, mipLevel, 0, desc.layerCount };
+            region.dstSubresource = region.srcSubresource;
+            region.extent.width = std::max(desc.width >> mipLevel, 1u);
+            region.extent.height = std::max(desc.height >> mipLevel, 1u);
+            region.extent.depth = std::max(desc.depth >> mipLevel, 1u);
+        }
+
+        vkCmdCopyImage(commandBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+
+        recordImageBarrier(commandBuffer, newImage, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalState.layout,
+            VK_ACCESS_TRANSFER_WRITE_BIT, finalState.accessMask, VK_PIPELINE_STAGE_TRANSFER_BIT, finalState.stages);
+
+        // views of the old image are recreated on demand, the old ones stay valid for work already recorded
+        Texture* retired = new Texture(m_Context);
+        retired->image = texture->image;
+        retired->subresourceViews.swap(texture->subresourceViews);
+        retired->allocation = m_Context.memoryAllocator->relocate(texture, allocation);
+        m_CurrentCommandBuffer->referencedRelocatedResources.push_back(TextureHandle(retired));
+        m_CurrentCommandBuffer->referencedResources.push_back(texture);
+
+        texture->image = newImage;
+        return true;
+    }
+
+    /*
+        Moves resources out of the least used block of every memory pool, so the block is released
+        once the copies have executed. Host visible memory is never moved, the application holds pointers into it.
+        Binding sets that reference a moved resource get a new descriptor set, command buffers recorded earlier
+        keep using the old one together with the old resource until the copies have executed.
+    */
+    DefragmentationStats Device::defragmentMemory(IRHICommandList* commandList, uint64_t maxBytesToMove)
+    {
+        CommandList* cmd = dynamic_cast<CommandList*>(commandList);
+        DefragmentationStats stats;
+
+        // handles keep the candidates alive while they are moved, even if the application releases them meanwhile
+        const std::vector<std::shared_ptr<IResource>> candidates = m_MemoryAllocator->getRelocationCandidates(maxBytesToMove);
+        if (candidates.empty())
+            return stats;
+
+        cmd->endRenderPass();
+
+        TrackedCommandBufferPtr commandBuffer = cmd->getCurrentCommandBuffer();
+
+        // earlier work may still write the resources
+        recordMemoryBarrier(commandBuffer->commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+        std::unordered_set<IResource*> moved;
+
+        for (const std::shared_ptr<IResource>& resource : candidates)
+        {
+            if (Buffer* buffer = dynamic_cast<Buffer*>(resource.get()))
+            {
+                const uint64_t size = buffer->allocation.size;
+                if (!cmd->relocateBuffer(buffer))
+                    continue;
+
+                stats.bytesMoved += size;
+            }
+            else if (Texture* texture = dynamic_cast<Texture*>(resource.get()))
+            {
+                const uint64_t size = texture->allocation.size;
+                if (!cmd->relocateTexture(texture))
+                    continue;
+
+                stats.bytesMoved += size;
+            }
+            else
+            {
+                continue;
+            }
+
+            moved.insert(resource.get());
+            stats.resourcesMoved++;
+        }
+
+        if (moved.empty())
+            return stats;
+
+        recordMemoryBarrier(commandBuffer->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+
+        // state cached by the command list may still name the old handles
+        cmd->clearState();
+
+        // rewriting a set in place would change it under command buffers that are pending or already recorded,
+        // the old sets go away together with the old resources once the copies have executed
+        m_BindingSetRegistry.forEach([&](BindingSet* bindingSet) {
+            if (!bindingSet->referencesAny(moved))
+                return;
+
+            commandBuffer->referencedRelocatedResources.push_back(replaceDescriptorSet(bindingSet));
+            stats.bindingSetsUpdated++;
+        });
+
+        return stats;
+    }
+}
@@ -0,0 +1,259 @@
+#include <cassert>
+#include <VulkanBackend.hpp>
+
+namespace RHI::Vulkan
+{
+    DescriptorBufferHeap::DescriptorBufferHeap(Device* device, const VulkanContext& context, VkDeviceSize size)
+        : m_Device(device), m_Context(context), m_Allocator(size)
+    {
+        m_Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &m_Properties;
+        vkGetPhysicalDeviceProperties2(m_Context.physicalDevice, &properties);
+
+        // combined image samplers carry a sampler, so the one buffer is bound for both kinds of descriptors
+        m_Usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+                  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = m_Usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        checkSuccess(vkCreateBuffer(m_Context.device, &bufferInfo, nullptr, &m_Buffer));
+
+        m_Allocation = m_Context.memoryAllocator->allocateBufferMemory(m_Buffer,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!m_Allocation.isValid())
+        {
+            printf("Cannot allocate the descriptor buffer\n");
+            exit(EXIT_FAILURE);
+        }
+
+        checkSuccess(vkBindBufferMemory(m_Context.device, m_Buffer, m_Allocation.memory, m_Allocation.offset));
+        m_MappedPtr = static_cast<uint8_t*>(m_Context.memoryAllocator->getMappedPointer(m_Allocation));
+
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = m_Buffer;
+        m_Address = vkGetBufferDeviceAddress(m_Context.device, &addressInfo);
+    }
+
+    DescriptorBufferHeap::~DescriptorBufferHeap()
+    {
+        if (m_Buffer)
+        {
+            vkDestroyBuffer(m_Context.device, m_Buffer, nullptr);
+            m_Buffer = VK_NULL_HANDLE;
+        }
+
+        m_Context.memoryAllocator->free(m_Allocation);
+    }
+
+    void DescriptorBufferHeap::reclaimPendingRanges()
+    {
+        uint64_t finishedIDs[uint32_t(CommandQueue::Count)];
+        for (uint32_t queueID = 0; queueID < uint32_t(CommandQueue::Count); queueID++)
+        {
+            Queue* queue = m_Device->getQueue(CommandQueue(queueID));
+            finishedIDs[queueID] = queue ? queue->updateLastFinishedID() : ~0ull;
+        }
+
+        auto finished = [&finishedIDs](const PendingRange& pending) {
+            for (uint32_t queueID = 0; queueID < uint32_t(CommandQueue::Count); queueID++)
+            {
+                if (pending.submissionIDs[queueID] > finishedIDs[queueID])
+                    return false;
+            }
+            return true;
+        };
+
+        for (const PendingRange& pending : m_PendingRanges)
+        {
+            if (finished(pending))
+                m_Allocator.free(pending.range);
+        }
+
+        m_PendingRanges.erase(std::remove_if(m_PendingRanges.begin(), m_PendingRanges.end(), finished), m_PendingRanges.end());
+    }
+
+    TLSFAllocator::Allocation DescriptorBufferHeap::allocate(VkDeviceSize size)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        TLSFAllocator::Allocation range = m_Allocator.allocate(size, m_Properties.descriptorBufferOffsetAlignment);
+        if (!range.isValid() && !m_PendingRanges.empty())
+        {
+            reclaimPendingRanges();
+            range = m_Allocator.allocate(size, m_Properties.descriptorBufferOffsetAlignment);
+        }
+
+        if (!range.isValid())
+            printf("Descriptor buffer is out of space\n");
+
+        return range;
+    }
+
+    void DescriptorBufferHeap::free(const TLSFAllocator::Allocation& range)
+    {
+        if (!range.isValid())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        // work submitted so far may still read the descriptors
+        PendingRange pending;
+        pending.range = range;
+
+        for (uint32_t queueID = 0; queueID < uint32_t(CommandQueue::Count); queueID++)
+        {
+            Queue* queue = m_Device->getQueue(CommandQueue(queueID));
+            pending.submissionIDs[queueID] = queue ? queue->getLastSubmittedID() : 0;
+        }
+
+        m_PendingRanges.push_back(pending);
+    }
+
+    std::shared_ptr<DescriptorBufferLayout> DescriptorBufferHeap::createLayout(VkDescriptorSetLayout layout, uint32_t bindingCount) const
+    {
+        std::shared_ptr<DescriptorBufferLayout> bufferLayout = std::make_shared<DescriptorBufferLayout>();
+
+        VkDeviceSize size = 0;
+        vkGetDescriptorSetLayoutSizeEXT(m_Context.device, layout, &size);
+
+        const VkDeviceSize alignment = m_Properties.descriptorBufferOffsetAlignment;
+        bufferLayout->size = (size + alignment - 1) / alignment * alignment;
+
+        bufferLayout->bindingOffsets.resize(bindingCount);
+        for (uint32_t binding = 0; binding < bindingCount; binding++)
+            vkGetDescriptorSetLayoutBindingOffsetEXT(m_Context.device, layout, binding, &bufferLayout->bindingOffsets[binding]);
+
+        return bufferLayout;
+    }
+
+    size_t DescriptorBufferHeap::getDescriptorSize(VkDescriptorType type) const
+    {
+        switch (type)
+        {
+        case VK_DESCRIPTOR_TYPE_SAMPLER:                return m_Properties.samplerDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return m_Properties.combinedImageSamplerDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:          return m_Properties.sampledImageDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:          return m_Properties.storageImageDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:         return m_Properties.uniformBufferDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:         return m_Properties.storageBufferDescriptorSize;
+        default:
+            assert(!"Descriptor type is not supported in a descriptor buffer");
+            return 0;
+        }
+    }
+
+    void DescriptorBufferHeap::writeDescriptor(uint8_t* dst, VkDescriptorType type, const VkDescriptorDataEXT& data)
+    {
+        VkDescriptorGetInfoEXT getInfo{};
+        getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+        getInfo.type = type;
+        getInfo.data = data;
+
+        vkGetDescriptorEXT(m_Context.device, &getInfo, getDescriptorSize(type), dst);
+    }
+
+    void DescriptorBufferHeap::writeDescriptors(VkDeviceSize offset, const DescriptorBufferLayout& layout, const DescriptorSetInfo& dsInfo)
+    {
+        uint8_t* set = m_MappedPtr + offset;
+        uint32_t bindingIdx = 0;
+
+        auto writeBuffer = [this](uint8_t* dst, VkDescriptorType type, IBuffer* buffer, VkDeviceSize bufferOffset, VkDeviceSize size) {
+            Buffer* buf = static_cast<Buffer*>(buffer);
+
+            VkBufferDeviceAddressInfo bufferAddressInfo{};
+            bufferAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+            bufferAddressInfo.buffer = buf->buffer;
+
+            // the address is taken at write time, the defragmenter rewrites the sets of a buffer it moved
+            VkDescriptorAddressInfoEXT addressInfo{};
+            addressInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+            addressInfo.address = vkGetBufferDeviceAddress(m_Context.device, &bufferAddressInfo) + bufferOffset;
+            addressInfo.range = (size > 0) ? size : buf->desc.size - bufferOffset;
+            addressInfo.format = VK_FORMAT_UNDEFINED;
+
+            VkDescriptorDataEXT data{};
+            if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+                data.pUniformBuffer = &addressInfo;
+            else
+                data.pStorageBuffer = &addressInfo;
+
+            writeDescriptor(dst, type, data);
+        };
+
+        auto writeImage = [this](uint8_t* dst, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo) {
+            VkDescriptorDataEXT data{};
+            switch (type)
+            {
+            case VK_DESCRIPTOR_TYPE_SAMPLER:       data.pSampler = &imageInfo.sampler; break;
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: data.pSampledImage = &imageInfo; break;
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: data.pStorageImage = &imageInfo; break;
+            default:                               data.pCombinedImageSampler = &imageInfo; break;
+            }
+
+            writeDescriptor(dst, type, data);
+        };
+
+        for (const BufferAttachment& b : dsInfo.buffers)
+        {
+            writeBuffer(set + layout.bindingOffsets[bindingIdx++], convertDescriptorType(b.dInfo.type), b.buffer, b.offset, b.size);
+        }
+
+        // a descriptor buffer holds the sampler of a combined image sampler, an immutable one is written in place of the set's
+        auto imageDescriptor = [&layout](uint32_t binding, ITexture* texture, ISampler* sampler, DescriptorType type,
+                                         const TextureSubresource& subresource) {
+            VkDescriptorImageInfo imageInfo = getImageDescriptor(texture, sampler, type, subresource);
+            if (layout.immutableSamplers[binding] != VK_NULL_HANDLE)
+                imageInfo.sampler = layout.immutableSamplers[binding];
+            return imageInfo;
+        };
+
+        for (const TextureAttachment& t : dsInfo.textures)
+        {
+            const uint32_t binding = bindingIdx++;
+            writeImage(set + layout.bindingOffsets[binding], convertDescriptorType(t.dInfo.type),
+                imageDescriptor(binding, t.texture, t.sampler, t.dInfo.type, t.dInfo.subresource));
+        }
+
+        for (const TextureArrayAttachment& ta : dsInfo.textureArrays)
+        {
+            const uint32_t binding = bindingIdx++;
+            uint8_t* dst = set + layout.bindingOffsets[binding];
+            for (ITexture* texture : ta.textures)
+            {
+                writeImage(dst, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                    imageDescriptor(binding, texture, ta.sampler, DescriptorType::COMBINED_IMAGE_SAMPLER, ta.subresource));
+                dst += m_Properties.combinedImageSamplerDescriptorSize;
+            }
+        }
+
+        for (const BufferArrayAttachment& ba : dsInfo.bufferArrays)
+        {
+            const VkDescriptorType type = convertDescriptorType(ba.dInfo.type);
+            uint8_t* dst = set + layout.bindingOffsets[bindingIdx++];
+            for (IBuffer* buffer : ba.buffers)
+            {
+                writeBuffer(dst, type, buffer, 0, 0);
+                dst += getDescriptorSize(type);
+            }
+        }
+
+        m_Context.memoryAllocator->flush(m_Allocation, offset, layout.size);
+    }
+
+    VkDescriptorBufferBindingInfoEXT DescriptorBufferHeap::getBindingInfo() const
+    {
+        VkDescriptorBufferBindingInfoEXT bindingInfo{};
+        bindingInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+        bindingInfo.address = m_Address;
+        bindingInfo.usage = m_Usage;
+        return bindingInfo;
+    }
+}
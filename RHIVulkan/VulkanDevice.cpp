@@ -8,6 +8,22 @@ namespace RHI::Vulkan
 		, m_DeviceDesc(desc)
 		, m_Resources(this)
     {
+        m_MemoryAllocator = std::make_unique<MemoryAllocator>(m_Context);
+        m_Context.memoryAllocator = m_MemoryAllocator.get();
+
+        m_StagingBufferPool = std::make_unique<StagingBufferPool>(this);
+        m_Context.stagingBufferPool = m_StagingBufferPool.get();
+        m_Context.bindingSetRegistry = &m_BindingSetRegistry;
+        m_Context.bindingSetCache = &m_BindingSetCache;
+        m_Context.layoutCache = &m_LayoutCache;
+        m_Context.samplerCache = &m_SamplerCache;
+
+        m_DescriptorAllocator = std::make_unique<DescriptorAllocator>(m_Context);
+        m_Context.descriptorAllocator = m_DescriptorAllocator.get();
+
+        m_SparseTilePool = std::make_unique<SparseTilePool>(m_Context);
+        m_Context.sparseTilePool = m_SparseTilePool.get();
+
         if (desc.useGraphicsQueue)
         {
             m_Queues[uint32_t(CommandQueue::Graphics)] = std::make_unique<Queue>(m_Context,
@@ -44,6 +60,18 @@ namespace RHI::Vulkan
         m_Context.ctxExtensions = *desc.ctxExtensions;
         m_Context.ctxFeatures = *desc.ctxFeatures;
 
+        if (m_Context.ctxFeatures.bindlessDescriptors)
+        {
+            m_BindlessHeap = std::make_unique<BindlessHeap>(this, m_Context, desc.bindlessHeapDesc);
+            m_Context.bindlessHeap = m_BindlessHeap.get();
+        }
+
+        if (m_Context.ctxFeatures.descriptorBuffer)
+        {
+            m_DescriptorBufferHeap = std::make_unique<DescriptorBufferHeap>(this, m_Context, desc.descriptorBufferSize);
+            m_Context.descriptorBufferHeap = m_DescriptorBufferHeap.get();
+        }
+
         VkPipelineCacheCreateInfo pipelineCacheInfo{};
         pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
         VkResult result = vkCreatePipelineCache(m_Context.device, &pipelineCacheInfo, nullptr, &m_Context.pipelineCache);
@@ -82,6 +110,13 @@ namespace RHI::Vulkan
 
     Device::~Device()
     {
+        // released objects may call back into the other queues and the heaps, so drain them all while they exist
+        vkDeviceWaitIdle(m_Context.device);
+        for (auto &queue : m_Queues) {
+            if (queue)
+                queue->releaseDeferred();
+        }
+
         if (m_Context.pipelineCache)
         {
             vkDestroyPipelineCache(m_Context.device, m_Context.pipelineCache, nullptr);
@@ -1,3 +1,5 @@
+#include <bit>
+#include <cassert>
 #include <VulkanBackend.hpp>
 
 #include <Common/Miscellaneous.hpp>
@@ -247,10 +249,14 @@ namespace RHI::Vulkan
             BindingLayout *bindingLayout = dynamic_cast<BindingLayout *>(bindingLayoutHandle.get());
             descriptorSetLayouts.push_back(bindingLayout->descriptorSetLayout);
         }
-        createPipelineLayout(descriptorSetLayouts, desc.pushConstants, &pso->pipelineLayout, pso->pushConstantsVisibility);
+        pso->descriptorSetLayouts = descriptorSetLayouts;
+        pso->pushConstantsSize = desc.pushConstants.vtxConstSize + desc.pushConstants.fragConstSize;
+        pso->layout = getPipelineLayout(desc.bindingLayouts, pso->pushConstantsVisibility, pso->pushConstantsSize);
+        pso->pipelineLayout = pso->layout->pipelineLayout;
 
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.flags = m_Context.ctxFeatures.descriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
         pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
         pipelineInfo.pStages = shaderStages.data();
         pipelineInfo.pVertexInputState = &vertexInputInfo;
@@ -317,28 +323,52 @@ namespace RHI::Vulkan
     }
 
 
-    bool Device::createPipelineLayout(
-        std::vector<VkDescriptorSetLayout> &dsLayouts, const PushConstantsDesc &constantsDesc, VkPipelineLayout *pipelineLayout,
-        VkShaderStageFlags pushConstantStages
+    std::shared_ptr<PipelineLayout> Device::getPipelineLayout(
+        const std::vector<BindingLayoutHandle> &bindingLayouts, VkShaderStageFlags pushConstantsVisibility, uint32_t pushConstantsSize
     ) {
-        std::vector<VkPushConstantRange> ranges;
-
-        const uint32_t totalSize = constantsDesc.vtxConstSize + constantsDesc.fragConstSize;
+        LayoutCache::PipelineLayoutKey key;
+        key.setLayouts.reserve(bindingLayouts.size());
+        for (const BindingLayoutHandle &bindingLayoutHandle : bindingLayouts) {
+            BindingLayout *bindingLayout = dynamic_cast<BindingLayout *>(bindingLayoutHandle.get());
+            key.setLayouts.push_back(bindingLayout->descriptorSetLayout);
+        }
+        if (pushConstantsSize > 0) {
+            key.pushConstantRanges.push_back({ pushConstantsVisibility, 0, pushConstantsSize });
+        }
 
-        if (totalSize > 0) {
-            ranges.push_back({ pushConstantStages, 0, totalSize });
+        const size_t hash = LayoutCache::hash(key);
+        if (std::shared_ptr<PipelineLayout> cached = m_LayoutCache.find(key, hash)) {
+            return cached;
         }
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.pNext = nullptr;
         pipelineLayoutInfo.flags = 0;
-        pipelineLayoutInfo.setLayoutCount = dsLayouts.size();
-        pipelineLayoutInfo.pSetLayouts = dsLayouts.data();
-        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(ranges.size());
-        pipelineLayoutInfo.pPushConstantRanges = ranges.empty() ? nullptr : ranges.data();
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(key.setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = key.setLayouts.empty() ? nullptr : key.setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(key.pushConstantRanges.size());
+        pipelineLayoutInfo.pPushConstantRanges = key.pushConstantRanges.empty() ? nullptr : key.pushConstantRanges.data();
+
+        std::shared_ptr<PipelineLayout> layout = std::make_shared<PipelineLayout>(m_Context);
+        layout->bindingLayouts = bindingLayouts;
+        layout->pushConstantRanges = key.pushConstantRanges;
+        checkSuccess(vkCreatePipelineLayout(m_Context.device, &pipelineLayoutInfo, nullptr, &layout->pipelineLayout));
+
+        // another thread may have interned an equal layout since the lookup above
+        return m_LayoutCache.add(std::move(key), hash, layout);
+    }
 
-        return (vkCreatePipelineLayout(m_Context.device, &pipelineLayoutInfo, nullptr, pipelineLayout) == VK_SUCCESS);
+    PipelineLayout::~PipelineLayout()
+    {
+        if (isCached && m_Context.layoutCache) {
+            m_Context.layoutCache->remove(this);
+        }
+
+        if (pipelineLayout) {
+            vkDestroyPipelineLayout(m_Context.device, pipelineLayout, nullptr);
+            pipelineLayout = VkPipelineLayout();
+        }
     }
 
     GraphicsPipeline::~GraphicsPipeline()
@@ -347,14 +377,9 @@ namespace RHI::Vulkan
             vkDestroyPipeline(m_Context.device, pipeline, nullptr);
             pipeline = nullptr;
         }
-
-        if (pipelineLayout) {
-            vkDestroyPipelineLayout(m_Context.device, pipelineLayout, nullptr);
-            pipelineLayout = nullptr;
-        }
     }
 
-    void CommandList::beginRenderPass(Framebuffer* framebuffer)
+    void CommandList::beginRenderPass(Framebuffer* framebuffer, VkSubpassContents contents)
     {
         VkRect2D rect = {};
         rect.offset = VkOffset2D(0, 0);
@@ -374,14 +399,16 @@ namespace RHI::Vulkan
         //renderPassInfo.clearValueCount = clearValueCount;
         //renderPassInfo.pClearValues = clearValues;
 
-        vkCmdBeginRenderPass(m_CurrentCommandBuffer->commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(m_CurrentCommandBuffer->commandBuffer, &renderPassInfo, contents);
     }
 
     void CommandList::endRenderPass()
     {
         if(m_CurrentGraphicsState.framebuffer)
         {
-            vkCmdEndRenderPass(m_CurrentCommandBuffer->commandBuffer);
+            // the render pass of a secondary list belongs to its parent
+            if (!m_CommandListParameters.isSecondary)
+                vkCmdEndRenderPass(m_CurrentCommandBuffer->commandBuffer);
             m_CurrentGraphicsState.framebuffer = nullptr;
         }
     }
@@ -391,34 +418,53 @@ namespace RHI::Vulkan
         GraphicsPipeline* pipeline = dynamic_cast<GraphicsPipeline*>(state.pipeline);
         Framebuffer* fb = dynamic_cast<Framebuffer*>(state.framebuffer);
 
-        if (m_EnableAutoBarriers) {
-            trackResourcesAndBarriers(state);
-        }
-
-        if(state.framebuffer != m_CurrentGraphicsState.framebuffer)
+        if (m_CommandListParameters.isSecondary)
         {
-            endRenderPass();
+            // no barriers inside a render pass, the parent issues them before executing this list
+            assert(state.framebuffer == m_CurrentGraphicsState.framebuffer);
+
+            if (m_EnableAutoBarriers && graphicsBindingSetsChanged(state.bindingSets))
+                m_SecondaryBindingSets.insert(m_SecondaryBindingSets.end(), state.bindingSets.begin(), state.bindingSets.end());
         }
+        else
+        {
+            if (m_EnableAutoBarriers) {
+                trackResourcesAndBarriers(state);
+            }
 
-        commitBarriers();
+            if(state.framebuffer != m_CurrentGraphicsState.framebuffer)
+            {
+                endRenderPass();
+            }
 
-        if (!m_CurrentGraphicsState.framebuffer)
-        {
-            beginRenderPass(fb);
+            commitBarriers();
+
+            if (!m_CurrentGraphicsState.framebuffer)
+            {
+                beginRenderPass(fb);
+            }
         }
 
+        m_Statistics.setGraphicsStateCalls++;
+
         bool updatePipeline = false;
         if (m_CurrentGraphicsState.pipeline != state.pipeline) {
             updatePipeline = true;
             vkCmdBindPipeline(
                 m_CurrentCommandBuffer->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline
             );
+            m_Statistics.pipelineBinds++;
+        } else {
+            m_Statistics.pipelineBindsSkipped++;
         }
 
         if (m_CurrentGraphicsState.viewport.viewport != state.viewport.viewport) {
             const Viewport &vp = state.viewport.viewport;
             const VkViewport viewport = VkViewport{vp.minX, vp.minY, vp.getWidth(), vp.getHeight(), vp.minZ, vp.maxZ};
             vkCmdSetViewport(m_CurrentCommandBuffer->commandBuffer, 0, 1, &viewport);
+            m_Statistics.dynamicStateUpdates++;
+        } else {
+            m_Statistics.dynamicStateUpdatesSkipped++;
         }
 
         if (m_CurrentGraphicsState.viewport.scissorRect != state.viewport.scissorRect) {
@@ -426,58 +472,87 @@ namespace RHI::Vulkan
             const VkRect2D scissor = VkRect2D{VkOffset2D{sc.minX, sc.minY}, VkExtent2D{static_cast<uint32_t>(std::abs(sc.getWidth())),
                                                                   static_cast<uint32_t>(std::abs(sc.getHeight()))}};
             vkCmdSetScissor(m_CurrentCommandBuffer->commandBuffer, 0, 1, &scissor);
+            m_Statistics.dynamicStateUpdates++;
+        } else {
+            m_Statistics.dynamicStateUpdatesSkipped++;
         }
 
-        if (pipeline->desc.renderState.depthStencilState.dynamicStencilReferenceEnable &&
-            (updatePipeline || m_CurrentGraphicsState.dynamicStencilReference != state.dynamicStencilReference)) {
-            vkCmdSetStencilReference(m_CurrentCommandBuffer->commandBuffer, VK_STENCIL_FRONT_AND_BACK, state.dynamicStencilReference);
+        if (pipeline->desc.renderState.depthStencilState.dynamicStencilReferenceEnable) {
+            if (updatePipeline || m_CurrentGraphicsState.dynamicStencilReference != state.dynamicStencilReference) {
+                vkCmdSetStencilReference(m_CurrentCommandBuffer->commandBuffer, VK_STENCIL_FRONT_AND_BACK, state.dynamicStencilReference);
+                m_Statistics.dynamicStateUpdates++;
+            } else {
+                m_Statistics.dynamicStateUpdatesSkipped++;
+            }
         }
 
-        if (pipeline->usesBlendConstants && (updatePipeline || m_CurrentGraphicsState.blendColorFactor != state.blendColorFactor)) {
-            vkCmdSetBlendConstants(m_CurrentCommandBuffer->commandBuffer, &state.blendColorFactor.r);
+        if (pipeline->usesBlendConstants) {
+            if (updatePipeline || m_CurrentGraphicsState.blendColorFactor != state.blendColorFactor) {
+                vkCmdSetBlendConstants(m_CurrentCommandBuffer->commandBuffer, &state.blendColorFactor.r);
+                m_Statistics.dynamicStateUpdates++;
+            } else {
+                m_Statistics.dynamicStateUpdatesSkipped++;
+            }
         }
 
-        if (state.indexBufferBinding.buffer &&
-            m_CurrentGraphicsState.indexBufferBinding.buffer != state.indexBufferBinding.buffer) {
-            Buffer *indexBuf = dynamic_cast<Buffer *>(state.indexBufferBinding.buffer);
-            vkCmdBindIndexBuffer(
-                m_CurrentCommandBuffer->commandBuffer,
-                indexBuf->buffer,
-                state.indexBufferBinding.offset,
-                state.indexBufferBinding.index32BitType ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16
-            );
+        // buffer bindings are not disturbed by compute work, so they are shadowed apart from m_CurrentGraphicsState
+        if (state.indexBufferBinding.buffer) {
+            if (m_BoundIndexBuffer != state.indexBufferBinding) {
+                Buffer *indexBuf = dynamic_cast<Buffer *>(state.indexBufferBinding.buffer);
+                vkCmdBindIndexBuffer(
+                    m_CurrentCommandBuffer->commandBuffer,
+                    indexBuf->buffer,
+                    state.indexBufferBinding.offset,
+                    state.indexBufferBinding.index32BitType ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16
+                );
+                m_BoundIndexBuffer = state.indexBufferBinding;
+                m_Statistics.indexBufferBinds++;
+            } else {
+                m_Statistics.indexBufferBindsSkipped++;
+            }
         }
 
-        if (!state.vertexBufferBindings.empty() && arraysAreDifferent(state.vertexBufferBindings, m_CurrentGraphicsState.vertexBufferBindings)) {
-            VkBuffer vertexBuffers[kMaxVertexAttributes] = {};
-            VkDeviceSize vertexBuffersOffsets[kMaxVertexAttributes] = {};
-            uint32_t maxVertexBufferIndex = 0;
-            uint32_t bindingIndex = 0u;
-            for (auto &vertexBinding : state.vertexBufferBindings) {
-                if (Buffer *vertexBuffer = dynamic_cast<Buffer *>(vertexBinding.buffer)) {
-                    vertexBuffers[bindingIndex] = vertexBuffer->buffer;
-                    vertexBuffersOffsets[bindingIndex] = vertexBinding.offset;
-                    maxVertexBufferIndex = std::max(vertexBinding.bindingSlot, maxVertexBufferIndex);
-                    bindingIndex++;
-                }
+        VkBuffer vertexBuffers[kMaxVertexAttributes] = {};
+        VkDeviceSize vertexBufferOffsets[kMaxVertexAttributes] = {};
+        uint32_t changedVertexSlots = 0;
+
+        for (const VertexBufferBinding &vertexBinding : state.vertexBufferBindings) {
+            Buffer *vertexBuffer = dynamic_cast<Buffer *>(vertexBinding.buffer);
+            if (!vertexBuffer || vertexBinding.bindingSlot >= kMaxVertexAttributes)
+                continue;
+
+            if (m_BoundVertexBuffers[vertexBinding.bindingSlot] == vertexBinding) {
+                m_Statistics.vertexBufferBindsSkipped++;
+                continue;
             }
 
-            vkCmdBindVertexBuffers(
-                m_CurrentCommandBuffer->commandBuffer,
-                0,
-                maxVertexBufferIndex + 1,
-                vertexBuffers,
-                vertexBuffersOffsets
-            );
+            vertexBuffers[vertexBinding.bindingSlot] = vertexBuffer->buffer;
+            vertexBufferOffsets[vertexBinding.bindingSlot] = vertexBinding.offset;
+            changedVertexSlots |= 1u << vertexBinding.bindingSlot;
+            m_BoundVertexBuffers[vertexBinding.bindingSlot] = vertexBinding;
+            m_Statistics.vertexBufferBinds++;
+        }
+
+        // one bind per contiguous range of changed slots
+        while (changedVertexSlots) {
+            const uint32_t first = uint32_t(std::countr_zero(changedVertexSlots));
+            const uint32_t count = uint32_t(std::countr_one(changedVertexSlots >> first));
+            vkCmdBindVertexBuffers(m_CurrentCommandBuffer->commandBuffer, first, count, vertexBuffers + first, vertexBufferOffsets + first);
+            changedVertexSlots &= ~(((1u << count) - 1) << first);
         }
 
         GraphicsPipeline* pso = dynamic_cast<GraphicsPipeline*>(state.pipeline);
         m_CurrentPipelineLayout = pso->pipelineLayout;
         m_CurrentPushConstantsVisibility = pso->pushConstantsVisibility;
 
-        bindBindingSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pso->pipelineLayout, state.bindingSets);
+        bindBindingSets(VK_PIPELINE_BIND_POINT_GRAPHICS, pso, state.bindingSets, state.dynamicOffsets);
 
-        m_CurrentGraphicsState = state;
+        m_CurrentGraphicsState.pipeline = state.pipeline;
+        m_CurrentGraphicsState.framebuffer = state.framebuffer;
+        m_CurrentGraphicsState.indirectParams = state.indirectParams;
+        m_CurrentGraphicsState.viewport = state.viewport;
+        m_CurrentGraphicsState.blendColorFactor = state.blendColorFactor;
+        m_CurrentGraphicsState.dynamicStencilReference = state.dynamicStencilReference;
         m_CurrentComputeState = {};
     }
 }
@@ -0,0 +1,813 @@
+#include <VulkanBackend.hpp>
+
+#include <algorithm>
+
+namespace RHI::Vulkan
+{
+    static constexpr VkDeviceSize kDefaultBlockSize = 256ull * 1024 * 1024;
+    static constexpr VkDeviceSize kSmallHeapMaxSize = 1024ull * 1024 * 1024;
+
+    // share of a heap considered usable when the driver does not report a budget
+    static constexpr VkDeviceSize kFallbackBudgetPercent = 80;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return ((value + alignment - 1) / alignment) * alignment;
+    }
+
+    MemoryAllocator::MemoryAllocator(const VulkanContext& context)
+        : m_Context(context)
+    {
+        vkGetPhysicalDeviceMemoryProperties(m_Context.physicalDevice, &m_MemoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_Context.physicalDevice, &properties);
+
+        m_BufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+        m_NonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+    }
+
+    MemoryAllocator::~MemoryAllocator()
+    {
+        for (auto& pools : m_Blocks)
+        {
+            for (auto& blocks : pools)
+            {
+                for (auto& block : blocks)
+                {
+                    destroyBlock(block.get());
+                }
+            }
+        }
+
+        for (auto& block : m_DedicatedBlocks)
+        {
+            destroyBlock(block.get());
+        }
+    }
+
+    uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+    {
+        for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+        {
+            if ((typeFilter & (1 << i)) && (m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                return i;
+            }
+        }
+
+        return 0xFFFFFFFF;
+    }
+
+    VkDeviceSize MemoryAllocator::getPreferredBlockSize(uint32_t memoryTypeIndex) const
+    {
+        const uint32_t heapIndex = m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        const VkDeviceSize heapSize = m_MemoryProperties.memoryHeaps[heapIndex].size;
+
+        // small heaps (BAR memory, some integrated GPUs) would be exhausted by a handful of default sized blocks
+        return heapSize <= kSmallHeapMaxSize ? alignUp(heapSize / 8, 32) : kDefaultBlockSize;
+    }
+
+    MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, const void* pNext)
+    {
+        // in descriptor buffer mode descriptors refer to buffers by device address
+        VkMemoryAllocateFlagsInfo flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+        flagsInfo.pNext = pNext;
+        flagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = m_Context.ctxFeatures.descriptorBuffer ? &flagsInfo : pNext;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (vkAllocateMemory(m_Context.device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+        {
+            return nullptr;
+        }
+
+        MemoryBlock* block = new MemoryBlock(size);
+        block->memory = memory;
+        block->memoryTypeIndex = memoryTypeIndex;
+
+        m_HeapAllocatedBytes[m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex] += size;
+        m_AllocationsSinceBudgetRefresh++;
+
+        const VkMemoryPropertyFlags typeFlags = m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+        block->coherent = (typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+        if (typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            if (!checkSuccess(vkMapMemory(m_Context.device, memory, 0, VK_WHOLE_SIZE, 0, &block->mappedPtr)))
+            {
+                vkFreeMemory(m_Context.device, memory, nullptr);
+                delete block;
+                return nullptr;
+            }
+        }
+
+        return block;
+    }
+
+    void MemoryAllocator::destroyBlock(MemoryBlock* block)
+    {
+        if (block->mappedPtr)
+        {
+            vkUnmapMemory(m_Context.device, block->memory);
+            block->mappedPtr = nullptr;
+        }
+
+        vkFreeMemory(m_Context.device, block->memory, nullptr);
+        block->memory = VK_NULL_HANDLE;
+
+        m_HeapAllocatedBytes[m_MemoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex] -= block->size;
+    }
+
+    MemoryAllocation MemoryAllocator::allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 memRequirements{};
+        memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        memRequirements.pNext = &dedicatedRequirements;
+
+        VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.buffer = buffer;
+
+        vkGetBufferMemoryRequirements2(m_Context.device, &requirementsInfo, &memRequirements);
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.buffer = buffer;
+
+        const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+
+        return allocate(memRequirements.memoryRequirements, properties, 0, dedicated, dedicatedInfo);
+    }
+
+    MemoryAllocation MemoryAllocator::allocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, bool linearTiling)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 memRequirements{};
+        memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        memRequirements.pNext = &dedicatedRequirements;
+
+        VkImageMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.image = image;
+
+        vkGetImageMemoryRequirements2(m_Context.device, &requirementsInfo, &memRequirements);
+
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.image = image;
+
+        const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+
+        return allocate(memRequirements.memoryRequirements, properties, linearTiling ? 0 : 1, dedicated, dedicatedInfo);
+    }
+
+    std::vector<MemoryHeapBudget> MemoryAllocator::getHeapBudgets() const
+    {
+        std::vector<MemoryHeapBudget> budgets(m_MemoryProperties.memoryHeapCount);
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        if (m_Context.ctxExtensions.EXT_memory_budget)
+        {
+            VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+            memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            memoryProperties.pNext = &budgetProperties;
+
+            vkGetPhysicalDeviceMemoryProperties2(m_Context.physicalDevice, &memoryProperties);
+        }
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        for (uint32_t i = 0; i < m_MemoryProperties.memoryHeapCount; i++)
+        {
+            const VkMemoryHeap& heap = m_MemoryProperties.memoryHeaps[i];
+
+            budgets[i].size = heap.size;
+            budgets[i].isDeviceLocal = (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+            if (m_Context.ctxExtensions.EXT_memory_budget)
+            {
+                budgets[i].budget = budgetProperties.heapBudget[i];
+                budgets[i].usage = budgetProperties.heapUsage[i];
+            }
+            else
+            {
+                budgets[i].budget = heap.size / 100 * kFallbackBudgetPercent;
+                budgets[i].usage = m_HeapAllocatedBytes[i];
+            }
+
+            m_AllocatedBytesAtBudgetRefresh[i] = m_HeapAllocatedBytes[i];
+        }
+
+        m_CachedBudgets = budgets;
+        m_AllocationsSinceBudgetRefresh = 0;
+
+        return budgets;
+    }
+
+    void MemoryAllocator::setEvictionCallback(MemoryEvictionCallback callback)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        m_EvictionCallback = std::move(callback);
+    }
+
+    bool MemoryAllocator::isOverBudget(uint32_t heapIndex, VkDeviceSize size) const
+    {
+        bool refresh;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            refresh = m_CachedBudgets.empty() || m_AllocationsSinceBudgetRefresh >= kBudgetRefreshInterval;
+        }
+
+        if (refresh)
+            getHeapBudgets();
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        // the driver usage of the last query, moved by the memory allocated and freed by this allocator since
+        const MemoryHeapBudget& budget = m_CachedBudgets[heapIndex];
+        const VkDeviceSize allocatedBytes = budget.usage + m_HeapAllocatedBytes[heapIndex];
+        const VkDeviceSize usage = allocatedBytes > m_AllocatedBytesAtBudgetRefresh[heapIndex]
+            ? allocatedBytes - m_AllocatedBytesAtBudgetRefresh[heapIndex] : 0;
+
+        return usage + size > budget.budget;
+    }
+
+    bool MemoryAllocator::canSuballocate(uint32_t memoryTypeIndex, uint32_t pool, VkDeviceSize size, VkDeviceSize alignment) const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        for (const auto& block : m_Blocks[memoryTypeIndex][pool])
+        {
+            if (block->allocator.getLargestFreeRegion() >= size + alignment - 1)
+                return true;
+        }
+
+        return false;
+    }
+
+    MemoryAllocation MemoryAllocator::allocateHeapMemory(VkDeviceSize size, VkMemoryPropertyFlags properties, uint32_t memoryTypeBits)
+    {
+        VkMemoryRequirements requirements{};
+        requirements.size = size;
+        requirements.alignment = 1;
+        requirements.memoryTypeBits = memoryTypeBits;
+
+        // no resource to dedicate the memory to, both handles stay null
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+
+        return allocate(requirements, properties, 0, true, dedicatedInfo, true);
+    }
+
+    VkDeviceSize MemoryAllocator::getPaddedSize(uint32_t memoryTypeIndex, VkDeviceSize size) const
+    {
+        // keep flushes and invalidations of one resource from touching its neighbours
+        const VkMemoryPropertyFlags typeFlags = m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+        if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+        {
+            return alignUp(size, m_NonCoherentAtomSize);
+        }
+
+        return size;
+    }
+
+    bool MemoryAllocator::needsDedicatedBlock(uint32_t memoryTypeIndex, VkDeviceSize paddedSize) const
+    {
+        if (paddedSize > getPreferredBlockSize(memoryTypeIndex) / 2)
+        {
+            return true;
+        }
+
+        // lazily allocated memory is committed per allocation, sharing a block would defeat it
+        return (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+    }
+
+    VkDeviceSize MemoryAllocator::getDeviceAllocationSize(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated) const
+    {
+        const VkDeviceSize paddedSize = getPaddedSize(memoryTypeIndex, size);
+
+        return dedicated || needsDedicatedBlock(memoryTypeIndex, paddedSize) ? paddedSize : getPreferredBlockSize(memoryTypeIndex);
+    }
+
+    uint32_t MemoryAllocator::selectMemoryType(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, uint32_t pool, bool dedicated)
+    {
+        uint32_t preferredType = findMemoryType(requirements.memoryTypeBits, properties);
+
+        // lazily allocated memory is only a preference, most desktop GPUs do not expose it
+        if (preferredType == 0xFFFFFFFF && (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+        {
+            properties &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+            preferredType = findMemoryType(requirements.memoryTypeBits, properties);
+        }
+
+        if (preferredType == 0xFFFFFFFF)
+            return preferredType;
+
+        // the budget only matters when new device memory has to be requested from the driver
+        if (!dedicated && !needsDedicatedBlock(preferredType, getPaddedSize(preferredType, requirements.size)) &&
+            canSuballocate(preferredType, pool, requirements.size, requirements.alignment))
+            return preferredType;
+
+        // a small resource can still cost a whole block, that is what the driver is asked for
+        const VkDeviceSize preferredSize = getDeviceAllocationSize(preferredType, requirements.size, dedicated);
+        const uint32_t preferredHeap = m_MemoryProperties.memoryTypes[preferredType].heapIndex;
+        if (!isOverBudget(preferredHeap, preferredSize))
+            return preferredType;
+
+        MemoryEvictionCallback evictionCallback;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            evictionCallback = m_EvictionCallback;
+        }
+
+        // the callback is called without holding the lock, it is expected to release resources
+        if (evictionCallback && evictionCallback(preferredHeap, preferredSize) && !isOverBudget(preferredHeap, preferredSize))
+            return preferredType;
+
+        // another type with the same properties on a heap with room left, then the same without DEVICE_LOCAL,
+        // which moves the resource to system memory instead of failing or thrashing the device heap
+        const VkMemoryPropertyFlags fallbackProperties[] = { properties, properties & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT };
+
+        for (VkMemoryPropertyFlags fallback : fallbackProperties)
+        {
+            for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+            {
+                if (!(requirements.memoryTypeBits & (1 << i)) || (m_MemoryProperties.memoryTypes[i].propertyFlags & fallback) != fallback)
+                    continue;
+
+                if (!isOverBudget(m_MemoryProperties.memoryTypes[i].heapIndex, getDeviceAllocationSize(i, requirements.size, dedicated)))
+                    return i;
+            }
+        }
+
+        // nothing within budget, leave it to the driver
+        return preferredType;
+    }
+
+    MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+        uint32_t pool, bool dedicated, const VkMemoryDedicatedAllocateInfo& dedicatedInfo, bool mayFail)
+    {
+        // with a coarse bufferImageGranularity linear and optimal resources must not share a page,
+        // keeping them in separate blocks avoids padding every allocation to the granularity
+        if (m_BufferImageGranularity <= 1)
+        {
+            pool = 0;
+        }
+
+        const uint32_t memoryTypeIndex = selectMemoryType(requirements, properties, pool, dedicated);
+        if (memoryTypeIndex == 0xFFFFFFFF)
+        {
+            if (mayFail)
+                return MemoryAllocation();
+
+            printf("Failed to find a suitable memory type\n");
+            exit(EXIT_FAILURE);
+        }
+
+        const VkDeviceSize size = getPaddedSize(memoryTypeIndex, requirements.size);
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+
+        const VkMemoryPropertyFlags typeFlags = m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+        if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+        {
+            alignment = std::max(alignment, m_NonCoherentAtomSize);
+        }
+
+        const VkDeviceSize blockSize = getPreferredBlockSize(memoryTypeIndex);
+        dedicated = dedicated || needsDedicatedBlock(memoryTypeIndex, size);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        MemoryAllocation allocation;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.size = requirements.size;
+
+        if (dedicated)
+        {
+            MemoryBlock* block = createBlock(memoryTypeIndex, size, &dedicatedInfo);
+            if (!block)
+            {
+                if (mayFail)
+                    return MemoryAllocation();
+
+                printf("Failed to allocate %llu bytes of device memory\n", (unsigned long long)size);
+                exit(EXIT_FAILURE);
+            }
+
+            block->dedicated = true;
+            m_DedicatedBlocks.emplace_back(block);
+
+            allocation.block = block;
+            allocation.memory = block->memory;
+            allocation.range = block->allocator.allocate(size);
+            allocation.offset = allocation.range.offset;
+            return allocation;
+        }
+
+        auto& blocks = m_Blocks[memoryTypeIndex][pool];
+
+        for (auto& block : blocks)
+        {
+            TLSFAllocator::Allocation range = block->allocator.allocate(size, alignment);
+            if (range.isValid())
+            {
+                allocation.block = block.get();
+                allocation.memory = block->memory;
+                allocation.range = range;
+                allocation.offset = range.offset;
+                return allocation;
+            }
+        }
+
+        // no room left in the pool, fall back to smaller blocks if the driver refuses the preferred size
+        MemoryBlock* block = nullptr;
+        for (VkDeviceSize newBlockSize = blockSize; !block && newBlockSize >= size; newBlockSize /= 2)
+        {
+            block = createBlock(memoryTypeIndex, newBlockSize, nullptr);
+        }
+
+        if (!block)
+        {
+            printf("Failed to allocate a device memory block for %llu bytes\n", (unsigned long long)size);
+            exit(EXIT_FAILURE);
+        }
+
+        block->pool = pool;
+        blocks.emplace_back(block);
+
+        allocation.block = block;
+        allocation.memory = block->memory;
+        allocation.range = block->allocator.allocate(size, alignment);
+        allocation.offset = allocation.range.offset;
+        return allocation;
+    }
+
+    void MemoryAllocator::free(MemoryAllocation& allocation)
+    {
+        if (!allocation.isValid())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        MemoryBlock* block = allocation.block;
+        block->allocator.free(allocation.range);
+        if (allocation.owner)
+            block->resources.erase(allocation.owner);
+        allocation = MemoryAllocation();
+
+        if (block->dedicated)
+        {
+            auto it = std::find_if(m_DedicatedBlocks.begin(), m_DedicatedBlocks.end(),
+                [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; });
+
+            destroyBlock(block);
+            m_DedicatedBlocks.erase(it);
+            return;
+        }
+
+        auto& blocks = m_Blocks[block->memoryTypeIndex][block->pool];
+
+        // an empty block is returned to the driver, except for the last one of the pool
+        // so that create/destroy churn does not end up in vkAllocateMemory every time
+        if (block->allocator.isEmpty() && blocks.size() > 1)
+        {
+            auto it = std::find_if(blocks.begin(), blocks.end(),
+                [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; });
+
+            destroyBlock(block);
+            blocks.erase(it);
+        }
+    }
+
+    void MemoryAllocator::registerResource(MemoryResource* resource, const std::shared_ptr<IResource>& handle)
+    {
+        if (!resource->allocation.isValid())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        resource->handle = handle;
+        resource->allocation.owner = resource;
+        resource->allocation.block->resources.insert(resource);
+    }
+
+    std::vector<std::shared_ptr<IResource>> MemoryAllocator::getRelocationCandidates(VkDeviceSize maxBytes) const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        std::vector<const MemoryBlock*> sources;
+
+        for (uint32_t typeIndex = 0; typeIndex < m_MemoryProperties.memoryTypeCount; typeIndex++)
+        {
+            // mapped memory stays put, the application holds pointers into it
+            if (m_MemoryProperties.memoryTypes[typeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+                continue;
+
+            for (uint32_t pool = 0; pool < kPoolCount; pool++)
+            {
+                const auto& blocks = m_Blocks[typeIndex][pool];
+                if (blocks.size() < 2)
+                    continue;
+
+                const MemoryBlock* sparsest = nullptr;
+                for (const auto& block : blocks)
+                {
+                    if (!sparsest || block->allocator.getUsedBytes() < sparsest->allocator.getUsedBytes())
+                        sparsest = block.get();
+                }
+
+                // a block that is at least half full is not worth emptying
+                if (sparsest->allocator.getUsedBytes() < sparsest->size / 2)
+                    sources.push_back(sparsest);
+            }
+        }
+
+        std::sort(sources.begin(), sources.end(), [](const MemoryBlock* a, const MemoryBlock* b) {
+            return a->allocator.getUsedBytes() < b->allocator.getUsedBytes();
+        });
+
+        std::vector<std::shared_ptr<IResource>> candidates;
+        VkDeviceSize totalBytes = 0;
+
+        for (const MemoryBlock* block : sources)
+        {
+            for (MemoryResource* resource : block->resources)
+            {
+                // the last handle is gone and the resource is waiting for the lock to free its memory
+                std::shared_ptr<IResource> handle = resource->handle.lock();
+                if (!handle)
+                    continue;
+
+                if (totalBytes + resource->allocation.size > maxBytes)
+                    return candidates;
+
+                totalBytes += resource->allocation.size;
+                candidates.push_back(std::move(handle));
+            }
+        }
+
+        return candidates;
+    }
+
+    MemoryAllocation MemoryAllocator::allocateForRelocation(const VkMemoryRequirements& requirements, const MemoryAllocation& current)
+    {
+        const MemoryBlock* currentBlock = current.block;
+
+        if (!(requirements.memoryTypeBits & (1u << currentBlock->memoryTypeIndex)))
+            return MemoryAllocation();
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        MemoryAllocation allocation;
+        allocation.memoryTypeIndex = currentBlock->memoryTypeIndex;
+        allocation.size = requirements.size;
+
+        for (auto& block : m_Blocks[currentBlock->memoryTypeIndex][currentBlock->pool])
+        {
+            if (block.get() == currentBlock)
+                continue;
+
+            TLSFAllocator::Allocation range = block->allocator.allocate(requirements.size, std::max<VkDeviceSize>(requirements.alignment, 1));
+            if (range.isValid())
+            {
+                allocation.block = block.get();
+                allocation.memory = block->memory;
+                allocation.range = range;
+                allocation.offset = range.offset;
+                return allocation;
+            }
+        }
+
+        return MemoryAllocation();
+    }
+
+    MemoryAllocation MemoryAllocator::relocate(MemoryResource* resource, const MemoryAllocation& allocation)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        MemoryAllocation previous = resource->allocation;
+        previous.block->resources.erase(resource);
+        previous.owner = nullptr;
+
+        resource->allocation = allocation;
+        resource->allocation.owner = resource;
+        allocation.block->resources.insert(resource);
+
+        return previous;
+    }
+
+    void* MemoryAllocator::getMappedPointer(const MemoryAllocation& allocation) const
+    {
+        if (!allocation.isValid() || !allocation.block->mappedPtr)
+            return nullptr;
+
+        return static_cast<uint8_t*>(allocation.block->mappedPtr) + allocation.offset;
+    }
+
+    VkMappedMemoryRange MemoryAllocator::getMappedRange(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+    {
+        const MemoryBlock* block = allocation.block;
+
+        if (size == VK_WHOLE_SIZE || offset + size > allocation.size)
+            size = allocation.size - offset;
+
+        // non-coherent allocations are atom aligned on both ends, so widening the range stays inside the allocation
+        const VkDeviceSize begin = (allocation.offset + offset) / m_NonCoherentAtomSize * m_NonCoherentAtomSize;
+        const VkDeviceSize end = std::min(alignUp(allocation.offset + offset + size, m_NonCoherentAtomSize), block->size);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = block->memory;
+        range.offset = begin;
+        range.size = end - begin;
+        return range;
+    }
+
+    void MemoryAllocator::flush(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (!allocation.isValid() || allocation.block->coherent || !allocation.block->mappedPtr)
+            return;
+
+        const VkMappedMemoryRange range = getMappedRange(allocation, offset, size);
+        checkSuccess(vkFlushMappedMemoryRanges(m_Context.device, 1, &range));
+    }
+
+    void MemoryAllocator::invalidate(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (!allocation.isValid() || allocation.block->coherent || !allocation.block->mappedPtr)
+            return;
+
+        const VkMappedMemoryRange range = getMappedRange(allocation, offset, size);
+        checkSuccess(vkInvalidateMappedMemoryRanges(m_Context.device, 1, &range));
+    }
+
+    MemoryStatistics MemoryAllocator::getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        MemoryStatistics stats;
+
+        for (const auto& pools : m_Blocks)
+        {
+            for (const auto& blocks : pools)
+            {
+                for (const auto& block : blocks)
+                {
+                    stats.blockCount++;
+                    stats.allocationCount += block->allocator.getAllocationCount();
+                    stats.blockBytes += block->size;
+                    stats.usedBytes += block->allocator.getUsedBytes();
+                }
+            }
+        }
+
+        for (const auto& block : m_DedicatedBlocks)
+        {
+            stats.dedicatedAllocationCount++;
+            stats.allocationCount++;
+            stats.blockBytes += block->size;
+            stats.usedBytes += block->size;
+        }
+
+        return stats;
+    }
+
+    Heap::~Heap()
+    {
+        m_Context.memoryAllocator->free(allocation);
+    }
+
+    HeapHandle Device::createHeap(const HeapDesc& desc)
+    {
+        Heap* heap = new Heap(m_Context);
+        heap->desc = desc;
+        heap->allocation = m_MemoryAllocator->allocateHeapMemory(desc.capacity, pickMemoryProperties(desc.memoryProperties), desc.memoryTypeBits);
+        if (!heap->allocation.isValid())
+        {
+            printf("Failed to allocate %llu bytes of heap memory\n", (unsigned long long)desc.capacity);
+            exit(EXIT_FAILURE);
+        }
+
+        if (!desc.debugName.empty())
+            m_Context.setVkObjectName(heap->allocation.memory, VK_OBJECT_TYPE_DEVICE_MEMORY, desc.debugName.c_str());
+
+        return HeapHandle(heap);
+    }
+
+    MemoryRequirements Device::getTextureMemoryRequirements(ITexture* texture)
+    {
+        Texture* tex = dynamic_cast<Texture*>(texture);
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_Context.device, tex->image, &memRequirements);
+
+        return MemoryRequirements{ memRequirements.size, memRequirements.alignment, memRequirements.memoryTypeBits };
+    }
+
+    MemoryRequirements Device::getBufferMemoryRequirements(IBuffer* buffer)
+    {
+        Buffer* buf = dynamic_cast<Buffer*>(buffer);
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_Context.device, buf->buffer, &memRequirements);
+
+        return MemoryRequirements{ memRequirements.size, memRequirements.alignment, memRequirements.memoryTypeBits };
+    }
+
+    static bool checkPlacement(const VkMemoryRequirements& requirements, const Heap* heap, uint64_t offset)
+    {
+        if (!(requirements.memoryTypeBits & (1u << heap->allocation.memoryTypeIndex)))
+        {
+            printf("Heap memory type %u is not in the memory type bits 0x%x of the resource, set HeapDesc::memoryTypeBits\n",
+                heap->allocation.memoryTypeIndex, requirements.memoryTypeBits);
+            return false;
+        }
+
+        if (offset % requirements.alignment != 0 || offset + requirements.size > heap->desc.capacity)
+        {
+            printf("Resource does not fit in the heap at offset %llu\n", (unsigned long long)offset);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool Device::bindTextureMemory(ITexture* texture, IHeap* heap, uint64_t offset)
+    {
+        Texture* tex = dynamic_cast<Texture*>(texture);
+        Heap* vkHeap = dynamic_cast<Heap*>(heap);
+
+        if (!tex->desc.isVirtual)
+            return false;
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_Context.device, tex->image, &memRequirements);
+
+        if (!checkPlacement(memRequirements, vkHeap, offset))
+            return false;
+
+        if (!checkSuccess(vkBindImageMemory(m_Context.device, tex->image, vkHeap->allocation.memory, vkHeap->allocation.offset + offset)))
+            return false;
+
+        if (m_BindlessHeap)
+            m_BindlessHeap->registerTexture(tex);
+
+        return true;
+    }
+
+    bool Device::bindBufferMemory(IBuffer* buffer, IHeap* heap, uint64_t offset)
+    {
+        Buffer* buf = dynamic_cast<Buffer*>(buffer);
+        Heap* vkHeap = dynamic_cast<Heap*>(heap);
+
+        if (!buf->desc.isVirtual)
+            return false;
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_Context.device, buf->buffer, &memRequirements);
+
+        if (!checkPlacement(memRequirements, vkHeap, offset))
+            return false;
+
+        if (!checkSuccess(vkBindBufferMemory(m_Context.device, buf->buffer, vkHeap->allocation.memory, vkHeap->allocation.offset + offset)))
+            return false;
+
+        uint8_t* heapMemory = static_cast<uint8_t*>(m_MemoryAllocator->getMappedPointer(vkHeap->allocation));
+        buf->ptr = heapMemory ? heapMemory + offset : nullptr;
+
+        if (m_BindlessHeap)
+            m_BindlessHeap->registerBuffer(buf);
+
+        return true;
+    }
+
+    MemoryStatistics Device::getMemoryStatistics() const
+    {
+        return m_MemoryAllocator->getStatistics();
+    }
+
+    std::vector<MemoryHeapBudget> Device::getMemoryHeapBudgets() const
+    {
+        return m_MemoryAllocator->getHeapBudgets();
+    }
+
+    void Device::setMemoryEvictionCallback(MemoryEvictionCallback callback)
+    {
+        m_MemoryAllocator->setEvictionCallback(std::move(callback));
+    }
+}
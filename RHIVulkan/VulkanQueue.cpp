@@ -1,16 +1,100 @@
 #include <VulkanBackend.hpp>
 
+#include <unordered_map>
+
 namespace RHI::Vulkan
 {
-    TrackedCommandBuffer::~TrackedCommandBuffer()
+    static std::atomic<uint64_t> s_NextQueueUID = 1;
+
+    // rings of the current thread by queue UID, UIDs are never reused so entries of destroyed queues are never hit
+    static thread_local std::unordered_map<uint64_t, CommandPoolRing *> t_CommandPoolRings;
+
+    CommandPoolRing::CommandPoolRing(const VulkanContext &context, uint32_t queueFamilyIndex)
+        : m_Context(context), m_QueueFamilyIndex(queueFamilyIndex)
     {
-        if (commandPool) {
-            vkDestroyCommandPool(m_Context.device, commandPool, nullptr);
+    }
+
+    CommandPoolRing::~CommandPoolRing()
+    {
+        // destroying the pool frees its command buffers
+        for (const std::unique_ptr<CommandPoolSlot> &slot : m_Slots) {
+            vkDestroyCommandPool(m_Context.device, slot->commandPool, nullptr);
         }
     }
 
+    CommandPoolSlot *CommandPoolRing::acquireSlot(uint64_t frameIndex)
+    {
+        if (!m_Slots.empty() && m_Slots[m_CurrentSlot]->frameIndex == frameIndex)
+            return m_Slots[m_CurrentSlot].get();
+
+        // the oldest slot comes first, a slot held by a long running submission must not make the ring grow
+        // while a newer one is already idle
+        for (uint32_t i = 1; i <= uint32_t(m_Slots.size()); i++) {
+            const uint32_t nextSlot = (m_CurrentSlot + i) % uint32_t(m_Slots.size());
+            CommandPoolSlot *slot = m_Slots[nextSlot].get();
+
+            if (slot->pendingCount == 0) {
+                checkSuccess(vkResetCommandPool(m_Context.device, slot->commandPool, 0));
+                slot->usedCount[VK_COMMAND_BUFFER_LEVEL_PRIMARY] = 0;
+                slot->usedCount[VK_COMMAND_BUFFER_LEVEL_SECONDARY] = 0;
+                slot->frameIndex = frameIndex;
+                m_CurrentSlot = nextSlot;
+                return slot;
+            }
+        }
+
+        std::unique_ptr<CommandPoolSlot> slot = std::make_unique<CommandPoolSlot>();
+        slot->frameIndex = frameIndex;
+
+        VkCommandPoolCreateInfo cpi{};
+        cpi.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cpi.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        cpi.queueFamilyIndex = m_QueueFamilyIndex;
+
+        checkSuccess(vkCreateCommandPool(m_Context.device, &cpi, nullptr, &slot->commandPool));
+
+        const uint32_t insertAt = m_Slots.empty() ? 0 : m_CurrentSlot + 1;
+        m_Slots.insert(m_Slots.begin() + insertAt, std::move(slot));
+        m_CurrentSlot = insertAt;
+
+        return m_Slots[m_CurrentSlot].get();
+    }
+
+    TrackedCommandBufferPtr CommandPoolRing::getCommandBuffer(VkCommandBufferLevel level, uint64_t frameIndex)
+    {
+        CommandPoolSlot *slot = acquireSlot(frameIndex);
+
+        std::vector<TrackedCommandBufferPtr> &commandBuffers = slot->commandBuffers[level];
+        uint32_t &usedCount = slot->usedCount[level];
+
+        if (usedCount == commandBuffers.size()) {
+            TrackedCommandBufferPtr commandBuffer = std::make_shared<TrackedCommandBuffer>(m_Context);
+            commandBuffer->commandPool = slot->commandPool;
+            commandBuffer->level = level;
+            commandBuffer->slot = slot;
+
+            VkCommandBufferAllocateInfo ai{};
+            ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            ai.pNext = nullptr;
+            ai.commandPool = slot->commandPool;
+            ai.level = level;
+            ai.commandBufferCount = static_cast<uint32_t>(1);
+
+            checkSuccess(vkAllocateCommandBuffers(m_Context.device, &ai, &commandBuffer->commandBuffer));
+
+            commandBuffers.push_back(commandBuffer);
+        }
+
+        TrackedCommandBufferPtr commandBuffer = commandBuffers[usedCount++];
+        commandBuffer->submissionID = 0;
+        slot->pendingCount++;
+
+        return commandBuffer;
+    }
+
     Queue::Queue(const VulkanContext &context, CommandQueue queueID, VkQueue queue, uint32_t queueFamilyIndex)
         : m_Context(context), m_Queue(queue), m_QueueID(queueID), m_QueueFamilyIndex(queueFamilyIndex)
+        , m_UID(s_NextQueueUID++)
     {
         // const VkSemaphoreCreateInfo semaphoreCreateInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
         VkSemaphoreTypeCreateInfo timelineCreateInfo;
@@ -24,10 +108,20 @@ namespace RHI::Vulkan
         semaphoreCreateInfo.pNext = &timelineCreateInfo;
         semaphoreCreateInfo.flags = 0;
         vkCreateSemaphore(m_Context.device, &semaphoreCreateInfo, nullptr, &trackingSemaphore);
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(m_Context.physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(m_Context.physicalDevice, &familyCount, families.data());
+
+        if (m_QueueFamilyIndex < familyCount)
+            m_SupportsSparseBinding = (families[m_QueueFamilyIndex].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) != 0;
     }
 
     Queue::~Queue()
     {
+        releaseDeferred();
+
         vkDestroySemaphore(m_Context.device, trackingSemaphore, nullptr);
         trackingSemaphore = VkSemaphore();
     }
@@ -47,7 +141,8 @@ namespace RHI::Vulkan
             if (CommandList *commandList = dynamic_cast<CommandList *>(commandLists[i])) {
                 if (TrackedCommandBufferPtr commandBuffer = commandList->getCurrentCommandBuffer()) {
                     commandBuffers[i] = commandBuffer->commandBuffer;
-                    // TODO:fix memory leaking
+                    // set here as well as in CommandList::executed, the in flight list has to stay ordered by ID
+                    commandBuffer->submissionID = m_LastSubmittedID;
                     m_CommandBuffersInFlight.push_back(commandBuffer);
                 }
             }
@@ -91,6 +186,44 @@ namespace RHI::Vulkan
         return m_LastSubmittedID;
     }
 
+    uint64_t Queue::bindSparse(const std::vector<VkSparseImageMemoryBindInfo> &imageBinds,
+                               const std::vector<VkSparseImageOpaqueMemoryBindInfo> &imageOpaqueBinds)
+    {
+        // binding operations are not ordered with earlier submissions, tiles being unmapped may still be sampled.
+        // only the tracking semaphore is used, the semaphores queued by the application stay for the next submit
+        const uint64_t waitValue = m_LastSubmittedID;
+        const uint32_t waitCount = waitValue > 0 ? 1 : 0;
+
+        m_LastSubmittedID++;
+        const uint64_t signalValue = m_LastSubmittedID;
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{};
+        timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSubmitInfo.waitSemaphoreValueCount = waitCount;
+        timelineSubmitInfo.pWaitSemaphoreValues = &waitValue;
+        timelineSubmitInfo.signalSemaphoreValueCount = 1;
+        timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+        VkBindSparseInfo bindInfo{};
+        bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+        bindInfo.pNext = &timelineSubmitInfo;
+        bindInfo.waitSemaphoreCount = waitCount;
+        bindInfo.pWaitSemaphores = &trackingSemaphore;
+        bindInfo.imageOpaqueBindCount = uint32_t(imageOpaqueBinds.size());
+        bindInfo.pImageOpaqueBinds = imageOpaqueBinds.data();
+        bindInfo.imageBindCount = uint32_t(imageBinds.size());
+        bindInfo.pImageBinds = imageBinds.data();
+        bindInfo.signalSemaphoreCount = 1;
+        bindInfo.pSignalSemaphores = &trackingSemaphore;
+
+        checkSuccess(vkQueueBindSparse(m_Queue, 1, &bindInfo, VK_NULL_HANDLE));
+
+        // the next submission must not sample tiles before they are mapped
+        addWaitSemaphore(trackingSemaphore, m_LastSubmittedID);
+
+        return m_LastSubmittedID;
+    }
+
     uint64_t Queue::updateLastFinishedID()
     {
         vkGetSemaphoreCounterValue(m_Context.device, trackingSemaphore, &m_LastFinishedID);
@@ -100,59 +233,102 @@ namespace RHI::Vulkan
 
     void Queue::retireCommandBuffers()
     {
-        std::list<TrackedCommandBufferPtr> submissions = std::move(m_CommandBuffersInFlight);
-
         uint64_t lastFinishedID = updateLastFinishedID();
 
-        for (const TrackedCommandBufferPtr &cmd : submissions) {
-            if (cmd->submissionID <= lastFinishedID) {
-                cmd->referencedStagingBuffers.clear();
-                cmd->submissionID = 0;
-                m_CommandBuffersPool.push_back(cmd);
-            } else {
-                m_CommandBuffersInFlight.push_back(std::move(cmd));
+        // submissions finish in order, so only the front of the list has to be looked at
+        while (!m_CommandBuffersInFlight.empty() && m_CommandBuffersInFlight.front()->submissionID <= lastFinishedID) {
+            TrackedCommandBufferPtr cmd = std::move(m_CommandBuffersInFlight.front());
+            m_CommandBuffersInFlight.pop_front();
+
+            releaseCommandBuffer(*cmd);
+        }
+
+        std::vector<std::function<void()>> finished;
+        {
+            std::lock_guard lock_guard(m_DeferredReleaseMutex);
+
+            size_t kept = 0;
+            for (size_t i = 0; i < m_DeferredReleases.size(); i++) {
+                DeferredRelease &deferred = m_DeferredReleases[i];
+                const uint64_t submissionID = *deferred.submission;
+
+                if (submissionID != 0 && submissionID <= lastFinishedID)
+                    finished.push_back(std::move(deferred.release));
+                else
+                    m_DeferredReleases[kept++] = std::move(deferred);
             }
+            m_DeferredReleases.resize(kept);
         }
+
+        // without the lock, a release may defer more work
+        for (const std::function<void()> &release : finished)
+            release();
+
+        m_FrameIndex++;
     }
 
-    TrackedCommandBufferPtr Queue::createCommandBuffer()
+    void Queue::discardCommandBuffer(const TrackedCommandBufferPtr &commandBuffer)
     {
-        TrackedCommandBufferPtr commandBuffer = std::make_shared<TrackedCommandBuffer>(m_Context);
+        // the old copies of defragmented resources may still be read by work submitted before
+        if (!commandBuffer->referencedRelocatedResources.empty()) {
+            deferRelease(m_LastSubmittedID, [resources = std::move(commandBuffer->referencedRelocatedResources)] {});
+            commandBuffer->referencedRelocatedResources.clear();
+        }
 
-        VkCommandPoolCreateInfo cpi{};
-        cpi.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        cpi.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-        cpi.queueFamilyIndex = m_QueueFamilyIndex;
+        // nothing of this recording reached the GPU
+        releaseCommandBuffer(*commandBuffer);
+    }
 
-        checkSuccess(vkCreateCommandPool(m_Context.device, &cpi, nullptr, &commandBuffer->commandPool));
+    void Queue::releaseCommandBuffer(TrackedCommandBuffer &commandBuffer)
+    {
+        for (const BufferHandle &stagingBuffer : commandBuffer.referencedStagingBuffers)
+            m_Context.stagingBufferPool->release(stagingBuffer);
+        commandBuffer.referencedStagingBuffers.clear();
+        commandBuffer.referencedRelocatedResources.clear();
+        commandBuffer.referencedUploadChunks.clear();
+        commandBuffer.referencedResources.clear();
+        for (const TrackedCommandBufferPtr &secondary : commandBuffer.referencedSecondaryBuffers) {
+            secondary->referencedResources.clear();
+            secondary->slot->pendingCount--;
+        }
+        commandBuffer.referencedSecondaryBuffers.clear();
+        // the owning thread resets the slot once nothing in it is pending
+        commandBuffer.slot->pendingCount--;
+    }
 
-        VkCommandBufferAllocateInfo ai{};
-        ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        ai.pNext = nullptr;
-        ai.commandPool = commandBuffer->commandPool;
-        ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        ai.commandBufferCount = static_cast<uint32_t>(1);
+    void Queue::deferRelease(std::shared_ptr<std::atomic<uint64_t>> submission, std::function<void()> release)
+    {
+        std::lock_guard lock_guard(m_DeferredReleaseMutex);
+        m_DeferredReleases.push_back(DeferredRelease{std::move(submission), std::move(release)});
+    }
 
-        checkSuccess(vkAllocateCommandBuffers(m_Context.device, &ai, &commandBuffer->commandBuffer));
+    void Queue::releaseDeferred()
+    {
+        std::vector<DeferredRelease> deferredReleases;
+        {
+            std::lock_guard lock_guard(m_DeferredReleaseMutex);
+            deferredReleases.swap(m_DeferredReleases);
+        }
 
-        return commandBuffer;
+        for (const DeferredRelease &deferred : deferredReleases)
+            deferred.release();
     }
 
-    TrackedCommandBufferPtr Queue::getOrCreateCommandBuffer()
+    void Queue::deferRelease(uint64_t submissionID, std::function<void()> release)
     {
-        std::lock_guard lock_guard(m_Mutex); // this is called from CommandList::open, so free-threaded
+        deferRelease(std::make_shared<std::atomic<uint64_t>>(submissionID), std::move(release));
+    }
 
-        TrackedCommandBufferPtr commandBuffer;
-        if (m_CommandBuffersPool.empty()) {
-            commandBuffer = createCommandBuffer();
-            //m_CommandBuffersPool.push_back(commandBuffer);
-        } else {
-            commandBuffer = m_CommandBuffersPool.front();
-            // TODO:fix memory leaking
-            m_CommandBuffersPool.pop_front();
+    TrackedCommandBufferPtr Queue::getOrCreateCommandBuffer(VkCommandBufferLevel level)
+    {
+        CommandPoolRing *&ring = t_CommandPoolRings[m_UID];
+        if (!ring) {
+            std::lock_guard lock_guard(m_Mutex); // first recording on this thread, the ring list is shared
+            m_CommandPoolRings.push_back(std::make_unique<CommandPoolRing>(m_Context, m_QueueFamilyIndex));
+            ring = m_CommandPoolRings.back().get();
         }
 
-        return commandBuffer;
+        return ring->getCommandBuffer(level, m_FrameIndex);
     }
 
     void Queue::addWaitSemaphore(VkSemaphore semaphore, uint64_t value)
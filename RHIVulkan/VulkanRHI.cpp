@@ -98,6 +98,44 @@ namespace
         return false;
     }
 
+    // the bindless heap needs non uniform indexing and update after bind for every descriptor type it holds
+    static bool IsBindlessSupported(VkPhysicalDevice physicalDevice)
+    {
+        VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &indexingFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        return indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound &&
+               indexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+               indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+               indexingFeatures.descriptorBindingStorageImageUpdateAfterBind &&
+               indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+               indexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+               indexingFeatures.shaderStorageImageArrayNonUniformIndexing &&
+               indexingFeatures.shaderStorageBufferArrayNonUniformIndexing;
+    }
+
+    static bool IsDescriptorBufferSupported(VkPhysicalDevice physicalDevice)
+    {
+        VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+        descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+
+        VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures{};
+        bufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+        bufferDeviceAddressFeatures.pNext = &descriptorBufferFeatures;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &bufferDeviceAddressFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        return descriptorBufferFeatures.descriptorBuffer && bufferDeviceAddressFeatures.bufferDeviceAddress;
+    }
+
     VulkanContextExtensions VulkanDynamicRHI::initializeContextExtensions()
     {
         VulkanContextExtensions contextExtensions{
@@ -261,7 +299,9 @@ namespace
             .useComputeQueue = m_DeviceParams.useComputeQueue,
             .transferFamily = m_TransferQueueFamily,
             .transferQueue = m_TransferQueue,
-            .useTransferQueue = m_DeviceParams.useTransferQueue };
+            .useTransferQueue = m_DeviceParams.useTransferQueue,
+            .bindlessHeapDesc = m_DeviceParams.bindlessHeapDesc,
+            .descriptorBufferSize = m_DeviceParams.descriptorBufferSize };
 
         m_Device = Vulkan::DeviceHandle(new RHI::Vulkan::Device(DeviceDesc));
 
@@ -309,6 +349,23 @@ namespace
             // for legacy drivers Vulkan 1.1
             extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
         }
+
+        uint32_t devicePropertiesCount = 0;
+        vkEnumerateDeviceExtensionProperties(m_VulkanPhysicalDevice, nullptr, &devicePropertiesCount, nullptr);
+        std::vector<VkExtensionProperties> deviceProperties(devicePropertiesCount);
+        vkEnumerateDeviceExtensionProperties(m_VulkanPhysicalDevice, nullptr, &devicePropertiesCount, deviceProperties.data());
+
+        m_VulkanExtensions.EXT_memory_budget = IsExtensionAvailable(deviceProperties, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (m_VulkanExtensions.EXT_memory_budget)
+        {
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        m_VulkanExtensions.KHR_push_descriptor = IsExtensionAvailable(deviceProperties, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        if (m_VulkanExtensions.KHR_push_descriptor)
+        {
+            extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        }
 #if defined (__APPLE__)
         if (ctx_.ctxExtensions.KHR_portability_subset)
         {
@@ -338,6 +395,13 @@ namespace
             (VkBool32)(m_VulkanFeatures.shaderSampledImageArrayDynamicIndexing ? VK_TRUE : VK_FALSE);
         /* for GL <-> VK material shader compatibility */
         deviceFeatures.shaderInt64 = (VkBool32)(m_VulkanFeatures.shaderInt64 ? VK_TRUE : VK_FALSE);
+        /* for virtual textures, optional */
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(m_VulkanPhysicalDevice, &supportedFeatures);
+        m_VulkanFeatures.sparseBinding = supportedFeatures.sparseBinding == VK_TRUE;
+        m_VulkanFeatures.sparseResidencyImage2D = m_VulkanFeatures.sparseBinding && supportedFeatures.sparseResidencyImage2D == VK_TRUE;
+        deviceFeatures.sparseBinding = (VkBool32)(m_VulkanFeatures.sparseBinding ? VK_TRUE : VK_FALSE);
+        deviceFeatures.sparseResidencyImage2D = (VkBool32)(m_VulkanFeatures.sparseResidencyImage2D ? VK_TRUE : VK_FALSE);
 
         void *pNext = nullptr;
 
@@ -357,6 +421,19 @@ namespace
             descriptorIndexing.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
             descriptorIndexing.runtimeDescriptorArray = VK_TRUE;
 
+            /* for the bindless descriptor heap, optional */
+            m_VulkanFeatures.bindlessDescriptors = m_DeviceParams.enableBindless && IsBindlessSupported(m_VulkanPhysicalDevice);
+            if (m_VulkanFeatures.bindlessDescriptors) {
+                descriptorIndexing.shaderStorageImageArrayNonUniformIndexing = VK_TRUE;
+                descriptorIndexing.descriptorBindingPartiallyBound = VK_TRUE;
+                descriptorIndexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+                descriptorIndexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+                descriptorIndexing.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+                descriptorIndexing.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+            } else if (m_DeviceParams.enableBindless) {
+                printf("Bindless descriptors are not supported by the device\n");
+            }
+
             pNext = &descriptorIndexing;
         }
 
@@ -369,8 +446,33 @@ namespace
             pNext = &timelineSemaphore;
         }
 
+        /* for binding sets in a descriptor buffer, optional */
+        VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddress = {};
+        VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBuffer = {};
+        if (m_DeviceParams.enableDescriptorBuffer) {
+            m_VulkanExtensions.EXT_descriptor_buffer = IsExtensionAvailable(deviceProperties, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+            m_VulkanFeatures.descriptorBuffer = m_VulkanExtensions.EXT_descriptor_buffer && !m_VulkanFeatures.bindlessDescriptors &&
+                                                IsDescriptorBufferSupported(m_VulkanPhysicalDevice);
+
+            if (m_VulkanFeatures.descriptorBuffer) {
+                extensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+
+                bufferDeviceAddress.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+                bufferDeviceAddress.pNext = pNext;
+                bufferDeviceAddress.bufferDeviceAddress = VK_TRUE;
+
+                descriptorBuffer.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+                descriptorBuffer.pNext = &bufferDeviceAddress;
+                descriptorBuffer.descriptorBuffer = VK_TRUE;
+
+                pNext = &descriptorBuffer;
+            } else {
+                printf("Descriptor buffers are not available, binding sets use descriptor pools\n");
+            }
+        }
+
         VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
-        if (m_VulkanFeatures.deviceDescriptorIndexing || m_VulkanFeatures.timelineSemaphore) {
+        if (m_VulkanFeatures.deviceDescriptorIndexing || m_VulkanFeatures.timelineSemaphore || m_VulkanFeatures.descriptorBuffer) {
             deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
             deviceFeatures2.pNext = pNext;
             deviceFeatures2.features = deviceFeatures;
@@ -399,7 +501,7 @@ namespace
 
         VkDeviceCreateInfo ci{};
         ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        ci.pNext = m_VulkanFeatures.deviceDescriptorIndexing ? &deviceFeatures2 : nullptr;
+        ci.pNext = deviceFeatures2.sType ? &deviceFeatures2 : nullptr;
         ci.flags = 0;
         ci.queueCreateInfoCount = static_cast<uint32_t>(qci.size());
         ci.pQueueCreateInfos = qci.data();
@@ -407,7 +509,7 @@ namespace
         ci.ppEnabledLayerNames = nullptr;
         ci.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
         ci.ppEnabledExtensionNames = extensions.data();
-        ci.pEnabledFeatures = m_VulkanFeatures.deviceDescriptorIndexing ? nullptr : &deviceFeatures;
+        ci.pEnabledFeatures = deviceFeatures2.sType ? nullptr : &deviceFeatures;
 
         return vkCreateDevice(m_VulkanPhysicalDevice, &ci, nullptr, &m_VulkanDevice);
     }
@@ -91,7 +91,7 @@ namespace RHI::Vulkan
             colorAttachment.format = tex->imageInfo.format;
             colorAttachment.samples = tex->imageInfo.samples;
             colorAttachment.loadOp = colorLoadOp;
-            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachment.storeOp = tex->desc.usage.isTransientAttachment ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
             colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
             colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
             colorAttachment.initialLayout = colorInitialLayout;
@@ -145,9 +145,11 @@ namespace RHI::Vulkan
             depthAttachment.format = depthTex->imageInfo.format;
             depthAttachment.samples = depthTex->imageInfo.samples;
             depthAttachment.loadOp = depthLoadOp;
-            depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            const bool storeDepth = !depthTex->desc.usage.isTransientAttachment;
+
+            depthAttachment.storeOp = storeDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
             depthAttachment.stencilLoadOp = stencilLoadOp;
-            depthAttachment.stencilStoreOp = hasStencil ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depthAttachment.stencilStoreOp = hasStencil && storeDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
             depthAttachment.initialLayout = depthInitialLayout;
             depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
@@ -1,4 +1,7 @@
+#include <cassert>
+#include <algorithm>
 #include <VulkanBackend.hpp>
+#include <Common/Miscellaneous.hpp>
 
 namespace RHI::Vulkan
 {
@@ -22,10 +25,23 @@ namespace RHI::Vulkan
         return InputLayoutHandle(inputLayout);
     }
 
-    VkDescriptorPool Device::createDescriptorPool(const DescriptorSetInfo& dsInfo, uint32_t dSetCount)
+    void getTexturesWithoutPermanentState(const DescriptorSetInfo& dsInfo, std::vector<uint16_t>& textureIndices)
+    {
+        textureIndices.clear();
+
+        for (size_t i = 0; i < dsInfo.textures.size(); i++)
+        {
+            if (!static_cast<Texture*>(dsInfo.textures[i].texture)->permanentState)
+                textureIndices.emplace_back(uint16_t(i));
+        }
+    }
+
+    static std::vector<VkDescriptorPoolSize> getDescriptorPoolSizes(const DescriptorSetInfo& dsInfo, uint32_t dSetCount)
     {
         uint32_t uniformBufferCount = 0;
+        uint32_t uniformBufferDynamicCount = 0;
         uint32_t storageBufferCount = 0;
+        uint32_t storageBufferDynamicCount = 0;
         uint32_t combinedImageSamplerCount = 0;
         uint32_t storageImageCount = 0;
 
@@ -35,6 +51,10 @@ namespace RHI::Vulkan
                 uniformBufferCount++;
             if (b.dInfo.type == DescriptorType::STORAGE_BUFFER)
                 storageBufferCount++;
+            if (b.dInfo.type == DescriptorType::UNIFORM_BUFFER_DYNAMIC)
+                uniformBufferDynamicCount++;
+            if (b.dInfo.type == DescriptorType::STORAGE_BUFFER_DYNAMIC)
+                storageBufferDynamicCount++;
         }
 
         for (const auto& t : dsInfo.textures)
@@ -54,6 +74,10 @@ namespace RHI::Vulkan
                 storageBufferCount += static_cast<uint32_t>(ba.buffers.size());
             else if (ba.dInfo.type == DescriptorType::UNIFORM_BUFFER)
                 uniformBufferCount += static_cast<uint32_t>(ba.buffers.size());
+            else if (ba.dInfo.type == DescriptorType::UNIFORM_BUFFER_DYNAMIC)
+                uniformBufferDynamicCount += static_cast<uint32_t>(ba.buffers.size());
+            else if (ba.dInfo.type == DescriptorType::STORAGE_BUFFER_DYNAMIC)
+                storageBufferDynamicCount += static_cast<uint32_t>(ba.buffers.size());
         }
 
         std::vector<VkDescriptorPoolSize> poolSizes;
@@ -61,39 +85,127 @@ namespace RHI::Vulkan
         if (uniformBufferCount)
             poolSizes.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, dSetCount * uniformBufferCount });
 
+        if (uniformBufferDynamicCount)
+            poolSizes.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, dSetCount * uniformBufferDynamicCount });
+
         if (storageBufferCount)
             poolSizes.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, dSetCount * storageBufferCount });
 
+        if (storageBufferDynamicCount)
+            poolSizes.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, dSetCount * storageBufferDynamicCount });
+
         if (combinedImageSamplerCount)
             poolSizes.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, dSetCount * combinedImageSamplerCount });
 
         if (storageImageCount)
             poolSizes.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, dSetCount * storageImageCount });
 
-        VkDescriptorPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.pNext = nullptr;
-        poolInfo.flags = 0;
-        poolInfo.maxSets = static_cast<uint32_t>(dSetCount);
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.empty() ? nullptr : poolSizes.data();
+        return poolSizes;
+    }
 
-        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    static bool isSameDescriptorInfo(const DescriptorInfo& a, const DescriptorInfo& b)
+    {
+        return a.type == b.type && a.shaderStageFlags == b.shaderStageFlags;
+    }
 
-        if (vkCreateDescriptorPool(m_Context.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    static bool isSameDescriptorSetInfo(const DescriptorSetInfo& a, const DescriptorSetInfo& b)
+    {
+        if (a.buffers.size() != b.buffers.size() || a.textures.size() != b.textures.size() ||
+            a.textureArrays.size() != b.textureArrays.size() || a.bufferArrays.size() != b.bufferArrays.size())
+            return false;
+
+        for (size_t i = 0; i < a.buffers.size(); i++)
         {
-            printf("Cannot allocate descriptor pool\n");
-            exit(EXIT_FAILURE);
+            const BufferAttachment& x = a.buffers[i];
+            const BufferAttachment& y = b.buffers[i];
+            if (!isSameDescriptorInfo(x.dInfo, y.dInfo) || x.buffer != y.buffer || x.offset != y.offset || x.size != y.size)
+                return false;
         }
 
-        //m_Resources.allDPools.push_back(descriptorPool);
-        return descriptorPool;
+        for (size_t i = 0; i < a.textures.size(); i++)
+        {
+            const TextureAttachment& x = a.textures[i];
+            const TextureAttachment& y = b.textures[i];
+            if (!isSameDescriptorInfo(x.dInfo, y.dInfo) || x.dInfo.subresource != y.dInfo.subresource ||
+                x.texture != y.texture || x.sampler != y.sampler)
+                return false;
+        }
+
+        for (size_t i = 0; i < a.textureArrays.size(); i++)
+        {
+            const TextureArrayAttachment& x = a.textureArrays[i];
+            const TextureArrayAttachment& y = b.textureArrays[i];
+            if (!isSameDescriptorInfo(x.dInfo, y.dInfo) || x.subresource != y.subresource || x.sampler != y.sampler ||
+                arraysAreDifferent(x.textures, y.textures))
+                return false;
+        }
+
+        for (size_t i = 0; i < a.bufferArrays.size(); i++)
+        {
+            const BufferArrayAttachment& x = a.bufferArrays[i];
+            const BufferArrayAttachment& y = b.bufferArrays[i];
+            if (!isSameDescriptorInfo(x.dInfo, y.dInfo) || arraysAreDifferent(x.buffers, y.buffers))
+                return false;
+        }
+
+        return true;
     }
 
+    static void forEachResource(const DescriptorSetInfo& dsInfo, const std::function<void(IResource*)>& callback)
+    {
+        for (const BufferAttachment& b : dsInfo.buffers)
+            callback(b.buffer);
+
+        for (const TextureAttachment& t : dsInfo.textures)
+        {
+            callback(t.texture);
+            if (t.sampler)
+                callback(t.sampler);
+        }
+
+        for (const TextureArrayAttachment& ta : dsInfo.textureArrays)
+        {
+            for (ITexture* texture : ta.textures)
+                callback(texture);
+            if (ta.sampler)
+                callback(ta.sampler);
+        }
+
+        for (const BufferArrayAttachment& ba : dsInfo.bufferArrays)
+        {
+            for (IBuffer* buffer : ba.buffers)
+                callback(buffer);
+        }
+    }
 
-    BindingLayoutHandle Device::createDescriptorSetLayout(const DescriptorSetInfo& dsInfo)
+    BindingLayoutHandle Device::createDescriptorSetLayout(const DescriptorSetInfo& dsInfo, BindingLayoutFlags flags)
     {
-        BindingLayout* bindingLayout = new BindingLayout(m_Context);
+        const bool pushDescriptor = (flags & BindingLayoutFlags::PushDescriptor) != BindingLayoutFlags::None;
+        if (pushDescriptor && !m_Context.ctxExtensions.KHR_push_descriptor)
+        {
+            printf("Push descriptors are not supported by the device\n");
+            exit(EXIT_FAILURE);
+        }
+
+        const bool descriptorBuffer = m_Context.ctxFeatures.descriptorBuffer;
+        if (descriptorBuffer)
+        {
+            auto isDynamic = [](DescriptorType type) {
+                return type == DescriptorType::UNIFORM_BUFFER_DYNAMIC || type == DescriptorType::STORAGE_BUFFER_DYNAMIC;
+            };
+
+            bool hasDynamicBuffers = false;
+            for (const auto& b : dsInfo.buffers)
+                hasDynamicBuffers |= isDynamic(b.dInfo.type);
+            for (const auto& ba : dsInfo.bufferArrays)
+                hasDynamicBuffers |= isDynamic(ba.dInfo.type);
+
+            if (pushDescriptor || hasDynamicBuffers)
+            {
+                printf("Push descriptors and dynamic buffers are not available in descriptor buffer mode\n");
+                exit(EXIT_FAILURE);
+            }
+        }
 
         VkDescriptorSetLayout descriptorSetLayout;
 
@@ -121,6 +233,56 @@ namespace RHI::Vulkan
             bindings.push_back(descriptorSetLayoutBinding(bindingIdx++, convertDescriptorType(ba.dInfo.type), pickShaderStage(ba.dInfo.shaderStageFlags), static_cast<uint32_t>(ba.buffers.size())));
         }
 
+        // per binding, the sampler baked into the layout, only combined image samplers take one
+        std::vector<Sampler*> immutableSamplers(bindings.size(), nullptr);
+        if ((flags & BindingLayoutFlags::ImmutableSamplers) != BindingLayoutFlags::None)
+        {
+            uint32_t textureIdx = static_cast<uint32_t>(dsInfo.buffers.size());
+            for (const auto& t : dsInfo.textures)
+            {
+                if (t.dInfo.type == DescriptorType::COMBINED_IMAGE_SAMPLER)
+                    immutableSamplers[textureIdx] = static_cast<Sampler*>(t.sampler);
+                textureIdx++;
+            }
+
+            for (const auto& ta : dsInfo.textureArrays)
+                immutableSamplers[textureIdx++] = static_cast<Sampler*>(ta.sampler);
+        }
+
+        LayoutCache::BindingLayoutKey key;
+        key.bindings = bindings;
+        for (Sampler* sampler : immutableSamplers)
+            key.immutableSamplers.push_back(sampler ? sampler->sampler : VK_NULL_HANDLE);
+        key.attachmentCounts[0] = static_cast<uint32_t>(dsInfo.buffers.size());
+        key.attachmentCounts[1] = static_cast<uint32_t>(dsInfo.textures.size());
+        key.attachmentCounts[2] = static_cast<uint32_t>(dsInfo.textureArrays.size());
+        key.attachmentCounts[3] = static_cast<uint32_t>(dsInfo.bufferArrays.size());
+        key.flags = flags;
+
+        const size_t hash = LayoutCache::hash(key);
+        if (BindingLayoutHandle cached = m_LayoutCache.find(key, hash))
+            return cached;
+
+        // the layout holds the samplers it bakes in, the Vulkan objects have to outlive it
+        std::vector<SamplerHandle> samplerHandles;
+        std::vector<std::vector<VkSampler>> bindingSamplers(bindings.size());
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            if (!immutableSamplers[i])
+                continue;
+
+            SamplerHandle handle = m_SamplerCache.getHandle(immutableSamplers[i]);
+            if (!handle)
+            {
+                printf("Immutable samplers must be created by the device\n");
+                exit(EXIT_FAILURE);
+            }
+
+            samplerHandles.push_back(handle);
+            bindingSamplers[i].assign(bindings[i].descriptorCount, immutableSamplers[i]->sampler);
+            bindings[i].pImmutableSamplers = bindingSamplers[i].data();
+        }
+
         //std::vector<VkDescriptorBindingFlags> descriptorBindingFlags(bindings.size(), 0);
         //descriptorBindingFlags.back() =
         //    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
@@ -135,7 +297,9 @@ namespace RHI::Vulkan
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         layoutInfo.pNext = nullptr; //dsInfo.textureArrays.empty() ? nullptr : &setLayoutBindingFlags;
-        layoutInfo.flags = 0;
+        layoutInfo.flags = pushDescriptor ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
+        if (descriptorBuffer)
+            layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
         layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
         layoutInfo.pBindings = bindings.empty() ? nullptr : bindings.data();
 
@@ -146,36 +310,216 @@ namespace RHI::Vulkan
         }
 
         //m_Resources.allDSLayouts.push_back(descriptorSetLayout);
+        BindingLayout* bindingLayout = new BindingLayout(m_Context);
         bindingLayout->descriptorSetLayout = descriptorSetLayout;
+        bindingLayout->pushDescriptor = pushDescriptor;
+        bindingLayout->immutableSamplers = std::move(samplerHandles);
+        if (descriptorBuffer)
+        {
+            bindingLayout->descriptorBufferLayout = m_DescriptorBufferHeap->createLayout(descriptorSetLayout, bindingIdx);
+            bindingLayout->descriptorBufferLayout->immutableSamplers = key.immutableSamplers;
+        }
+        else if (!pushDescriptor && !bindings.empty())
+            bindingLayout->updateTemplate = std::make_shared<DescriptorUpdateTemplate>(m_Context, descriptorSetLayout, dsInfo);
+
+        // another thread may have interned an equal layout since the lookup above
+        return m_LayoutCache.add(std::move(key), hash, BindingLayoutHandle(bindingLayout));
+    }
+
+    BindingSetHandle Device::createCachedDescriptorSet(const DescriptorSetInfo& dsInfo, IBindingLayout* bindingLayout)
+    {
+        const size_t hash = BindingSetCache::hash(bindingLayout, dsInfo);
+        if (BindingSetHandle cached = m_BindingSetCache.find(bindingLayout, dsInfo, hash))
+            return cached;
+
+        BindingSetHandle handle = createDescriptorSet(dsInfo, 1, bindingLayout);
+        m_BindingSetCache.add(bindingLayout, hash, handle);
 
-        return BindingLayoutHandle(bindingLayout);
+        return handle;
     }
 
-    BindingSetHandle Device::createDescriptorSet(const DescriptorSetInfo& dsInfo, uint32_t dSetCount, IBindingLayout* bindingLayout)
+    BindingSetHandle Device::createDescriptorSet(const DescriptorSetInfo& dsInfo, [[maybe_unused]] uint32_t dSetCount, IBindingLayout* bindingLayout)
     {
         BindingSet* bindingSet = new BindingSet(m_Context);
-        bindingSet->descriptorPool = createDescriptorPool(dsInfo);
 
         BindingLayout* dsLayout = dynamic_cast<BindingLayout*>(bindingLayout);
+        assert(!dsLayout->pushDescriptor);
+        // a binding set holds exactly one descriptor set
+        assert(dSetCount == 1);
 
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.descriptorPool = bindingSet->descriptorPool;
-        allocInfo.descriptorSetCount = dSetCount;
-        allocInfo.pSetLayouts = &dsLayout->descriptorSetLayout;
+        if (dsLayout->descriptorBufferLayout)
+        {
+            // the set is only a range of the descriptor buffer
+            bindingSet->descriptorBufferLayout = dsLayout->descriptorBufferLayout;
+            bindingSet->descriptorBufferRange = m_DescriptorBufferHeap->allocate(dsLayout->descriptorBufferLayout->size);
+            if (!bindingSet->descriptorBufferRange.isValid())
+            {
+                printf("createDescriptorSet: cannot allocate %llu bytes of the descriptor buffer\n",
+                    (unsigned long long)dsLayout->descriptorBufferLayout->size);
+                exit(EXIT_FAILURE);
+            }
 
-        if (vkAllocateDescriptorSets(m_Context.device, &allocInfo, &bindingSet->descriptorSet) != VK_SUCCESS)
+            bindingSet->descriptorBufferOffset = bindingSet->descriptorBufferRange.offset;
+        }
+        else
         {
-            printf("Cannot allocate descriptor set\n");
-            exit(EXIT_FAILURE);
+            // the descriptor set comes from the pools shared by all sets
+            bindingSet->descriptorPoolSizes = getDescriptorPoolSizes(dsInfo, 1);
+            bindingSet->descriptorSet = m_DescriptorAllocator->allocate(dsLayout->descriptorSetLayout,
+                bindingSet->descriptorPoolSizes, &bindingSet->descriptorPool);
+            bindingSet->updateTemplate = dsLayout->updateTemplate;
+            bindingSet->layout = m_LayoutCache.getHandle(dsLayout);
         }
 
         updateDescriptorSet(bindingSet, dsInfo);
+        m_BindingSetRegistry.add(bindingSet);
 
         return BindingSetHandle(bindingSet);
     }
 
+    BindingSetHandle Device::replaceDescriptorSet(BindingSet* bindingSet)
+    {
+        BindingSet* retired = new BindingSet(m_Context);
+
+        if (bindingSet->descriptorBufferLayout)
+        {
+            retired->descriptorBufferRange = bindingSet->descriptorBufferRange;
+
+            bindingSet->descriptorBufferRange = m_DescriptorBufferHeap->allocate(bindingSet->descriptorBufferLayout->size);
+            if (!bindingSet->descriptorBufferRange.isValid())
+            {
+                printf("replaceDescriptorSet: cannot allocate %llu bytes of the descriptor buffer\n",
+                    (unsigned long long)bindingSet->descriptorBufferLayout->size);
+                exit(EXIT_FAILURE);
+            }
+
+            bindingSet->descriptorBufferOffset = bindingSet->descriptorBufferRange.offset;
+        }
+        else
+        {
+            retired->descriptorPool = bindingSet->descriptorPool;
+            retired->descriptorSet = bindingSet->descriptorSet;
+            retired->descriptorPoolSizes = bindingSet->descriptorPoolSizes;
+            retired->ownsDescriptorPool = bindingSet->ownsDescriptorPool;
+
+            BindingLayout* layout = dynamic_cast<BindingLayout*>(bindingSet->layout.get());
+            bindingSet->descriptorPoolSizes = getDescriptorPoolSizes(bindingSet->desc, 1);
+            bindingSet->descriptorSet = m_DescriptorAllocator->allocate(layout->descriptorSetLayout,
+                bindingSet->descriptorPoolSizes, &bindingSet->descriptorPool);
+            bindingSet->ownsDescriptorPool = false;
+        }
+
+        updateDescriptorSet(bindingSet, bindingSet->desc);
+
+        return BindingSetHandle(retired);
+    }
+
+    BindingSetCacheStatistics Device::getBindingSetCacheStatistics() const
+    {
+        return m_BindingSetCache.getStatistics();
+    }
+
+    static VkDescriptorBufferInfo getBufferDescriptor(const BufferAttachment& b)
+    {
+        // the range of a dynamic binding is the slice seen by one draw, not the rest of the buffer
+        assert((b.dInfo.type != DescriptorType::UNIFORM_BUFFER_DYNAMIC && b.dInfo.type != DescriptorType::STORAGE_BUFFER_DYNAMIC) ||
+               b.size > 0);
+
+        return VkDescriptorBufferInfo{
+            static_cast<Buffer*>(b.buffer)->buffer,
+            b.offset,
+            (b.size > 0) ? b.size : VK_WHOLE_SIZE
+        };
+    }
+
+    VkDescriptorImageInfo getImageDescriptor(ITexture* texture, ISampler* sampler, DescriptorType type,
+                                             const TextureSubresource& subresource)
+    {
+        Texture* tex = static_cast<Texture*>(texture);
+        TextureView* subresourceView = tex->GetOrCreateSubresourceView(subresource.resolveTextureSubresource(tex->getDesc()));
+
+        const VkImageLayout layout = type == DescriptorType::STORAGE_IMAGE ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        const VkSampler vkSampler = (sampler != nullptr) ? static_cast<Sampler*>(sampler)->sampler : VK_NULL_HANDLE;
+
+        return VkDescriptorImageInfo{ vkSampler, subresourceView->imageView, layout };
+    }
+
+    // one write per binding of dsInfo, in layout order, together with the infos the writes point to
+    struct DescriptorWrites
+    {
+        std::vector<VkWriteDescriptorSet> writes;
+        std::vector<VkDescriptorBufferInfo> bufferInfos;
+        std::vector<VkDescriptorImageInfo> imageInfos;
+
+        DescriptorWrites(const DescriptorSetInfo& dsInfo, VkDescriptorSet dstSet)
+        {
+            size_t bufferCount = dsInfo.buffers.size();
+            for (const auto& ba : dsInfo.bufferArrays)
+                bufferCount += ba.buffers.size();
+
+            size_t imageCount = dsInfo.textures.size();
+            for (const auto& ta : dsInfo.textureArrays)
+                imageCount += ta.textures.size();
+
+            // the writes keep pointers into the infos, so they must not reallocate
+            bufferInfos.reserve(bufferCount);
+            imageInfos.reserve(imageCount);
+            writes.reserve(dsInfo.buffers.size() + dsInfo.textures.size() + dsInfo.textureArrays.size() + dsInfo.bufferArrays.size());
+
+            uint32_t bindingIdx = 0;
+
+            for (const BufferAttachment& b : dsInfo.buffers)
+            {
+                bufferInfos.push_back(getBufferDescriptor(b));
+                writes.push_back(bufferWriteDescriptorSet(dstSet, &bufferInfos.back(), bindingIdx++, convertDescriptorType(b.dInfo.type)));
+            }
+
+            for (const TextureAttachment& t : dsInfo.textures)
+            {
+                imageInfos.push_back(getImageDescriptor(t.texture, t.sampler, t.dInfo.type, t.dInfo.subresource));
+                writes.push_back(imageWriteDescriptorSet(dstSet, &imageInfos.back(), bindingIdx++, convertDescriptorType(t.dInfo.type)));
+            }
+
+            for (const TextureArrayAttachment& ta : dsInfo.textureArrays)
+            {
+                const size_t first = imageInfos.size();
+                for (ITexture* texture : ta.textures)
+                    imageInfos.push_back(getImageDescriptor(texture, ta.sampler, DescriptorType::COMBINED_IMAGE_SAMPLER, ta.subresource));
+
+                VkWriteDescriptorSet writeSet{};
+                writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeSet.pNext = nullptr;
+                writeSet.dstSet = dstSet;
+                writeSet.dstBinding = bindingIdx++;
+                writeSet.dstArrayElement = 0;
+                writeSet.descriptorCount = static_cast<uint32_t>(ta.textures.size());
+                writeSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writeSet.pImageInfo = imageInfos.data() + first;
+
+                writes.push_back(writeSet);
+            }
+
+            for (const BufferArrayAttachment& ba : dsInfo.bufferArrays)
+            {
+                const size_t first = bufferInfos.size();
+                for (IBuffer* buffer : ba.buffers)
+                    bufferInfos.push_back(VkDescriptorBufferInfo{ static_cast<Buffer*>(buffer)->buffer, 0, VK_WHOLE_SIZE });
+
+                VkWriteDescriptorSet writeSet{};
+                writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeSet.pNext = nullptr;
+                writeSet.dstSet = dstSet;
+                writeSet.dstBinding = bindingIdx++;
+                writeSet.dstArrayElement = 0;
+                writeSet.descriptorCount = static_cast<uint32_t>(ba.buffers.size());
+                writeSet.descriptorType = convertDescriptorType(ba.dInfo.type);
+                writeSet.pBufferInfo = bufferInfos.data() + first;
+
+                writes.push_back(writeSet);
+            }
+        }
+    };
+
     /*
         This routine counts all textures in all texture arrays (if any of them are present),
         creates a list of DescriptorWrite operations with required buffer/image info structures
@@ -184,156 +528,292 @@ namespace RHI::Vulkan
     void Device::updateDescriptorSet(IBindingSet* ds, const DescriptorSetInfo& dsInfo)
     {
         BindingSet *bindingSet = dynamic_cast<BindingSet *>(ds);
-        bindingSet->desc = dsInfo;
 
-        uint32_t bindingIdx = 0;
-        std::vector<VkWriteDescriptorSet> descriptorWrites;
+        // other holders of a shared set see the new content, but it must not be handed out for the old one anymore
+        if (bindingSet->isCached && !isSameDescriptorSetInfo(bindingSet->desc, dsInfo))
+            m_BindingSetCache.remove(bindingSet);
 
-        std::vector<VkDescriptorBufferInfo> bufferDescriptors(dsInfo.buffers.size());
-        std::vector<VkDescriptorImageInfo> imageDescriptors(dsInfo.textures.size());
-        std::vector<VkDescriptorImageInfo> imageArrayDescriptors;
+        // the copy stays, state tracking, the set cache and defragmentation read the resources back from desc. Assigning
+        // reuses the storage of its vectors, so updates of the same shape allocate nothing, and a rewrite from desc copies nothing
+        if (&bindingSet->desc != &dsInfo)
+            bindingSet->desc = dsInfo;
+        bindingSet->dynamicBufferCount = 0;
 
-        for (size_t i = 0; i < dsInfo.buffers.size(); i++)
+        auto isDynamic = [](DescriptorType type) {
+            return type == DescriptorType::UNIFORM_BUFFER_DYNAMIC || type == DescriptorType::STORAGE_BUFFER_DYNAMIC;
+        };
+        for (const auto& b : dsInfo.buffers)
+            bindingSet->dynamicBufferCount += isDynamic(b.dInfo.type) ? 1 : 0;
+        for (const auto& ba : dsInfo.bufferArrays)
+            bindingSet->dynamicBufferCount += isDynamic(ba.dInfo.type) ? static_cast<uint32_t>(ba.buffers.size()) : 0;
+
+        getTexturesWithoutPermanentState(dsInfo, bindingSet->texturesWithoutPermanentState);
+
+        if (bindingSet->descriptorBufferLayout)
         {
-            BufferAttachment b = dsInfo.buffers[i];
+            m_DescriptorBufferHeap->writeDescriptors(bindingSet->descriptorBufferOffset, *bindingSet->descriptorBufferLayout, dsInfo);
+            return;
+        }
+
+        const DescriptorUpdateTemplate* updateTemplate = bindingSet->updateTemplate.get();
+        if (updateTemplate && updateTemplate->matches(dsInfo))
+        {
+            // the whole set is one template update, the descriptor data is packed in layout order
+            DescriptorUpdateTemplate::Entry stackData[DescriptorUpdateTemplate::kMaxStackEntries];
+            std::vector<DescriptorUpdateTemplate::Entry> heapData;
+            DescriptorUpdateTemplate::Entry* data = stackData;
+            if (updateTemplate->entryCount > DescriptorUpdateTemplate::kMaxStackEntries)
+            {
+                heapData.resize(updateTemplate->entryCount);
+                data = heapData.data();
+            }
 
-            Buffer* buffer = dynamic_cast<Buffer*>(b.buffer);
+            DescriptorUpdateTemplate::Entry* entry = data;
+            for (const BufferAttachment& b : dsInfo.buffers)
+                (entry++)->buffer = getBufferDescriptor(b);
 
-            bufferDescriptors[i] = VkDescriptorBufferInfo{
-                buffer->buffer,
-                b.offset,
-                (b.size > 0) ? b.size : VK_WHOLE_SIZE
-            };
+            for (const TextureAttachment& t : dsInfo.textures)
+                (entry++)->image = getImageDescriptor(t.texture, t.sampler, t.dInfo.type, t.dInfo.subresource);
+
+            for (const TextureArrayAttachment& ta : dsInfo.textureArrays)
+            {
+                for (ITexture* texture : ta.textures)
+                    (entry++)->image = getImageDescriptor(texture, ta.sampler, DescriptorType::COMBINED_IMAGE_SAMPLER, ta.subresource);
+            }
+
+            for (const BufferArrayAttachment& ba : dsInfo.bufferArrays)
+            {
+                for (IBuffer* buffer : ba.buffers)
+                    (entry++)->buffer = VkDescriptorBufferInfo{ static_cast<Buffer*>(buffer)->buffer, 0, VK_WHOLE_SIZE };
+            }
 
-            descriptorWrites.push_back(bufferWriteDescriptorSet(bindingSet->descriptorSet, &bufferDescriptors[i],
-                                                                bindingIdx++, convertDescriptorType(b.dInfo.type)));
+            vkUpdateDescriptorSetWithTemplate(m_Context.device, bindingSet->descriptorSet, updateTemplate->updateTemplate, data);
+            return;
         }
 
-        for (size_t i = 0; i < dsInfo.textures.size(); i++)
-        {
-            Texture* tex = dynamic_cast<Texture*>(dsInfo.textures[i].texture);
-            Sampler* sampler = dynamic_cast<Sampler*>(dsInfo.textures[i].sampler);
-            TextureSubresource subresource = dsInfo.textures[i].dInfo.subresource.resolveTextureSubresource(tex->getDesc());
-            TextureView *subresourceView = tex->GetOrCreateSubresourceView(subresource);
+        const DescriptorWrites descriptorWrites(dsInfo, bindingSet->descriptorSet);
+        vkUpdateDescriptorSets(m_Context.device, static_cast<uint32_t>(descriptorWrites.writes.size()), descriptorWrites.writes.data(), 0, nullptr);
+    }
+
 
-            const bool isStorageImage = dsInfo.textures[i].dInfo.type == DescriptorType::STORAGE_IMAGE;
-            VkImageLayout layout = isStorageImage ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            VkSampler vkSampler = (sampler != nullptr) ? sampler->sampler : VK_NULL_HANDLE;
+    void CommandList::BoundBindingSets::reset()
+    {
+        pipelineLayout = VkPipelineLayout();
+        setLayouts.clear();
+        pushConstantRanges.clear();
+        sets.fill(nullptr);
+        for (std::vector<uint32_t> &offsets : dynamicOffsets)
+            offsets.clear();
+    }
 
-            imageDescriptors[i] =
-                VkDescriptorImageInfo{ vkSampler,
-                                       subresourceView->imageView,
-                                       layout };
+    // layouts are only compatible for set binding when they were created with identical push constant ranges
+    static bool samePushConstantRanges(const std::vector<VkPushConstantRange> &a, const std::vector<VkPushConstantRange> &b)
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const VkPushConstantRange &x, const VkPushConstantRange &y) {
+            return x.stageFlags == y.stageFlags && x.offset == y.offset && x.size == y.size;
+        });
+    }
 
-            VkDescriptorType vkDescType = convertDescriptorType(dsInfo.textures[i].dInfo.type);
-            descriptorWrites.push_back(
-                imageWriteDescriptorSet(bindingSet->descriptorSet, &imageDescriptors[i], bindingIdx++, vkDescType));
+    void CommandList::bindBindingSets(
+        VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, const std::vector<VkDescriptorSetLayout> &setLayouts,
+        const std::vector<VkPushConstantRange> &pushConstantRanges, const std::vector<IBindingSet *> &bindingSets,
+        const std::vector<uint32_t> &dynamicOffsets
+    ) {
+        BoundBindingSets &bound = bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? m_BoundComputeSets : m_BoundGraphicsSets;
+
+        if (bound.pipelineLayout != pipelineLayout) {
+            // sets stay bound up to the first set layout that differs, none of them if the push constants differ
+            uint32_t compatibleSets = 0;
+            if (samePushConstantRanges(bound.pushConstantRanges, pushConstantRanges)) {
+                while (compatibleSets < setLayouts.size() && compatibleSets < bound.setLayouts.size() &&
+                       setLayouts[compatibleSets] == bound.setLayouts[compatibleSets]) {
+                    compatibleSets++;
+                }
+            }
 
-            if (!tex->permanentState) {
-                bindingSet->texturesWithoutPermanentState.emplace_back(i);
-            }else {
-                
+            for (uint32_t i = compatibleSets; i < kMaxBindingSets; i++) {
+                bound.sets[i] = nullptr;
+                bound.dynamicOffsets[i].clear();
             }
+
+            bound.pipelineLayout = pipelineLayout;
+            bound.setLayouts = setLayouts;
+            bound.pushConstantRanges = pushConstantRanges;
         }
 
-        uint32_t taOffset = 0;
-        std::vector<uint32_t> taOffsets(dsInfo.textureArrays.size());
-        for (size_t ta = 0; ta < dsInfo.textureArrays.size(); ta++)
-        {
-            taOffsets[ta] = taOffset;
+        VkDescriptorSet descriptorSets[kMaxBindingSets] = {};
+        VkDeviceSize descriptorBufferOffsets[kMaxBindingSets] = {};
+        uint32_t firstOffset[kMaxBindingSets + 1] = {};
+        bool changed[kMaxBindingSets] = {};
 
-            for (size_t j = 0; j < dsInfo.textureArrays[ta].textures.size(); j++)
-            {
-                Texture* tex = dynamic_cast<Texture*>(dsInfo.textureArrays[ta].textures[j]);
-                Sampler *sampler = dynamic_cast<Sampler *>(dsInfo.textureArrays[ta].sampler);
-                TextureSubresource subresource =
-                    dsInfo.textureArrays[ta].subresource.resolveTextureSubresource(tex->getDesc());
-                TextureView *subresourceView = tex->GetOrCreateSubresourceView(subresource);
+        const uint32_t setCount = std::min(uint32_t(bindingSets.size()), kMaxBindingSets);
+
+        // a slot is bound again when its set or its slice of the dynamic offsets differs
+        for (uint32_t i = 0; i < setCount; i++) {
+            BindingSet *binding = dynamic_cast<BindingSet *>(bindingSets[i]);
+            const uint32_t offsetCount = binding ? binding->dynamicBufferCount : 0;
+            firstOffset[i + 1] = firstOffset[i] + offsetCount;
 
-                VkDescriptorImageInfo imageInfo = {
-                    sampler->sampler,
-                    subresourceView->imageView,
-                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                };
+            if (!binding) {
+                continue;
+            }
+
+            assert(firstOffset[i + 1] <= dynamicOffsets.size());
+            descriptorSets[i] = binding->descriptorSet;
+            descriptorBufferOffsets[i] = binding->descriptorBufferOffset;
+
+            const std::vector<uint32_t> &boundOffsets = bound.dynamicOffsets[i];
+            changed[i] = bound.sets[i] != binding || boundOffsets.size() != offsetCount ||
+                         !std::equal(boundOffsets.begin(), boundOffsets.end(), dynamicOffsets.begin() + firstOffset[i]);
+
+            if (!changed[i]) {
+                m_Statistics.descriptorSetBindsSkipped++;
+            }
+        }
+
+        // one bind per contiguous range of changed slots
+        for (uint32_t first = 0; first < setCount; first++) {
+            if (!changed[first]) {
+                continue;
+            }
 
-                imageArrayDescriptors.push_back(imageInfo); // item 'taOffsets[ta] + j'
+            uint32_t last = first;
+            while (last + 1 < setCount && changed[last + 1]) {
+                last++;
             }
 
-            taOffset += static_cast<uint32_t>(dsInfo.textureArrays[ta].textures.size());
+            const uint32_t offsetCount = firstOffset[last + 1] - firstOffset[first];
+            if (m_Context.ctxFeatures.descriptorBuffer) {
+                if (!m_DescriptorBufferBound) {
+                    const VkDescriptorBufferBindingInfoEXT bindingInfo = m_Context.descriptorBufferHeap->getBindingInfo();
+                    vkCmdBindDescriptorBuffersEXT(m_CurrentCommandBuffer->commandBuffer, 1, &bindingInfo);
+                    m_DescriptorBufferBound = true;
+                }
+
+                // every set lives in the one descriptor buffer at index 0
+                const uint32_t bufferIndices[kMaxBindingSets] = {};
+                vkCmdSetDescriptorBufferOffsetsEXT(
+                    m_CurrentCommandBuffer->commandBuffer,
+                    bindPoint,
+                    pipelineLayout,
+                    first,
+                    last - first + 1,
+                    bufferIndices,
+                    descriptorBufferOffsets + first
+                );
+            } else {
+                vkCmdBindDescriptorSets(
+                    m_CurrentCommandBuffer->commandBuffer,
+                    bindPoint,
+                    pipelineLayout,
+                    first,
+                    last - first + 1,
+                    descriptorSets + first,
+                    offsetCount,
+                    offsetCount ? dynamicOffsets.data() + firstOffset[first] : nullptr
+                );
+            }
+
+            for (uint32_t i = first; i <= last; i++) {
+                bound.sets[i] = bindingSets[i];
+                bound.dynamicOffsets[i].assign(dynamicOffsets.begin() + firstOffset[i], dynamicOffsets.begin() + firstOffset[i + 1]);
+            }
+
+            m_Statistics.descriptorSetBinds += last - first + 1;
+            first = last;
         }
+    }
 
-        for (size_t ta = 0; ta < dsInfo.textureArrays.size(); ta++)
-        {
-            VkWriteDescriptorSet writeSet{};
-            writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeSet.pNext = nullptr;
-            writeSet.dstSet = bindingSet->descriptorSet;
-            writeSet.dstBinding = bindingIdx++;
-            writeSet.dstArrayElement = 0;
-            writeSet.descriptorCount = static_cast<uint32_t>(dsInfo.textureArrays[ta].textures.size());
-            writeSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            writeSet.pImageInfo = imageArrayDescriptors.data() + taOffsets[ta];
+    DescriptorUpdateTemplate::DescriptorUpdateTemplate(const VulkanContext &context, VkDescriptorSetLayout layout,
+                                                       const DescriptorSetInfo &dsInfo)
+        : m_Context(context)
+    {
+        uint32_t bindingIdx = 0;
+        std::vector<VkDescriptorUpdateTemplateEntry> entries;
 
-            descriptorWrites.push_back(writeSet);
+        auto addEntry = [&](VkDescriptorType type, uint32_t count) {
+            VkDescriptorUpdateTemplateEntry entry{};
+            entry.dstBinding = bindingIdx++;
+            entry.dstArrayElement = 0;
+            entry.descriptorCount = count;
+            entry.descriptorType = type;
+            entry.offset = entryCount * sizeof(Entry);
+            entry.stride = sizeof(Entry);
+            entries.push_back(entry);
+
+            entryCount += count;
+        };
+
+        for (const auto& b : dsInfo.buffers)
+            addEntry(convertDescriptorType(b.dInfo.type), 1);
+
+        for (const auto& t : dsInfo.textures)
+            addEntry(convertDescriptorType(t.dInfo.type), 1);
+
+        for (const auto& ta : dsInfo.textureArrays)
+        {
+            textureArraySizes.push_back(static_cast<uint32_t>(ta.textures.size()));
+            addEntry(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureArraySizes.back());
         }
 
-        std::vector<VkDescriptorBufferInfo> bufferArrayDescriptors;
         for (const auto& ba : dsInfo.bufferArrays)
         {
-            uint32_t baOffset = static_cast<uint32_t>(bufferArrayDescriptors.size());
-            for (size_t j = 0; j < ba.buffers.size(); j++)
-            {
-                Buffer* buf = dynamic_cast<Buffer*>(ba.buffers[j]);
-                bufferArrayDescriptors.push_back(VkDescriptorBufferInfo{
-                    buf->buffer, 0, VK_WHOLE_SIZE
-                });
-            }
+            bufferArraySizes.push_back(static_cast<uint32_t>(ba.buffers.size()));
+            addEntry(convertDescriptorType(ba.dInfo.type), bufferArraySizes.back());
+        }
 
-            VkWriteDescriptorSet writeSet{};
-            writeSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeSet.pNext = nullptr;
-            writeSet.dstSet = bindingSet->descriptorSet;
-            writeSet.dstBinding = bindingIdx++;
-            writeSet.dstArrayElement = 0;
-            writeSet.descriptorCount = static_cast<uint32_t>(ba.buffers.size());
-            writeSet.descriptorType = convertDescriptorType(ba.dInfo.type);
-            writeSet.pBufferInfo = bufferArrayDescriptors.data() + baOffset;
+        bufferCount = static_cast<uint32_t>(dsInfo.buffers.size());
+        textureCount = static_cast<uint32_t>(dsInfo.textures.size());
 
-            descriptorWrites.push_back(writeSet);
-        }
+        VkDescriptorUpdateTemplateCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        createInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        createInfo.pDescriptorUpdateEntries = entries.data();
+        createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        createInfo.descriptorSetLayout = layout;
 
-        vkUpdateDescriptorSets(m_Context.device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        if (vkCreateDescriptorUpdateTemplate(m_Context.device, &createInfo, nullptr, &updateTemplate) != VK_SUCCESS)
+        {
+            printf("Failed to create descriptor update template\n");
+            exit(EXIT_FAILURE);
+        }
     }
 
+    DescriptorUpdateTemplate::~DescriptorUpdateTemplate()
+    {
+        if (updateTemplate) {
+            vkDestroyDescriptorUpdateTemplate(m_Context.device, updateTemplate, nullptr);
+            updateTemplate = VK_NULL_HANDLE;
+        }
+    }
 
-    void CommandList::bindBindingSets(
-        VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, const std::vector<IBindingSet *> bindingSets
-    ) {
-        VkDescriptorSet descriptorSets[kMaxBindingSets] = {};
+    bool DescriptorUpdateTemplate::matches(const DescriptorSetInfo &dsInfo) const
+    {
+        if (dsInfo.buffers.size() != bufferCount || dsInfo.textures.size() != textureCount ||
+            dsInfo.textureArrays.size() != textureArraySizes.size() || dsInfo.bufferArrays.size() != bufferArraySizes.size())
+            return false;
 
-        uint32_t descriptorMaxIdx = 0u;
-        for (IBindingSet *bindingSet : bindingSets) {
-            if (BindingSet *binding = dynamic_cast<BindingSet *>(bindingSet)) {
-                descriptorSets[descriptorMaxIdx] = binding->descriptorSet;
-            }
+        for (size_t i = 0; i < textureArraySizes.size(); i++)
+        {
+            if (dsInfo.textureArrays[i].textures.size() != textureArraySizes[i])
+                return false;
+        }
 
-            descriptorMaxIdx++;
+        for (size_t i = 0; i < bufferArraySizes.size(); i++)
+        {
+            if (dsInfo.bufferArrays[i].buffers.size() != bufferArraySizes[i])
+                return false;
         }
 
-        vkCmdBindDescriptorSets(
-            m_CurrentCommandBuffer->commandBuffer,
-            bindPoint,
-            pipelineLayout,
-            0,
-            descriptorMaxIdx,
-            descriptorSets,
-            0,
-            nullptr
-        );
+        return true;
     }
 
     BindingLayout::~BindingLayout()
     {
+        if (isCached && m_Context.layoutCache) {
+            m_Context.layoutCache->remove(this);
+        }
+
         if (descriptorSetLayout) {
             vkDestroyDescriptorSetLayout(m_Context.device, descriptorSetLayout, nullptr);
             descriptorSetLayout = VkDescriptorSetLayout();
@@ -345,10 +825,833 @@ namespace RHI::Vulkan
     {}
 
     BindingSet::~BindingSet() {
-        if (descriptorPool) {
+        if (m_Context.bindingSetRegistry) {
+            m_Context.bindingSetRegistry->remove(this);
+        }
+
+        if (isCached && m_Context.bindingSetCache) {
+            m_Context.bindingSetCache->remove(this);
+        }
+
+        if (ownsDescriptorPool && descriptorPool) {
             vkDestroyDescriptorPool(m_Context.device, descriptorPool, nullptr);
-            descriptorPool = VkDescriptorPool();
-            descriptorSet = VkDescriptorSet();
+        } else if (descriptorSet && m_Context.descriptorAllocator) {
+            m_Context.descriptorAllocator->free(descriptorPool, descriptorSet, descriptorPoolSizes);
+        }
+
+        if (m_Context.descriptorBufferHeap) {
+            m_Context.descriptorBufferHeap->free(descriptorBufferRange);
+        }
+
+        descriptorPool = VkDescriptorPool();
+        descriptorSet = VkDescriptorSet();
+    }
+
+    bool BindingSet::referencesAny(const std::unordered_set<IResource*>& resources) const {
+        for (const BufferAttachment &b : desc.buffers) {
+            if (resources.count(b.buffer)) {
+                return true;
+            }
+        }
+
+        for (const TextureAttachment &t : desc.textures) {
+            if (resources.count(t.texture)) {
+                return true;
+            }
+        }
+
+        for (const TextureArrayAttachment &ta : desc.textureArrays) {
+            for (ITexture *texture : ta.textures) {
+                if (resources.count(texture)) {
+                    return true;
+                }
+            }
+        }
+
+        for (const BufferArrayAttachment &ba : desc.bufferArrays) {
+            for (IBuffer *buffer : ba.buffers) {
+                if (resources.count(buffer)) {
+                    return true;
+                }
+            }
         }
+
+        return false;
+    }
+
+    void BindingSetRegistry::add(BindingSet* bindingSet)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_BindingSets.insert(bindingSet);
+    }
+
+    void BindingSetRegistry::remove(BindingSet* bindingSet)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_BindingSets.erase(bindingSet);
+    }
+
+    void BindingSetRegistry::forEach(const std::function<void(BindingSet*)>& callback)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        for (BindingSet* bindingSet : m_BindingSets)
+            callback(bindingSet);
+    }
+
+    size_t BindingSetCache::hash(IBindingLayout* layout, const DescriptorSetInfo& dsInfo)
+    {
+        size_t hash = 0;
+        hashCombine(hash, layout);
+
+        auto hashDescriptorInfo = [&hash](const DescriptorInfo& dInfo) {
+            hashCombine(hash, uint32_t(dInfo.type));
+            hashCombine(hash, uint32_t(dInfo.shaderStageFlags));
+        };
+
+        auto hashSubresource = [&hash](const TextureSubresource& subresource) {
+            hashCombine(hash, subresource.mipLevel);
+            hashCombine(hash, subresource.mipLevelCount);
+            hashCombine(hash, subresource.baseArrayLayer);
+            hashCombine(hash, subresource.layerCount);
+        };
+
+        for (const BufferAttachment& b : dsInfo.buffers)
+        {
+            hashDescriptorInfo(b.dInfo);
+            hashCombine(hash, b.buffer);
+            hashCombine(hash, b.offset);
+            hashCombine(hash, b.size);
+        }
+
+        for (const TextureAttachment& t : dsInfo.textures)
+        {
+            hashDescriptorInfo(t.dInfo);
+            hashSubresource(t.dInfo.subresource);
+            hashCombine(hash, t.texture);
+            hashCombine(hash, t.sampler);
+        }
+
+        for (const TextureArrayAttachment& ta : dsInfo.textureArrays)
+        {
+            hashDescriptorInfo(ta.dInfo);
+            hashSubresource(ta.subresource);
+            hashCombine(hash, ta.sampler);
+            hashCombine(hash, ta.textures.size());
+            for (ITexture* texture : ta.textures)
+                hashCombine(hash, texture);
+        }
+
+        for (const BufferArrayAttachment& ba : dsInfo.bufferArrays)
+        {
+            hashDescriptorInfo(ba.dInfo);
+            hashCombine(hash, ba.buffers.size());
+            for (IBuffer* buffer : ba.buffers)
+                hashCombine(hash, buffer);
+        }
+
+        return hash;
+    }
+
+    BindingSetHandle BindingSetCache::find(IBindingLayout* layout, const DescriptorSetInfo& dsInfo, size_t hash)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto range = m_Entries.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            const Entry& entry = it->second;
+            if (entry.layout != layout || !isSameDescriptorSetInfo(entry.bindingSet->desc, dsInfo))
+                continue;
+
+            // the last handle may be going away right now, the set then removes its entry from its destructor
+            if (BindingSetHandle handle = entry.handle.lock())
+            {
+                m_Statistics.hits++;
+                return handle;
+            }
+        }
+
+        m_Statistics.misses++;
+        return nullptr;
+    }
+
+    void BindingSetCache::add(IBindingLayout* layout, size_t hash, const BindingSetHandle& bindingSet)
+    {
+        BindingSet* set = dynamic_cast<BindingSet*>(bindingSet.get());
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        set->isCached = true;
+        set->cacheHash = hash;
+        m_Entries.emplace(hash, Entry{ layout, set, bindingSet });
+
+        forEachResource(set->desc, [this, set](IResource* resource) {
+            m_SetsByResource[resource].push_back(set);
+        });
+    }
+
+    void BindingSetCache::removeLocked(BindingSet* bindingSet)
+    {
+        if (!bindingSet->isCached)
+            return;
+
+        auto range = m_Entries.equal_range(bindingSet->cacheHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.bindingSet == bindingSet)
+            {
+                m_Entries.erase(it);
+                break;
+            }
+        }
+
+        forEachResource(bindingSet->desc, [this, bindingSet](IResource* resource) {
+            auto it = m_SetsByResource.find(resource);
+            if (it == m_SetsByResource.end())
+                return;
+
+            std::vector<BindingSet*>& sets = it->second;
+            sets.erase(std::remove(sets.begin(), sets.end(), bindingSet), sets.end());
+            if (sets.empty())
+                m_SetsByResource.erase(it);
+        });
+
+        bindingSet->isCached = false;
+    }
+
+    void BindingSetCache::remove(BindingSet* bindingSet)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        removeLocked(bindingSet);
+    }
+
+    void BindingSetCache::evictResource(IResource* resource)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto it = m_SetsByResource.find(resource);
+        if (it == m_SetsByResource.end())
+            return;
+
+        // the sets stay alive for their holders, they are only no longer shared
+        const std::vector<BindingSet*> sets = it->second;
+        for (BindingSet* bindingSet : sets)
+        {
+            removeLocked(bindingSet);
+            m_Statistics.evictions++;
+        }
+    }
+
+    BindingSetCacheStatistics BindingSetCache::getStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        BindingSetCacheStatistics statistics = m_Statistics;
+        statistics.entries = static_cast<uint32_t>(m_Entries.size());
+        return statistics;
+    }
+
+    bool LayoutCache::BindingLayoutKey::operator==(const BindingLayoutKey& other) const
+    {
+        if (flags != other.flags || bindings.size() != other.bindings.size() ||
+            !std::equal(std::begin(attachmentCounts), std::end(attachmentCounts), std::begin(other.attachmentCounts)))
+            return false;
+
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            const VkDescriptorSetLayoutBinding& a = bindings[i];
+            const VkDescriptorSetLayoutBinding& b = other.bindings[i];
+            if (a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount ||
+                a.stageFlags != b.stageFlags)
+                return false;
+        }
+
+        return immutableSamplers == other.immutableSamplers;
+    }
+
+    bool LayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey& other) const
+    {
+        return setLayouts == other.setLayouts && samePushConstantRanges(pushConstantRanges, other.pushConstantRanges);
+    }
+
+    size_t LayoutCache::hash(const BindingLayoutKey& key)
+    {
+        size_t hash = 0;
+        hashCombine(hash, uint32_t(key.flags));
+
+        for (uint32_t count : key.attachmentCounts)
+            hashCombine(hash, count);
+
+        for (const VkDescriptorSetLayoutBinding& binding : key.bindings)
+        {
+            hashCombine(hash, binding.binding);
+            hashCombine(hash, uint32_t(binding.descriptorType));
+            hashCombine(hash, binding.descriptorCount);
+            hashCombine(hash, binding.stageFlags);
+        }
+
+        for (VkSampler sampler : key.immutableSamplers)
+            hashCombine(hash, sampler);
+
+        return hash;
+    }
+
+    size_t LayoutCache::hash(const PipelineLayoutKey& key)
+    {
+        size_t hash = 0;
+        for (const VkPushConstantRange& range : key.pushConstantRanges)
+        {
+            hashCombine(hash, range.stageFlags);
+            hashCombine(hash, range.offset);
+            hashCombine(hash, range.size);
+        }
+
+        for (VkDescriptorSetLayout setLayout : key.setLayouts)
+            hashCombine(hash, setLayout);
+
+        return hash;
+    }
+
+    BindingLayoutHandle LayoutCache::find(const BindingLayoutKey& key, size_t hash)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return findLocked(key, hash);
+    }
+
+    BindingLayoutHandle LayoutCache::findLocked(const BindingLayoutKey& key, size_t hash)
+    {
+        auto range = m_BindingLayouts.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            // the last handle may be going away right now, the layout then removes its entry from its destructor
+            if (it->second.key == key)
+            {
+                if (BindingLayoutHandle handle = it->second.handle.lock())
+                    return handle;
+            }
+        }
+
+        return nullptr;
+    }
+
+    BindingLayoutHandle LayoutCache::getHandle(BindingLayout* layout)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (!layout->isCached)
+            return nullptr;
+
+        auto range = m_BindingLayouts.equal_range(layout->cacheHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.layout == layout)
+                return it->second.handle.lock();
+        }
+
+        return nullptr;
+    }
+
+    std::shared_ptr<PipelineLayout> LayoutCache::find(const PipelineLayoutKey& key, size_t hash)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return findLocked(key, hash);
+    }
+
+    std::shared_ptr<PipelineLayout> LayoutCache::findLocked(const PipelineLayoutKey& key, size_t hash)
+    {
+        auto range = m_PipelineLayouts.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.key == key)
+            {
+                if (std::shared_ptr<PipelineLayout> layout = it->second.handle.lock())
+                    return layout;
+            }
+        }
+
+        return nullptr;
+    }
+
+    BindingLayoutHandle LayoutCache::add(BindingLayoutKey key, size_t hash, const BindingLayoutHandle& layout)
+    {
+        BindingLayout* bindingLayout = dynamic_cast<BindingLayout*>(layout.get());
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (BindingLayoutHandle existing = findLocked(key, hash))
+            return existing;
+
+        bindingLayout->isCached = true;
+        bindingLayout->cacheHash = hash;
+        m_BindingLayouts.emplace(hash, BindingLayoutEntry{ std::move(key), bindingLayout, layout });
+
+        return layout;
+    }
+
+    std::shared_ptr<PipelineLayout> LayoutCache::add(PipelineLayoutKey key, size_t hash, const std::shared_ptr<PipelineLayout>& layout)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (std::shared_ptr<PipelineLayout> existing = findLocked(key, hash))
+            return existing;
+
+        layout->isCached = true;
+        layout->cacheHash = hash;
+        m_PipelineLayouts.emplace(hash, PipelineLayoutEntry{ std::move(key), layout.get(), layout });
+
+        return layout;
+    }
+
+    void LayoutCache::remove(BindingLayout* layout)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto range = m_BindingLayouts.equal_range(layout->cacheHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.layout == layout)
+            {
+                m_BindingLayouts.erase(it);
+                break;
+            }
+        }
+
+        layout->isCached = false;
+    }
+
+    void LayoutCache::remove(PipelineLayout* layout)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto range = m_PipelineLayouts.equal_range(layout->cacheHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.layout == layout)
+            {
+                m_PipelineLayouts.erase(it);
+                break;
+            }
+        }
+
+        layout->isCached = false;
+    }
+
+    DescriptorAllocator::DescriptorAllocator(const VulkanContext& context)
+        : m_Context(context)
+    {}
+
+    DescriptorAllocator::~DescriptorAllocator()
+    {
+        for (auto& pool : m_Pools)
+            vkDestroyDescriptorPool(m_Context.device, pool->pool, nullptr);
+    }
+
+    /* Pool shared by many sets, requiredSizes are the descriptors of the set that is about to be allocated */
+    static VkDescriptorPool createSharedDescriptorPool(const VulkanContext& context, uint32_t maxSets, VkDescriptorPoolCreateFlags flags,
+        const std::vector<VkDescriptorPoolSize>& requiredSizes, std::vector<VkDescriptorPoolSize>* createdSizes = nullptr)
+    {
+        // descriptors per set on average, a set needing more than a whole pool gets a pool large enough for it
+        std::vector<VkDescriptorPoolSize> poolSizes = {
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 * maxSets },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 * maxSets },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * maxSets },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 * maxSets },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 * maxSets },
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 * maxSets }
+        };
+
+        for (const VkDescriptorPoolSize& required : requiredSizes)
+        {
+            auto it = std::find_if(poolSizes.begin(), poolSizes.end(),
+                [&required](const VkDescriptorPoolSize& size) { return size.type == required.type; });
+
+            if (it == poolSizes.end())
+                poolSizes.push_back(required);
+            else
+                it->descriptorCount = std::max(it->descriptorCount, required.descriptorCount);
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = flags;
+        poolInfo.maxSets = maxSets;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+        if (vkCreateDescriptorPool(context.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+        {
+            printf("Cannot allocate descriptor pool\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (createdSizes)
+            *createdSizes = std::move(poolSizes);
+
+        return descriptorPool;
+    }
+
+    static bool hasDescriptorsFor(const std::vector<VkDescriptorPoolSize>& available, const std::vector<VkDescriptorPoolSize>& required)
+    {
+        for (const VkDescriptorPoolSize& size : required)
+        {
+            if (size.descriptorCount == 0)
+                continue;
+
+            auto it = std::find_if(available.begin(), available.end(),
+                [&size](const VkDescriptorPoolSize& a) { return a.type == size.type; });
+
+            if (it == available.end() || it->descriptorCount < size.descriptorCount)
+                return false;
+        }
+
+        return true;
+    }
+
+    static void moveDescriptors(std::vector<VkDescriptorPoolSize>& available, const std::vector<VkDescriptorPoolSize>& sizes, bool take)
+    {
+        for (const VkDescriptorPoolSize& size : sizes)
+        {
+            auto it = std::find_if(available.begin(), available.end(),
+                [&size](const VkDescriptorPoolSize& a) { return a.type == size.type; });
+
+            if (it != available.end())
+                it->descriptorCount = take ? it->descriptorCount - size.descriptorCount : it->descriptorCount + size.descriptorCount;
+        }
+    }
+
+    DescriptorAllocator::Pool* DescriptorAllocator::createPool(const std::vector<VkDescriptorPoolSize>& requiredSizes)
+    {
+        std::unique_ptr<Pool> pool = std::make_unique<Pool>();
+        pool->pool = createSharedDescriptorPool(m_Context, kSetsPerPool, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, requiredSizes,
+            &pool->available);
+
+        m_PoolLookup[pool->pool] = pool.get();
+        m_Pools.push_back(std::move(pool));
+
+        return m_Pools.back().get();
+    }
+
+    VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& poolSizes, VkDescriptorPool* pool)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        auto tryAllocate = [&](Pool* candidate) {
+            allocInfo.descriptorPool = candidate->pool;
+            const VkResult result = vkAllocateDescriptorSets(m_Context.device, &allocInfo, &descriptorSet);
+
+            if (result == VK_SUCCESS)
+            {
+                candidate->allocatedSets++;
+                moveDescriptors(candidate->available, poolSizes, true);
+                *pool = candidate->pool;
+                return true;
+            }
+
+            if (result != VK_ERROR_FRAGMENTED_POOL && result != VK_ERROR_OUT_OF_POOL_MEMORY)
+            {
+                // out of host or device memory, another pool would not help
+                checkSuccess(result);
+                printf("vkAllocateDescriptorSets failed\n");
+                exit(EXIT_FAILURE);
+            }
+
+            // the counts fit, so the pool is fragmented or the driver counts differently, it is tried again once a set is freed
+            candidate->fragmented = true;
+            return false;
+        };
+
+        // the newest pools are the most likely to have space left
+        for (auto it = m_Pools.rbegin(); it != m_Pools.rend(); ++it)
+        {
+            Pool* candidate = it->get();
+            if (candidate->fragmented || candidate->allocatedSets == kSetsPerPool || !hasDescriptorsFor(candidate->available, poolSizes))
+                continue;
+
+            if (tryAllocate(candidate))
+                return descriptorSet;
+        }
+
+        if (!tryAllocate(createPool(poolSizes)))
+        {
+            printf("Cannot allocate descriptor set\n");
+            exit(EXIT_FAILURE);
+        }
+
+        return descriptorSet;
+    }
+
+    void DescriptorAllocator::free(VkDescriptorPool descriptorPool, VkDescriptorSet descriptorSet, const std::vector<VkDescriptorPoolSize>& poolSizes)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto it = m_PoolLookup.find(descriptorPool);
+        if (it == m_PoolLookup.end())
+            return;
+
+        Pool* pool = it->second;
+        vkFreeDescriptorSets(m_Context.device, pool->pool, 1, &descriptorSet);
+        pool->allocatedSets--;
+        moveDescriptors(pool->available, poolSizes, false);
+        pool->fragmented = false;
+
+        // empty pools are released, except the newest one that the next sets are allocated from
+        if (pool->allocatedSets == 0 && pool != m_Pools.back().get())
+        {
+            vkDestroyDescriptorPool(m_Context.device, pool->pool, nullptr);
+            m_PoolLookup.erase(it);
+            m_Pools.erase(std::find_if(m_Pools.begin(), m_Pools.end(),
+                [pool](const std::unique_ptr<Pool>& p) { return p.get() == pool; }));
+        }
+    }
+
+    TransientDescriptorManager::TransientDescriptorManager(Device* device, const VulkanContext& context, CommandQueue queueID)
+        : m_Device(device), m_Context(context), m_QueueID(queueID)
+        , m_Submission(std::make_shared<std::atomic<uint64_t>>(0))
+    {
+    }
+
+    static void destroyTransientPool(const VulkanContext& context, TransientDescriptorPool& pool)
+    {
+        // the sets go away with the pool, not one by one
+        for (const auto& bindingSet : pool.bindingSets)
+            bindingSet->descriptorSet = VkDescriptorSet();
+
+        if (pool.pool)
+            vkDestroyDescriptorPool(context.device, pool.pool, nullptr);
+        if (context.descriptorBufferHeap)
+            context.descriptorBufferHeap->free(pool.descriptorBufferRange);
+    }
+
+    TransientDescriptorManager::~TransientDescriptorManager()
+    {
+        // the open recording dies with the command list, nothing can submit it anymore
+        if (m_CurrentPool)
+            destroyTransientPool(m_Context, *m_CurrentPool);
+
+        Queue* queue = m_Device->getQueue(m_QueueID);
+        const uint64_t lastFinishedID = queue->updateLastFinishedID();
+
+        for (const TransientDescriptorPoolPtr& pool : m_PoolList)
+        {
+            const uint64_t submissionID = *pool->submission;
+
+            if (pool->submission == m_Submission || (submissionID != 0 && submissionID <= lastFinishedID))
+            {
+                destroyTransientPool(m_Context, *pool);
+                continue;
+            }
+
+            // submitted and still executing, or closed for a primary list that has not been submitted yet
+            const VulkanContext& context = m_Context;
+            queue->deferRelease(pool->submission, [&context, pool] { destroyTransientPool(context, *pool); });
+        }
+    }
+
+    bool TransientDescriptorManager::allocateFromCurrentPool(VkDescriptorSetLayout layout, VkDescriptorSet* descriptorSet)
+    {
+        if (!m_CurrentPool)
+            return false;
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_CurrentPool->pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        return vkAllocateDescriptorSets(m_Context.device, &allocInfo, descriptorSet) == VK_SUCCESS;
+    }
+
+    BindingSet* TransientDescriptorManager::allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& poolSizes)
+    {
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        if (!allocateFromCurrentPool(layout, &descriptorSet))
+        {
+            if (m_CurrentPool)
+            {
+                m_PoolList.push_back(m_CurrentPool);
+                m_CurrentPool = nullptr;
+            }
+
+            if (recycleFinishedPool([](const TransientDescriptorPool&) { return true; }))
+                checkSuccess(vkResetDescriptorPool(m_Context.device, m_CurrentPool->pool, 0));
+
+            // a recycled pool may be too small for a large set
+            if (!m_CurrentPool || !allocateFromCurrentPool(layout, &descriptorSet))
+            {
+                if (m_CurrentPool)
+                    m_PoolList.push_back(m_CurrentPool);
+
+                m_CurrentPool = std::make_shared<TransientDescriptorPool>();
+                m_CurrentPool->pool = createSharedDescriptorPool(m_Context, kSetsPerPool, 0, poolSizes);
+
+                if (!allocateFromCurrentPool(layout, &descriptorSet))
+                {
+                    printf("Cannot allocate transient descriptor set\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            m_CurrentPool->submission = m_Submission;
+        }
+
+        BindingSet* bindingSet = nextBindingSet();
+        bindingSet->descriptorSet = descriptorSet;
+
+        return bindingSet;
+    }
+
+    BindingSet* TransientDescriptorManager::allocate(const std::shared_ptr<DescriptorBufferLayout>& layout)
+    {
+        auto fits = [&layout](const TransientDescriptorPool& pool) {
+            return pool.descriptorBufferUsed + layout->size <= pool.descriptorBufferRange.size;
+        };
+
+        if (!m_CurrentPool || !fits(*m_CurrentPool))
+        {
+            if (m_CurrentPool)
+            {
+                m_PoolList.push_back(m_CurrentPool);
+                m_CurrentPool = nullptr;
+            }
+
+            if (!recycleFinishedPool(fits))
+            {
+                m_CurrentPool = std::make_shared<TransientDescriptorPool>();
+                m_CurrentPool->descriptorBufferRange =
+                    m_Context.descriptorBufferHeap->allocate(std::max(kDescriptorBufferRangeSize, layout->size));
+
+                if (!m_CurrentPool->descriptorBufferRange.isValid())
+                {
+                    printf("Cannot allocate transient descriptor set\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            m_CurrentPool->submission = m_Submission;
+        }
+
+        BindingSet* bindingSet = nextBindingSet();
+        bindingSet->descriptorBufferLayout = layout;
+        bindingSet->descriptorBufferOffset = m_CurrentPool->descriptorBufferRange.offset + m_CurrentPool->descriptorBufferUsed;
+        m_CurrentPool->descriptorBufferUsed += layout->size;
+
+        return bindingSet;
+    }
+
+    bool TransientDescriptorManager::recycleFinishedPool(const std::function<bool(const TransientDescriptorPool&)>& fits)
+    {
+        const uint64_t lastFinishedID = m_Device->getQueue(m_QueueID)->updateLastFinishedID();
+
+        for (auto it = m_PoolList.begin(); it != m_PoolList.end(); ++it)
+        {
+            const uint64_t submissionID = *(*it)->submission;
+
+            if (submissionID != 0 && submissionID <= lastFinishedID)
+            {
+                TransientDescriptorPool& pool = **it;
+                pool.usedSets = 0;
+                pool.descriptorBufferUsed = 0;
+
+                if (!fits(pool))
+                    continue;
+
+                m_CurrentPool = *it;
+                m_PoolList.erase(it);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    BindingSet* TransientDescriptorManager::nextBindingSet()
+    {
+        // binding set objects are reused with the pool
+        std::vector<std::unique_ptr<BindingSet>>& bindingSets = m_CurrentPool->bindingSets;
+        if (m_CurrentPool->usedSets == bindingSets.size())
+            bindingSets.push_back(std::make_unique<BindingSet>(m_Context));
+
+        return bindingSets[m_CurrentPool->usedSets++].get();
+    }
+
+    std::shared_ptr<std::atomic<uint64_t>> TransientDescriptorManager::closeRecording()
+    {
+        std::shared_ptr<std::atomic<uint64_t>> submission = m_Submission;
+
+        if (m_CurrentPool)
+        {
+            m_PoolList.push_back(m_CurrentPool);
+            m_CurrentPool = nullptr;
+        }
+
+        m_Submission = std::make_shared<std::atomic<uint64_t>>(0);
+        return submission;
+    }
+
+    void TransientDescriptorManager::submitPools(uint64_t submissionID)
+    {
+        *closeRecording() = submissionID;
+    }
+
+    IBindingSet* CommandList::createTransientBindingSet(IBindingLayout* bindingLayout, const DescriptorSetInfo& dsInfo)
+    {
+        BindingLayout* layout = dynamic_cast<BindingLayout*>(bindingLayout);
+        assert(!layout->pushDescriptor);
+
+        BindingSet* bindingSet = layout->descriptorBufferLayout
+            ? m_TransientDescriptors.allocate(layout->descriptorBufferLayout)
+            : m_TransientDescriptors.allocate(layout->descriptorSetLayout, getDescriptorPoolSizes(dsInfo, 1));
+        bindingSet->updateTemplate = layout->updateTemplate;
+        m_Device->updateDescriptorSet(bindingSet, dsInfo);
+
+        return bindingSet;
+    }
+
+    void CommandList::pushDescriptorSet(uint32_t setIndex, const DescriptorSetInfo& dsInfo)
+    {
+        assert(m_CurrentCommandBuffer);
+        assert(setIndex < kMaxBindingSets);
+
+        const bool isCompute = m_CurrentComputeState.pipeline != nullptr;
+        const VkPipelineBindPoint bindPoint = isCompute ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS;
+        BoundBindingSets& bound = isCompute ? m_BoundComputeSets : m_BoundGraphicsSets;
+        assert(bound.pipelineLayout);
+
+        if (m_EnableAutoBarriers)
+        {
+            if (m_CommandListParameters.isSecondary)
+            {
+                // the parent transitions them before it executes this list
+                m_SecondaryPushDescriptors.push_back(dsInfo);
+            }
+            else if (!m_CurrentGraphicsState.framebuffer)
+            {
+                getTexturesWithoutPermanentState(dsInfo, m_PushTextureIndices);
+                requireDescriptorTextureStates(dsInfo, m_PushTextureIndices);
+                commitBarriers();
+            }
+            // inside a render pass of this list they were transitioned from GraphicsState::pushDescriptorSets
+        }
+
+        const DescriptorWrites descriptorWrites(dsInfo, VK_NULL_HANDLE);
+        vkCmdPushDescriptorSetKHR(m_CurrentCommandBuffer->commandBuffer, bindPoint, bound.pipelineLayout, setIndex,
+            static_cast<uint32_t>(descriptorWrites.writes.size()), descriptorWrites.writes.data());
+
+        // the slot holds no set now, binding one there again must not be skipped
+        bound.sets[setIndex] = nullptr;
+        bound.dynamicOffsets[setIndex].clear();
+
+        m_Statistics.descriptorSetPushes++;
     }
 }
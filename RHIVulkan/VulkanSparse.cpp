@@ -0,0 +1,411 @@
+#include <VulkanBackend.hpp>
+
+#include <algorithm>
+
+namespace RHI::Vulkan
+{
+    struct SparseTileChunk
+    {
+        MemoryAllocation allocation;
+        VkDeviceSize tileSize = 0;
+        std::vector<uint32_t> freeTiles;
+        uint32_t usedTiles = 0;
+    };
+
+    SparseTilePool::SparseTilePool(const VulkanContext& context)
+        : m_Context(context)
+    {}
+
+    SparseTilePool::~SparseTilePool()
+    {
+        for (auto& chunk : m_Chunks)
+        {
+            m_Context.memoryAllocator->free(chunk->allocation);
+        }
+    }
+
+    void SparseTilePool::freeTile(const SparseTile& tile)
+    {
+        SparseTileChunk* chunk = tile.chunk;
+        chunk->freeTiles.push_back(tile.index);
+        chunk->usedTiles--;
+        m_UsedBytes -= chunk->tileSize;
+
+        if (chunk->usedTiles == 0)
+        {
+            auto it = std::find_if(m_Chunks.begin(), m_Chunks.end(),
+                [chunk](const std::unique_ptr<SparseTileChunk>& c) { return c.get() == chunk; });
+
+            m_Context.memoryAllocator->free(chunk->allocation);
+            m_Chunks.erase(it);
+        }
+    }
+
+    void SparseTilePool::reclaimPendingTiles()
+    {
+        // one snapshot per queue, so freeing a tile and dropping its entry always agree
+        uint64_t finishedIDs[uint32_t(CommandQueue::Count)] = {};
+        bool queried[uint32_t(CommandQueue::Count)] = {};
+
+        size_t kept = 0;
+        for (size_t i = 0; i < m_PendingTiles.size(); i++)
+        {
+            const PendingTile& pending = m_PendingTiles[i];
+            const uint32_t queueID = uint32_t(pending.queue->getQueueID());
+
+            if (!queried[queueID])
+            {
+                finishedIDs[queueID] = pending.queue->updateLastFinishedID();
+                queried[queueID] = true;
+            }
+
+            if (pending.submissionID <= finishedIDs[queueID])
+                freeTile(pending.tile);
+            else
+                m_PendingTiles[kept++] = pending;
+        }
+
+        m_PendingTiles.resize(kept);
+    }
+
+    SparseTile SparseTilePool::allocate(VkDeviceSize tileSize, uint32_t memoryTypeBits)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        reclaimPendingTiles();
+
+        if (m_UsedBytes + tileSize > m_Budget)
+            return SparseTile();
+
+        SparseTileChunk* chunk = nullptr;
+        for (auto& c : m_Chunks)
+        {
+            if (c->tileSize == tileSize && !c->freeTiles.empty() && (memoryTypeBits & (1u << c->allocation.memoryTypeIndex)))
+            {
+                chunk = c.get();
+                break;
+            }
+        }
+
+        if (!chunk)
+        {
+            // a partial chunk at the end of the budget, so the last tiles can still be committed
+            const VkDeviceSize remainingTiles = (m_Budget - m_UsedBytes) / tileSize;
+            const uint32_t tileCount = uint32_t(std::min<VkDeviceSize>(kTilesPerChunk, remainingTiles));
+
+            std::unique_ptr<SparseTileChunk> newChunk = std::make_unique<SparseTileChunk>();
+            newChunk->tileSize = tileSize;
+            newChunk->allocation = m_Context.memoryAllocator->allocateHeapMemory(tileSize * tileCount,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memoryTypeBits);
+
+            // the tile stays unmapped, like a tile over the budget
+            if (!newChunk->allocation.isValid())
+                return SparseTile();
+
+            for (uint32_t i = tileCount; i > 0; i--)
+                newChunk->freeTiles.push_back(i - 1);
+
+            chunk = newChunk.get();
+            m_Chunks.push_back(std::move(newChunk));
+        }
+
+        SparseTile tile;
+        tile.chunk = chunk;
+        tile.index = chunk->freeTiles.back();
+
+        chunk->freeTiles.pop_back();
+        chunk->usedTiles++;
+        m_UsedBytes += tileSize;
+
+        return tile;
+    }
+
+    void SparseTilePool::release(const SparseTile& tile, Queue* queue, uint64_t submissionID)
+    {
+        if (!tile.isValid())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (queue)
+            m_PendingTiles.push_back(PendingTile{ tile, queue, submissionID });
+        else
+            freeTile(tile);
+    }
+
+    VkDeviceMemory SparseTilePool::getMemory(const SparseTile& tile) const
+    {
+        return tile.chunk->allocation.memory;
+    }
+
+    VkDeviceSize SparseTilePool::getMemoryOffset(const SparseTile& tile) const
+    {
+        return tile.chunk->allocation.offset + tile.index * tile.chunk->tileSize;
+    }
+
+    void SparseTilePool::setBudget(VkDeviceSize bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Budget = bytes;
+    }
+
+    VkDeviceSize SparseTilePool::getUsage() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_UsedBytes;
+    }
+
+    static uint32_t divideRoundingUp(uint32_t value, uint32_t divisor)
+    {
+        return (value + divisor - 1) / divisor;
+    }
+
+    void Device::initSparsePageTable(Texture* texture)
+    {
+        const TextureDesc& desc = texture->desc;
+
+        std::unique_ptr<SparsePageTable> pageTable = std::make_unique<SparsePageTable>();
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_Context.device, texture->image, &memRequirements);
+
+        pageTable->tileSize = memRequirements.alignment;
+        pageTable->memoryTypeBits = memRequirements.memoryTypeBits;
+
+        uint32_t requirementCount = 0;
+        vkGetImageSparseMemoryRequirements(m_Context.device, texture->image, &requirementCount, nullptr);
+        std::vector<VkSparseImageMemoryRequirements> requirements(requirementCount);
+        vkGetImageSparseMemoryRequirements(m_Context.device, texture->image, &requirementCount, requirements.data());
+
+        const VkImageAspectFlags aspect = pickImageAspect(desc.format);
+        for (const VkSparseImageMemoryRequirements& r : requirements)
+        {
+            if (r.formatProperties.aspectMask & aspect)
+                pageTable->requirements = r;
+            else if (r.formatProperties.aspectMask & VK_IMAGE_ASPECT_METADATA_BIT)
+                printf("Sparse texture '%s' needs metadata, which is never made resident\n", desc.debugName.c_str());
+        }
+
+        const VkSparseImageMemoryRequirements& r = pageTable->requirements;
+        const VkExtent3D granularity = r.formatProperties.imageGranularity;
+
+        TextureTiling& tiling = pageTable->tiling;
+        tiling.tileWidth = granularity.width;
+        tiling.tileHeight = granularity.height;
+        tiling.tileDepth = granularity.depth;
+        tiling.tileSizeInBytes = pageTable->tileSize;
+        tiling.packedMipLevel = std::min(r.imageMipTailFirstLod, desc.mipLevels);
+        tiling.mipTailTileCount = uint32_t((r.imageMipTailSize + pageTable->tileSize - 1) / pageTable->tileSize);
+        tiling.singleMipTail = (r.formatProperties.flags & VK_SPARSE_IMAGE_FORMAT_SINGLE_MIPTAIL_BIT) != 0;
+
+        uint32_t tilesPerLayer = 0;
+        for (uint32_t mipLevel = 0; mipLevel < tiling.packedMipLevel; mipLevel++)
+        {
+            TextureTiling::MipLevel level;
+            level.tilesX = divideRoundingUp(std::max(desc.width >> mipLevel, 1u), granularity.width);
+            level.tilesY = divideRoundingUp(std::max(desc.height >> mipLevel, 1u), granularity.height);
+            level.tilesZ = divideRoundingUp(std::max(desc.depth >> mipLevel, 1u), granularity.depth);
+
+            tiling.mipLevels.push_back(level);
+            tilesPerLayer += level.tilesX * level.tilesY * level.tilesZ;
+        }
+
+        // tiles are stored layer by layer, mip by mip inside a layer
+        pageTable->firstTile.resize(desc.layerCount * tiling.packedMipLevel);
+        uint32_t firstTile = 0;
+        for (uint32_t layer = 0; layer < desc.layerCount; layer++)
+        {
+            for (uint32_t mipLevel = 0; mipLevel < tiling.packedMipLevel; mipLevel++)
+            {
+                const TextureTiling::MipLevel& level = tiling.mipLevels[mipLevel];
+                pageTable->firstTile[layer * tiling.packedMipLevel + mipLevel] = firstTile;
+                firstTile += level.tilesX * level.tilesY * level.tilesZ;
+            }
+        }
+
+        pageTable->tiles.resize(size_t(tilesPerLayer) * desc.layerCount);
+        pageTable->mipTails.resize(tiling.singleMipTail ? 1 : desc.layerCount);
+
+        texture->pageTable = std::move(pageTable);
+    }
+
+    TextureTiling Device::getTextureTiling(ITexture* texture)
+    {
+        Texture* tex = dynamic_cast<Texture*>(texture);
+
+        if (!tex->pageTable)
+            return TextureTiling();
+
+        return tex->pageTable->tiling;
+    }
+
+    bool Device::setTextureTilesResident(ITexture* texture, const std::vector<TextureTile>& tiles, bool resident, CommandQueue executionQueue)
+    {
+        Texture* tex = dynamic_cast<Texture*>(texture);
+        SparsePageTable* pageTable = tex->pageTable.get();
+        Queue* queue = getQueue(executionQueue);
+
+        if (!pageTable || !queue || !queue->supportsSparseBinding())
+        {
+            printf("Cannot change the residency of texture '%s'\n", tex->desc.debugName.c_str());
+            return false;
+        }
+
+        const TextureTiling& tiling = pageTable->tiling;
+        const VkImageAspectFlags aspect = pickImageAspect(tex->desc.format);
+
+        std::vector<VkSparseImageMemoryBind> binds;
+        std::vector<SparseTile*> changedTiles;
+
+        for (const TextureTile& tile : tiles)
+        {
+            if (tile.mipLevel >= tiling.packedMipLevel || tile.arrayLayer >= tex->desc.layerCount)
+                continue;
+
+            const TextureTiling::MipLevel& level = tiling.mipLevels[tile.mipLevel];
+            if (tile.x >= level.tilesX || tile.y >= level.tilesY || tile.z >= level.tilesZ)
+                continue;
+
+            const uint32_t index = pageTable->firstTile[tile.arrayLayer * tiling.packedMipLevel + tile.mipLevel] +
+                                   (tile.z * level.tilesY + tile.y) * level.tilesX + tile.x;
+
+            SparseTile& entry = pageTable->tiles[index];
+            if (entry.isValid() == resident)
+                continue;
+
+            if (resident)
+            {
+                entry = m_SparseTilePool->allocate(pageTable->tileSize, pageTable->memoryTypeBits);
+
+                // over budget or out of device memory, undo the tiles committed by this call
+                if (!entry.isValid())
+                {
+                    for (SparseTile* changed : changedTiles)
+                    {
+                        m_SparseTilePool->release(*changed, nullptr, 0);
+                        *changed = SparseTile();
+                    }
+                    return false;
+                }
+            }
+
+            const uint32_t mipWidth = std::max(tex->desc.width >> tile.mipLevel, 1u);
+            const uint32_t mipHeight = std::max(tex->desc.height >> tile.mipLevel, 1u);
+            const uint32_t mipDepth = std::max(tex->desc.depth >> tile.mipLevel, 1u);
+
+            VkSparseImageMemoryBind bind{};
+            bind.subresource = VkImageSubresource{ aspect, tile.mipLevel, tile.arrayLayer };
+            bind.offset = VkOffset3D{ int32_t(tile.x * tiling.tileWidth), int32_t(tile.y * tiling.tileHeight), int32_t(tile.z * tiling.tileDepth) };
+            bind.extent.width = std::min(tiling.tileWidth, mipWidth - tile.x * tiling.tileWidth);
+            bind.extent.height = std::min(tiling.tileHeight, mipHeight - tile.y * tiling.tileHeight);
+            bind.extent.depth = std::min(tiling.tileDepth, mipDepth - tile.z * tiling.tileDepth);
+            bind.memory = resident ? m_SparseTilePool->getMemory(entry) : VK_NULL_HANDLE;
+            bind.memoryOffset = resident ? m_SparseTilePool->getMemoryOffset(entry) : 0;
+
+            binds.push_back(bind);
+            changedTiles.push_back(&entry);
+        }
+
+        if (binds.empty())
+            return true;
+
+        VkSparseImageMemoryBindInfo imageBind{};
+        imageBind.image = tex->image;
+        imageBind.bindCount = uint32_t(binds.size());
+        imageBind.pBinds = binds.data();
+
+        const uint64_t submissionID = queue->bindSparse({ imageBind }, {});
+
+        if (!resident)
+        {
+            for (SparseTile* changed : changedTiles)
+            {
+                m_SparseTilePool->release(*changed, queue, submissionID);
+                *changed = SparseTile();
+            }
+        }
+
+        return true;
+    }
+
+    bool Device::setTextureMipTailResident(ITexture* texture, uint32_t arrayLayer, bool resident, CommandQueue executionQueue)
+    {
+        Texture* tex = dynamic_cast<Texture*>(texture);
+        SparsePageTable* pageTable = tex->pageTable.get();
+        Queue* queue = getQueue(executionQueue);
+
+        if (!pageTable || !queue || !queue->supportsSparseBinding())
+        {
+            printf("Cannot change the residency of texture '%s'\n", tex->desc.debugName.c_str());
+            return false;
+        }
+
+        const TextureTiling& tiling = pageTable->tiling;
+        if (tiling.mipTailTileCount == 0)
+            return true;
+
+        const uint32_t mipTailIndex = tiling.singleMipTail ? 0 : arrayLayer;
+        if (mipTailIndex >= pageTable->mipTails.size())
+            return false;
+
+        std::vector<SparseTile>& mipTail = pageTable->mipTails[mipTailIndex];
+        if (!mipTail.empty() == resident)
+            return true;
+
+        if (resident)
+        {
+            for (uint32_t i = 0; i < tiling.mipTailTileCount; i++)
+            {
+                SparseTile tile = m_SparseTilePool->allocate(pageTable->tileSize, pageTable->memoryTypeBits);
+                if (!tile.isValid())
+                {
+                    for (const SparseTile& allocated : mipTail)
+                        m_SparseTilePool->release(allocated, nullptr, 0);
+                    mipTail.clear();
+                    return false;
+                }
+
+                mipTail.push_back(tile);
+            }
+        }
+
+        // the mip tail is bound through opaque offsets in the image, one tile at a time
+        const VkSparseImageMemoryRequirements& r = pageTable->requirements;
+        const VkDeviceSize mipTailOffset = r.imageMipTailOffset + mipTailIndex * r.imageMipTailStride;
+
+        std::vector<VkSparseMemoryBind> binds(tiling.mipTailTileCount);
+        for (uint32_t i = 0; i < tiling.mipTailTileCount; i++)
+        {
+            binds[i].resourceOffset = mipTailOffset + i * pageTable->tileSize;
+            binds[i].size = std::min(pageTable->tileSize, r.imageMipTailSize - i * pageTable->tileSize);
+            binds[i].memory = resident ? m_SparseTilePool->getMemory(mipTail[i]) : VK_NULL_HANDLE;
+            binds[i].memoryOffset = resident ? m_SparseTilePool->getMemoryOffset(mipTail[i]) : 0;
+        }
+
+        VkSparseImageOpaqueMemoryBindInfo opaqueBind{};
+        opaqueBind.image = tex->image;
+        opaqueBind.bindCount = uint32_t(binds.size());
+        opaqueBind.pBinds = binds.data();
+
+        const uint64_t submissionID = queue->bindSparse({}, { opaqueBind });
+
+        if (!resident)
+        {
+            for (const SparseTile& tile : mipTail)
+                m_SparseTilePool->release(tile, queue, submissionID);
+            mipTail.clear();
+        }
+
+        return true;
+    }
+
+    void Device::setSparseMemoryBudget(uint64_t bytes)
+    {
+        m_SparseTilePool->setBudget(bytes);
+    }
+
+    uint64_t Device::getSparseMemoryUsage() const
+    {
+        return m_SparseTilePool->getUsage();
+    }
+}
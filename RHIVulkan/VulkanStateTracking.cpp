@@ -12,8 +12,12 @@ namespace RHI::Vulkan
         }
 
         BindingSet *binding = static_cast<BindingSet *>(bindingSet);
-        for (auto &textureIdx : binding->texturesWithoutPermanentState) {
-            TextureAttachment &textureAttachment = binding->desc.textures[textureIdx];
+        requireDescriptorTextureStates(binding->desc, binding->texturesWithoutPermanentState);
+    }
+
+    void CommandList::requireDescriptorTextureStates(const DescriptorSetInfo &dsInfo, const std::vector<uint16_t> &textureIndices) {
+        for (auto &textureIdx : textureIndices) {
+            const TextureAttachment &textureAttachment = dsInfo.textures[textureIdx];
 
             switch (textureAttachment.dInfo.type) {
             case DescriptorType::COMBINED_IMAGE_SAMPLER:
@@ -24,10 +28,26 @@ namespace RHI::Vulkan
         }
     }
 
+    bool CommandList::graphicsBindingSetsChanged(const std::vector<IBindingSet *> &bindingSets) const {
+        // a compute state in between may have moved the resources of the same sets into other states
+        if (!m_CurrentGraphicsState.pipeline || bindingSets.size() > kMaxBindingSets) {
+            return true;
+        }
+
+        for (uint32_t i = 0; i < kMaxBindingSets; i++) {
+            IBindingSet *bindingSet = i < bindingSets.size() ? bindingSets[i] : nullptr;
+            if (m_BoundGraphicsSets.sets[i] != bindingSet) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     void CommandList::trackResourcesAndBarriers(const GraphicsState &state) {
         assert(m_EnableAutoBarriers);
 
-        if (arraysAreDifferent(state.bindingSets, m_CurrentGraphicsState.bindingSets)) {
+        if (graphicsBindingSetsChanged(state.bindingSets)) {
             for (size_t i = 0; i < state.bindingSets.size(); i++) {
                 setResourceStatesForBindingSet(state.bindingSets[i]);
             }
@@ -35,7 +55,25 @@ namespace RHI::Vulkan
 
         if (m_CurrentGraphicsState.framebuffer != state.framebuffer) {
             setTextureStatesForFramebuffer(state.framebuffer);
+
+            // the render pass begins next, pushes inside it cannot transition anything
+            for (const DescriptorSetInfo *dsInfo : state.pushDescriptorSets) {
+                getTexturesWithoutPermanentState(*dsInfo, m_PushTextureIndices);
+                requireDescriptorTextureStates(*dsInfo, m_PushTextureIndices);
+            }
+        }
+#ifndef NDEBUG
+        else if (!state.pushDescriptorSets.empty()) {
+            // the render pass stays open, a pushed texture that needs a transition would get its barrier inside it
+            const size_t barrierCount = m_StateTracker.getTextureBarriers().size();
+            for (const DescriptorSetInfo *dsInfo : state.pushDescriptorSets) {
+                getTexturesWithoutPermanentState(*dsInfo, m_PushTextureIndices);
+                requireDescriptorTextureStates(*dsInfo, m_PushTextureIndices);
+            }
+            assert(m_StateTracker.getTextureBarriers().size() == barrierCount &&
+                "pushed textures must be in their shader state before the render pass, or come with a new framebuffer");
         }
+#endif
     }
 
     void CommandList::transitionBufferLayout(IBuffer *buffer, ImageLayout oldLayout, ImageLayout newLayout) {
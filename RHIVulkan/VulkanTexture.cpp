@@ -1,35 +1,138 @@
 #include <VulkanBackend.hpp>
+#include <Common/Miscellaneous.hpp>
 
 #include <assert.h>
+#include <cstring>
 
 namespace RHI::Vulkan
 {
     Texture::~Texture()
     {
+        if (m_Context.bindlessHeap)
+            m_Context.bindlessHeap->releaseTexture(this);
+
+        if (m_Context.bindingSetCache)
+            m_Context.bindingSetCache->evictResource(this);
+
         for (auto &viewPair : subresourceViews) {
             VkImageView &view = viewPair.second.imageView;
             vkDestroyImageView(m_Context.device, view, nullptr);
             view = VkImageView();
         }
 
+        if (pageTable)
+        {
+            for (const SparseTile& tile : pageTable->tiles)
+                m_Context.sparseTilePool->release(tile, nullptr, 0);
+
+            for (const auto& mipTail : pageTable->mipTails)
+                for (const SparseTile& tile : mipTail)
+                    m_Context.sparseTilePool->release(tile, nullptr, 0);
+        }
+
         if (managed)
         {
             if (image)
             {
                 vkDestroyImage(m_Context.device, image, nullptr);
             }
-            if (memory)
-            {
-                vkFreeMemory(m_Context.device, memory, nullptr);
-            }
+            m_Context.memoryAllocator->free(allocation);
         }
     }
 
     Sampler::~Sampler()
     {
+        if (isCached && m_Context.samplerCache)
+            m_Context.samplerCache->remove(this);
+
+        if (m_Context.bindlessHeap)
+            m_Context.bindlessHeap->releaseSampler(this);
+
+        if (m_Context.bindingSetCache)
+            m_Context.bindingSetCache->evictResource(this);
+
         vkDestroySampler(m_Context.device, sampler, nullptr);
     }
 
+    size_t SamplerCache::hash(const SamplerDesc& desc, bool depthSampler)
+    {
+        size_t hash = 0;
+        hashCombine(hash, depthSampler);
+        hashCombine(hash, uint32_t(desc.addressU));
+        hashCombine(hash, uint32_t(desc.addressV));
+        hashCombine(hash, uint32_t(desc.addressW));
+        hashCombine(hash, uint32_t(desc.minFilter));
+        hashCombine(hash, uint32_t(desc.magFilter));
+        hashCombine(hash, uint32_t(desc.mipFilter));
+        hashCombine(hash, desc.anisotropyEnable);
+        hashCombine(hash, desc.maxAnisotropy);
+        return hash;
+    }
+
+    SamplerHandle SamplerCache::find(const SamplerDesc& desc, bool depthSampler, size_t hash)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto range = m_Entries.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            const Sampler* sampler = it->second.sampler;
+            if (sampler->depthSampler != depthSampler || sampler->desc != desc)
+                continue;
+
+            // the last handle may be going away right now, the sampler then removes its entry from its destructor
+            if (SamplerHandle handle = it->second.handle.lock())
+                return handle;
+        }
+
+        return nullptr;
+    }
+
+    SamplerHandle SamplerCache::getHandle(Sampler* sampler)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (!sampler->isCached)
+            return nullptr;
+
+        auto range = m_Entries.equal_range(sampler->cacheHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.sampler == sampler)
+                return it->second.handle.lock();
+        }
+
+        return nullptr;
+    }
+
+    void SamplerCache::add(size_t hash, const SamplerHandle& sampler)
+    {
+        Sampler* s = static_cast<Sampler*>(sampler.get());
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        s->isCached = true;
+        s->cacheHash = hash;
+        m_Entries.emplace(hash, Entry{ s, sampler });
+    }
+
+    void SamplerCache::remove(Sampler* sampler)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto range = m_Entries.equal_range(sampler->cacheHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.sampler == sampler)
+            {
+                m_Entries.erase(it);
+                break;
+            }
+        }
+
+        sampler->isCached = false;
+    }
+
     VkFormat Device::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
     {
         for (VkFormat format : candidates)
@@ -53,18 +156,7 @@ namespace RHI::Vulkan
 
     uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
     {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(m_Context.physicalDevice, &memProperties);
-
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-        {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-            {
-                return i;
-            }
-        }
-
-        return 0xFFFFFFFF;
+        return m_MemoryAllocator->findMemoryType(typeFilter, properties);
     }
 
     Format Device::findDepthFormat()
@@ -127,6 +219,18 @@ namespace RHI::Vulkan
         if (desc.usage.isUAV)
             ret |= VK_IMAGE_USAGE_STORAGE_BIT;
 
+        if (desc.usage.isTransientAttachment)
+        {
+            // transient images may only be used as attachments
+            const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+            if (ret != 0 && (ret & ~attachmentUsage) == 0)
+                ret |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            else
+                printf("Transient attachment %s has non attachment usage, it gets regular memory\n", desc.debugName.c_str());
+        }
+
         return ret;
     }
 
@@ -140,6 +244,25 @@ namespace RHI::Vulkan
             ret |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
         }
 
+        if (!!(desc.flags & CreateFlagBits::MUTABLE_FORMAT_BIT))
+            ret |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+
+        if (!!(desc.flags & CreateFlagBits::ARRAY_2D_COMPATIBLE_BIT))
+            ret |= VK_IMAGE_CREATE_2D_ARRAY_COMPATIBLE_BIT;
+
+        // placed textures may share memory with others
+        if (!!(desc.flags & CreateFlagBits::ALIAS_BIT) || desc.isVirtual)
+            ret |= VK_IMAGE_CREATE_ALIAS_BIT;
+
+        if (!!(desc.flags & CreateFlagBits::SPARSE_BINDING_BIT))
+            ret |= VK_IMAGE_CREATE_SPARSE_BINDING_BIT;
+
+        if (!!(desc.flags & CreateFlagBits::SPARSE_RESIDENCY_BIT))
+            ret |= VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+
+        if (!!(desc.flags & CreateFlagBits::SPARSE_ALIASED_BIT))
+            ret |= VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_ALIASED_BIT;
+
         return ret;
     }
 
@@ -158,6 +281,41 @@ namespace RHI::Vulkan
         }
     }
 
+    uint64_t fillMipCopyRegions(const TextureDesc &desc, std::vector<VkBufferImageCopy> &regions)
+    {
+        const FormatInfo formatInfo = getFormatInfo(desc.format);
+
+        regions.resize(desc.mipLevels);
+
+        uint64_t offset = 0;
+        for (uint32_t i = 0; i < desc.mipLevels; i++)
+        {
+            const uint32_t mipWidth = std::max(desc.width >> i, 1u);
+            const uint32_t mipHeight = std::max(desc.height >> i, 1u);
+            const uint32_t mipDepth = std::max(desc.depth >> i, 1u);
+
+            const uint32_t numColumns = (mipWidth + formatInfo.blockSize - 1) / formatInfo.blockSize;
+            const uint32_t numRows = (mipHeight + formatInfo.blockSize - 1) / formatInfo.blockSize;
+            const uint64_t layerSize = uint64_t(numColumns) * formatInfo.bytesPerBlock * numRows * mipDepth;
+
+            VkBufferImageCopy &region = regions[i];
+            region = VkBufferImageCopy{};
+            region.bufferOffset = offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = pickImageAspect(desc.format);
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = desc.layerCount;
+            region.imageOffset = VkOffset3D{ 0, 0, 0 };
+            region.imageExtent = VkExtent3D{ mipWidth, mipHeight, mipDepth };
+
+            offset += layerSize * desc.layerCount;
+        }
+
+        return offset;
+    }
+
     static VkImageType textureDimensionToImageType(TextureDimension dimension)
     {
         switch (dimension)
@@ -243,23 +401,50 @@ namespace RHI::Vulkan
         Texture* tex = new Texture(m_Context);
         fillImageInfo(tex, desc);
 
+        const VkImageCreateFlags sparseFlags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT | VK_IMAGE_CREATE_SPARSE_ALIASED_BIT;
+        const bool sparse = (tex->imageInfo.flags & VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT) != 0;
+
+        // only partially resident textures are supported, a fully bound sparse image behaves like a regular one
+        if ((tex->imageInfo.flags & sparseFlags) && (!sparse || !m_Context.ctxFeatures.sparseResidencyImage2D))
+        {
+            printf("Sparse residency is not available for texture '%s', creating it fully resident\n", desc.debugName.c_str());
+            tex->imageInfo.flags &= ~sparseFlags;
+        }
+
         checkSuccess(vkCreateImage(m_Context.device, &tex->imageInfo, nullptr, &tex->image));
 
         m_Context.setVkImageName(tex->image, desc.debugName.c_str());
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(m_Context.device, tex->image, &memRequirements);
+        // sparse textures get their memory tile by tile from setTextureTilesResident
+        if (tex->imageInfo.flags & VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT)
+        {
+            initSparsePageTable(tex);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, pickMemoryProperties(desc.memoryProperties));
+            if (m_BindlessHeap)
+                m_BindlessHeap->registerTexture(tex);
 
-        checkSuccess(vkAllocateMemory(m_Context.device, &allocInfo, nullptr, &tex->memory));
+            return TextureHandle(tex);
+        }
 
-        vkBindImageMemory(m_Context.device, tex->image, tex->memory, 0);
-        return TextureHandle(tex);
+        // virtual textures get their memory from bindTextureMemory
+        if (desc.isVirtual)
+            return TextureHandle(tex);
+
+        VkMemoryPropertyFlags memoryProperties = pickMemoryProperties(desc.memoryProperties);
+        if (tex->imageInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+            memoryProperties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+        tex->allocation = m_MemoryAllocator->allocateImageMemory(tex->image, memoryProperties, desc.isLinearTiling);
+
+        checkSuccess(vkBindImageMemory(m_Context.device, tex->image, tex->allocation.memory, tex->allocation.offset));
+
+        TextureHandle handle(tex);
+        m_MemoryAllocator->registerResource(tex, handle);
+
+        if (m_BindlessHeap)
+            m_BindlessHeap->registerTexture(tex);
+
+        return handle;
     }
 
     TextureDimension getDimensionForFramebuffer(TextureDimension dimension, bool isArray) {
@@ -326,6 +511,10 @@ namespace RHI::Vulkan
 
     SamplerHandle Device::createTextureSampler(const SamplerDesc& desc)
     {
+        const size_t hash = SamplerCache::hash(desc, false);
+        if (SamplerHandle cached = m_SamplerCache.find(desc, false, hash))
+            return cached;
+
         VkSamplerCreateInfo samplerInfo{};
         samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
         samplerInfo.pNext = nullptr;
@@ -347,6 +536,7 @@ namespace RHI::Vulkan
         samplerInfo.unnormalizedCoordinates = VK_FALSE;
 
         Sampler* sampler = new Sampler(m_Context);
+        sampler->desc = desc;
 
         if(vkCreateSampler(m_Context.device, &samplerInfo, nullptr, &sampler->sampler) != VK_SUCCESS)
         {
@@ -354,11 +544,21 @@ namespace RHI::Vulkan
             exit(EXIT_FAILURE);
         }
 
-        return SamplerHandle(sampler);
+        if (m_BindlessHeap)
+            m_BindlessHeap->registerSampler(sampler);
+
+        SamplerHandle handle(sampler);
+        m_SamplerCache.add(hash, handle);
+
+        return handle;
     }
 
     SamplerHandle Device::createDepthSampler()
     {
+        const size_t hash = SamplerCache::hash(SamplerDesc(), true);
+        if (SamplerHandle cached = m_SamplerCache.find(SamplerDesc(), true, hash))
+            return cached;
+
         VkSamplerCreateInfo si{};
         si.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
         si.pNext = nullptr;
@@ -375,6 +575,7 @@ namespace RHI::Vulkan
         si.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 
         Sampler* sampler = new Sampler(m_Context);
+        sampler->depthSampler = true;
 
         if(vkCreateSampler(m_Context.device, &si, nullptr, &sampler->sampler) != VK_SUCCESS)
         {
@@ -382,7 +583,13 @@ namespace RHI::Vulkan
             exit(EXIT_FAILURE);
         }
 
-        return SamplerHandle(sampler);
+        if (m_BindlessHeap)
+            m_BindlessHeap->registerSampler(sampler);
+
+        SamplerHandle handle(sampler);
+        m_SamplerCache.add(hash, handle);
+
+        return handle;
     }
 
     bool CommandList::updateTextureImage(
@@ -412,10 +619,7 @@ namespace RHI::Vulkan
             depthPitch = rowPitch * deviceNumRows;
         }
 
-        BufferDesc stagingDesc = BufferDesc{}.setSize(deviceMemSize).setIsTransferSrc(true).setMemoryProperties(
-            MemoryPropertiesBits::HOST_VISIBLE_BIT | MemoryPropertiesBits::HOST_COHERENT_BIT
-        );
-        BufferHandle stagingBuffer = m_Device->createBuffer(stagingDesc);
+        BufferHandle stagingBuffer = m_Context.stagingBufferPool->acquire(deviceMemSize);
         m_CurrentCommandBuffer->referencedStagingBuffers.push_back(stagingBuffer);
 
         // m_Device->uploadBufferData(stagingBuffer.get(), 0, imageData, imageSize);
@@ -445,21 +649,54 @@ namespace RHI::Vulkan
         return true;
     }
 
+    bool CommandList::updateTextureImageAllMips(ITexture *texture, const void *imageData)
+    {
+        endRenderPass();
+
+        Texture *tex = dynamic_cast<Texture *>(texture);
+
+        std::vector<VkBufferImageCopy> regions;
+        const uint64_t totalSize = fillMipCopyRegions(tex->desc, regions);
+
+        BufferHandle stagingBuffer = m_Context.stagingBufferPool->acquire(totalSize);
+        m_CurrentCommandBuffer->referencedStagingBuffers.push_back(stagingBuffer);
+
+        Buffer *buf = dynamic_cast<Buffer *>(stagingBuffer.get());
+        memcpy(buf->ptr, imageData, totalSize);
+
+        if (m_EnableAutoBarriers) {
+            m_StateTracker.requireTextureState(
+                tex, { 0, tex->desc.mipLevels, 0, tex->desc.layerCount }, ResourceStates::CopyDestination
+            );
+        }
+        commitBarriers();
+
+        vkCmdCopyBufferToImage(
+            m_CurrentCommandBuffer->commandBuffer, buf->buffer, tex->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            (uint32_t)regions.size(), regions.data()
+        );
+
+        return true;
+    }
+
     void* Device::mapStagingTextureMemory(ITexture* texture, size_t offset, size_t size)
     {
         Texture* tex = dynamic_cast<Texture*>(texture);
 
-        void* mappedData = nullptr;
-        vkMapMemory(m_Context.device, tex->memory, offset, size, 0, &mappedData);
+        uint8_t* mappedData = static_cast<uint8_t*>(m_MemoryAllocator->getMappedPointer(tex->allocation));
+        if (!mappedData)
+            return nullptr;
+
+        m_MemoryAllocator->invalidate(tex->allocation, offset, size);
 
-        return mappedData;
+        return mappedData + offset;
     }
 
     void Device::unmapStagingTextureMemory(ITexture* texture)
     {
         Texture* tex = dynamic_cast<Texture*>(texture);
 
-        vkUnmapMemory(m_Context.device, tex->memory);
+        m_MemoryAllocator->flush(tex->allocation);
     }
 
     TextureHandle Device::createTextureForNative(VkImage image, VkImageView imageView, const TextureDesc& desc)